@@ -1,26 +1,34 @@
 #version 410 core
 
-layout (location = 0) out vec3 out_geometry;
-layout (location = 1) out vec3 out_normal;
-layout (location = 2) out vec4 out_albedo_specular;
+/* octahedral, mapped to [0, 1] so the compact layout's unsigned normalized target holds it */
+layout (location = 0) out vec2 out_normal;
+layout (location = 1) out vec4 out_albedo_specular;
 
-in vec3 v_pos;
 in vec2 v_uv;
 in vec3 v_normal;
+flat in vec3 v_material_color;
 
-uniform mat4 unif_model_rotation;
-uniform vec3 unif_material_color;
 uniform sampler2D unif_texture_albedo;
 uniform sampler2D unif_texture_normal;
 uniform sampler2D unif_texture_specular;
 
+vec2 octahedral_encode(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 folded = n.xy;
+	if (n.z < 0.0) {
+		vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+		folded = (1.0 - abs(n.yx)) * signs;
+	}
+
+	return folded * 0.5 + 0.5;
+}
+
 void main() {
-	out_geometry = v_pos;
 	vec4 albedo = texture(unif_texture_albedo, v_uv);
 	if (albedo.a == 0.0) {
 		albedo = vec4(1.0, 1.0, 1.0, 1.0);
 	}
 
-	out_normal = normalize(texture(unif_texture_normal, v_uv).xyz + v_normal);
-	out_albedo_specular = vec4(unif_material_color * vec3(albedo), texture(unif_texture_specular, v_uv).r);
+	out_normal = octahedral_encode(normalize(texture(unif_texture_normal, v_uv).xyz + v_normal));
+	out_albedo_specular = vec4(v_material_color * vec3(albedo), texture(unif_texture_specular, v_uv).r);
 }
\ No newline at end of file
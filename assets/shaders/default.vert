@@ -4,16 +4,33 @@ layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec2 in_uv;
 layout (location = 2) in vec3 in_normal;
 
-out vec3 v_pos;
 out vec2 v_uv;
 out vec3 v_normal;
+flat out vec3 v_material_color;
 
-uniform mat4 unif_mvp;
-uniform mat4 unif_model;
+layout (std140) uniform frame_data {
+	mat4 frame_vp;
+	vec4 frame_view_pos;
+	float frame_time;
+	mat4 frame_inverse_vp;
+};
+
+/* per-draw records, 9 texels each: model (4), model rotation (4), material color (1)
+ * in_draw_record is the instance's record id (offset by base_instance for indirect draws),
+ * unif_draw_index is added on top for plain instanced draws */
+layout (location = 15) in uint in_draw_record;
+uniform samplerBuffer unif_draw_data;
+uniform int unif_draw_index;
+
+mat4 draw_data_mat4(int offset) {
+	int base = (unif_draw_index + int(in_draw_record)) * 9 + offset;
+	return mat4(texelFetch(unif_draw_data, base), texelFetch(unif_draw_data, base + 1), texelFetch(unif_draw_data, base + 2), texelFetch(unif_draw_data, base + 3));
+}
 
 void main() {
-	gl_Position = unif_mvp * vec4(in_pos, 1.0);
-	v_pos = vec3(unif_model * vec4(in_pos, 1.0));
+	mat4 model = draw_data_mat4(0);
+	gl_Position = frame_vp * model * vec4(in_pos, 1.0);
 	v_uv = in_uv;
-	v_normal = vec3(unif_model * vec4(in_normal, 1.0));
-}
\ No newline at end of file
+	v_normal = vec3(model * vec4(in_normal, 1.0));
+	v_material_color = texelFetch(unif_draw_data, (unif_draw_index + int(in_draw_record)) * 9 + 8).rgb;
+}
@@ -2,54 +2,124 @@
 
 out vec4 out_color;
 
-uniform sampler2D unif_gbuffer_geometry;
+uniform sampler2D unif_gbuffer_depth;
 uniform sampler2D unif_gbuffer_normal;
 uniform sampler2D unif_gbuffer_albedo_specular;
-uniform sampler2D unif_gbuffer_shadows;
+uniform sampler2DShadow unif_shadow_atlas;
 uniform vec2 unif_screen;
-uniform vec3 unif_view_pos;
-uniform float unif_time;
+
+/* two texels per light: position and radius, then color times intensity and the light's shadow entry or -1.
+ * cluster c lists its lights in unif_cluster_lights from unif_cluster_offsets[c] up to unif_cluster_offsets[c + 1] */
+uniform samplerBuffer unif_light_data;
+uniform usamplerBuffer unif_cluster_offsets;
+uniform usamplerBuffer unif_cluster_lights;
+uniform ivec3 unif_cluster_grid;
+/* slice = log(view depth) * x + y */
+uniform vec2 unif_cluster_depth;
+/* five texels per shadow entry: the light's view projection, then its atlas tile's origin and size in uv and half a texel */
+uniform samplerBuffer unif_shadow_data;
+
+layout (std140) uniform frame_data {
+	mat4 frame_vp;
+	vec4 frame_view_pos;
+	float frame_time;
+	mat4 frame_inverse_vp;
+};
 
 const float gamma = 2.2;
 const float ambient = 0.2;
-const float light_strength = 20;
-const vec3 light_color = vec3(1.0, 1.0, 1.0);
 const float default_shininess = 1000;
+const float shadow_bias = 0.0005;
+
+vec3 octahedral_decode(vec2 encoded) {
+	encoded = encoded * 2.0 - 1.0;
+	vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -fold : fold;
+	n.y += n.y >= 0.0 ? -fold : fold;
+	return normalize(n);
+}
+
+/* 1 where the light reaches position, fragments outside the light's frustum are lit */
+float shadow_visibility(int shadow, vec3 position) {
+	int base = shadow * 5;
+	mat4 light_vp = mat4(texelFetch(unif_shadow_data, base), texelFetch(unif_shadow_data, base + 1), texelFetch(unif_shadow_data, base + 2), texelFetch(unif_shadow_data, base + 3));
+	vec4 tile = texelFetch(unif_shadow_data, base + 4);
+
+	vec4 light_space = light_vp * vec4(position, 1.0);
+	if (light_space.w <= 0.0) {
+		return 1.0;
+	}
+
+	vec3 coords = light_space.xyz / light_space.w * 0.5 + 0.5;
+	if (any(lessThan(coords, vec3(0.0))) || any(greaterThan(coords, vec3(1.0)))) {
+		return 1.0;
+	}
+
+	/* kept half a texel inside the tile so filtering never reads a neighbour's */
+	vec2 uv = clamp(tile.xy + coords.xy * tile.z, tile.xy + tile.w, tile.xy + tile.z - tile.w);
+	return texture(unif_shadow_atlas, vec3(uv, coords.z - shadow_bias));
+}
 
 void main() {
 	vec2 uv = gl_FragCoord.xy / unif_screen;
-	vec3 position = texture(unif_gbuffer_geometry, uv).xyz;
-	vec3 normal = texture(unif_gbuffer_normal, uv).rgb;
-	vec3 albedo = texture(unif_gbuffer_albedo_specular, uv).rgb;
-	float shininess = texture(unif_gbuffer_albedo_specular, uv).a;
-	float shadow = texture(unif_gbuffer_shadows, uv).r;
+	/* the g-buffer may be larger than what was rendered into it, so it's read by pixel and uv only covers the rendered part */
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float window_depth = texelFetch(unif_gbuffer_depth, pixel, 0).r;
+	vec2 encoded_normal = texelFetch(unif_gbuffer_normal, pixel, 0).rg;
+	vec4 albedo_specular = texelFetch(unif_gbuffer_albedo_specular, pixel, 0);
+	vec3 albedo = albedo_specular.rgb;
+	float shininess = albedo_specular.a;
+
+	/* nothing was drawn here */
+	if (window_depth == 1.0) {
+		out_color = vec4(pow(albedo * ambient, vec3(1.0 / gamma)), 1.0);
+		return;
+	}
 
 	if (shininess == 0) {
 		shininess = default_shininess;
 	}
 
-	vec3 light_pos = vec3(sin(unif_time), 1, cos(unif_time));
+	vec3 normal = octahedral_decode(encoded_normal);
 
-	vec3 light_dir = light_pos - position;
-	float distance = length(light_dir);
-	light_dir = normalize(light_dir);
+	/* the unprojected point's w is 1 / clip w, and view depth is clip w, the same value the lights were binned by */
+	vec4 unprojected = frame_inverse_vp * vec4(vec3(uv, window_depth) * 2.0 - 1.0, 1.0);
+	vec3 position = unprojected.xyz / unprojected.w;
+	float depth = 1.0 / unprojected.w;
+	float slice = floor(log(max(depth, 1e-4)) * unif_cluster_depth.x + unif_cluster_depth.y);
+	ivec3 cell = clamp(ivec3(ivec2(floor(uv * vec2(unif_cluster_grid.xy))), int(slice)), ivec3(0), unif_cluster_grid - 1);
+	int cluster = (cell.z * unif_cluster_grid.y + cell.y) * unif_cluster_grid.x + cell.x;
+	int first = int(texelFetch(unif_cluster_offsets, cluster).r);
+	int last = int(texelFetch(unif_cluster_offsets, cluster + 1).r);
 
-	vec3 view_dir = normalize(light_pos - position);
+	vec3 view_dir = normalize(frame_view_pos.xyz - position);
+	vec3 lit = vec3(0.0);
+	for (int i = first; i < last; i++) {
+		int light = int(texelFetch(unif_cluster_lights, i).r);
+		vec4 position_radius = texelFetch(unif_light_data, light * 2);
+		vec4 color_shadow = texelFetch(unif_light_data, light * 2 + 1);
 
-	vec3 half_dir = normalize(light_dir + view_dir);
-	float spec = pow(max(dot(normal, half_dir), 0.0), shininess);
-	vec3 specular = spec * light_color;
+		vec3 light_dir = position_radius.xyz - position;
+		float distance_squared = dot(light_dir, light_dir);
+		float reach = distance_squared / (position_radius.w * position_radius.w);
+		if (reach >= 1.0) {
+			continue;
+		}
 
-	float diff = max(dot(normal, light_dir), 0.0);
-	vec3 diffuse = diff * light_color;
+		/* inverse square falloff faded to zero at the radius */
+		float window = 1.0 - reach * reach;
+		float attenuation = window * window / max(distance_squared, 1e-4);
+		light_dir *= inversesqrt(max(distance_squared, 1e-8));
 
-	vec3 result = albedo * (ambient + (1.0 - shadow) * (diffuse + specular) * light_strength) / (distance * distance);
-	if (unif_screen.x == 0) {
-		result = diffuse + spec + position + normal + albedo + shadow + vec3(uv, 0.0) * shininess;
-	}
-	if (unif_screen.x > 800) {
-		result = 1.0 - vec3(shadow, shadow, shadow);
+		vec3 half_dir = normalize(light_dir + view_dir);
+		float spec = pow(max(dot(normal, half_dir), 0.0), shininess);
+		float diff = max(dot(normal, light_dir), 0.0);
+		float visibility = (color_shadow.w >= 0.0) ? shadow_visibility(int(color_shadow.w), position) : 1.0;
+
+		lit += (diff + spec) * color_shadow.rgb * attenuation * visibility;
 	}
 
+	vec3 result = albedo * (ambient + lit);
 	out_color = vec4(pow(result, vec3(1.0 / gamma)), 1.0);
-}
\ No newline at end of file
+}
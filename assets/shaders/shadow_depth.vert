@@ -3,8 +3,19 @@
 layout (location = 0) in vec3 in_pos;
 
 uniform mat4 unif_light_vp;
-uniform mat4 unif_model;
+
+/* per-draw records, 9 texels each: model (4), model rotation (4), material color (1)
+ * in_draw_record is the instance's record id (offset by base_instance for indirect draws),
+ * unif_draw_index is added on top for plain instanced draws */
+layout (location = 15) in uint in_draw_record;
+uniform samplerBuffer unif_draw_data;
+uniform int unif_draw_index;
+
+mat4 draw_data_mat4(int offset) {
+	int base = (unif_draw_index + int(in_draw_record)) * 9 + offset;
+	return mat4(texelFetch(unif_draw_data, base), texelFetch(unif_draw_data, base + 1), texelFetch(unif_draw_data, base + 2), texelFetch(unif_draw_data, base + 3));
+}
 
 void main() {
-	gl_Position = unif_light_vp * unif_model * vec4(in_pos, 1.0);
-}
\ No newline at end of file
+	gl_Position = unif_light_vp * draw_data_mat4(0) * vec4(in_pos, 1.0);
+}
@@ -0,0 +1,56 @@
+#include "allocation_counter.hpp"
+
+#ifdef ALLOCATION_COUNTING
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+static std::atomic<u64> allocations(0);
+
+static void* counted_allocate(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void* block = std::malloc(size == 0 ? 1 : size);
+	if (block == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	return block;
+}
+
+/* over-allocates and keeps malloc's pointer right below the aligned block, aligned_alloc isn't everywhere */
+static void* counted_allocate_aligned(std::size_t size, std::align_val_t alignment) {
+	std::size_t align = static_cast<std::size_t>(alignment);
+	void* block = counted_allocate(size + align + sizeof(void*));
+	std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(block) + sizeof(void*) + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+	reinterpret_cast<void**>(aligned)[-1] = block;
+	return reinterpret_cast<void*>(aligned);
+}
+
+static void counted_free_aligned(void* pointer) {
+	if (pointer != nullptr) {
+		std::free(reinterpret_cast<void**>(pointer)[-1]);
+	}
+}
+
+void* operator new(std::size_t size) { return counted_allocate(size); }
+void* operator new[](std::size_t size) { return counted_allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return counted_allocate_aligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return counted_allocate_aligned(size, alignment); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { counted_free_aligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { counted_free_aligned(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { counted_free_aligned(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { counted_free_aligned(pointer); }
+
+u64 allocation_count() {
+	return allocations.load(std::memory_order_relaxed);
+}
+#else
+u64 allocation_count() {
+	return 0;
+}
+#endif
@@ -0,0 +1,10 @@
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+
+#include "types.hpp"
+
+/* heap allocations made through operator new by every thread so far.
+ * only counted when built with ALLOCATION_COUNTING, which replaces the global operator new and delete, always 0 otherwise */
+u64 allocation_count();
+
+#endif
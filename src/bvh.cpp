@@ -0,0 +1,598 @@
+#include "bvh.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+
+static aabb_t aabb_union(const aabb_t& a, const aabb_t& b) {
+	aabb_t box;
+	for (usize c = 0; c < 3; c++) {
+		box.min[c] = std::min(a.min[c], b.min[c]);
+		box.max[c] = std::max(a.max[c], b.max[c]);
+	}
+
+	return box;
+}
+
+static b8 aabb_contains(const aabb_t& outer, const aabb_t& inner) {
+	for (usize c = 0; c < 3; c++) {
+		if (inner.min[c] < outer.min[c] || inner.max[c] > outer.max[c]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* f64 so unbounded boxes don't overflow the insertion costs */
+static f64 aabb_surface(const aabb_t& box) {
+	f64 x = static_cast<f64>(box.max[0]) - box.min[0];
+	f64 y = static_cast<f64>(box.max[1]) - box.min[1];
+	f64 z = static_cast<f64>(box.max[2]) - box.min[2];
+	return 2.0 * (x * y + y * z + z * x);
+}
+
+static aabb_t aabb_from_bounds(const bounds_t& bounds, f32 margin) {
+	aabb_t box;
+	for (usize c = 0; c < 3; c++) {
+		box.min[c] = bounds.center[c] - bounds.extent[c] - margin;
+		box.max[c] = bounds.center[c] + bounds.extent[c] + margin;
+	}
+
+	return box;
+}
+
+/* a bit per lane whose box is outside a plane and per lane whose box is inside every plane */
+static void bvh_wide_classify(const bvh_wide_node_t& node, const frustum_t& frustum, u32& outside_bits, u32& inside_bits) {
+	outside_bits = 0;
+	inside_bits = 0;
+
+#ifdef VF_LANES
+	for (usize first = 0; first < BVH_WIDE; first += VF_LANES) {
+		vf cx = vf_load(node.center[0] + first);
+		vf cy = vf_load(node.center[1] + first);
+		vf cz = vf_load(node.center[2] + first);
+		vf ex = vf_load(node.extent[0] + first);
+		vf ey = vf_load(node.extent[1] + first);
+		vf ez = vf_load(node.extent[2] + first);
+
+		vf outside = vf_set(0.0f);
+		vf crossing = vf_set(0.0f);
+		for (usize i = 0; i < 6; i++) {
+			const vec4& plane = frustum.planes[i];
+			vf distance = vf_add(vf_add(vf_mul(vf_set(plane[0]), cx), vf_mul(vf_set(plane[1]), cy)), vf_add(vf_mul(vf_set(plane[2]), cz), vf_set(plane[3])));
+			vf projected = vf_add(vf_add(vf_mul(vf_set(std::fabs(plane[0])), ex), vf_mul(vf_set(std::fabs(plane[1])), ey)), vf_mul(vf_set(std::fabs(plane[2])), ez));
+			outside = vf_or(outside, vf_less(vf_add(distance, projected), vf_set(0.0f)));
+			crossing = vf_or(crossing, vf_less(distance, projected));
+		}
+
+		outside_bits |= vf_mask_bits(outside) << first;
+		inside_bits |= (~vf_mask_bits(crossing) & ((1u << VF_LANES) - 1)) << first;
+	}
+#else
+	for (usize lane = 0; lane < node.used; lane++) {
+		b8 outside = false;
+		b8 crossing = false;
+		for (usize p = 0; p < 6 && !outside; p++) {
+			const vec4& plane = frustum.planes[p];
+			f32 distance = plane[0] * node.center[0][lane] + plane[1] * node.center[1][lane] + plane[2] * node.center[2][lane] + plane[3];
+			f32 projected = std::fabs(plane[0]) * node.extent[0][lane] + std::fabs(plane[1]) * node.extent[1][lane] + std::fabs(plane[2]) * node.extent[2][lane];
+			outside = distance + projected < 0;
+			crossing = crossing || distance < projected;
+		}
+
+		outside_bits |= (outside ? 1u : 0u) << lane;
+		inside_bits |= (crossing ? 0u : 1u) << lane;
+	}
+#endif
+}
+
+static f32 aabb_distance_squared(const aabb_t& box, const vec3 point) {
+	f32 distance = 0;
+	for (usize c = 0; c < 3; c++) {
+		f32 d = std::max(box.min[c] - point[c], std::max(0.0f, point[c] - box.max[c]));
+		distance += d * d;
+	}
+
+	return distance;
+}
+
+/* slab test, enter is where the ray enters the box or 0 when it starts inside */
+static b8 aabb_ray(const aabb_t& box, const vec3 origin, const vec3 inverse_direction, f32 max_distance, f32& enter) {
+	f32 near = 0;
+	f32 far = max_distance;
+	for (usize c = 0; c < 3; c++) {
+		f32 a = (box.min[c] - origin[c]) * inverse_direction[c];
+		f32 b = (box.max[c] - origin[c]) * inverse_direction[c];
+		near = std::max(near, std::min(a, b));
+		far = std::min(far, std::max(a, b));
+		if (near > far) {
+			return false;
+		}
+	}
+
+	enter = near;
+	return true;
+}
+
+bvh_c::bvh_c(f32 margin) {
+	this->root = BVH_NONE;
+	this->margin = margin;
+	this->wide_refits = 0;
+	this->wide_stale = true;
+}
+
+u32 bvh_c::allocate_node() {
+	u32 node = static_cast<u32>(this->nodes.size());
+	if (!this->free_nodes.empty()) {
+		node = this->free_nodes.back();
+		this->free_nodes.pop_back();
+	} else {
+		this->nodes.emplace_back();
+	}
+
+	this->nodes[node] = {};
+	this->nodes[node].parent = BVH_NONE;
+	this->nodes[node].left = BVH_NONE;
+	this->nodes[node].right = BVH_NONE;
+	this->nodes[node].payload = BVH_NONE;
+	return node;
+}
+
+void bvh_c::free_node(u32 node) {
+	this->nodes[node].height = U32_MAX;
+	this->free_nodes.push_back(node);
+}
+
+u32 bvh_c::insert(const bounds_t& bounds, u32 payload) {
+	u32 leaf = this->allocate_node();
+	this->nodes[leaf].box = aabb_from_bounds(bounds, this->margin);
+	this->nodes[leaf].bounds = bounds;
+	this->nodes[leaf].payload = payload;
+	this->insert_leaf(leaf);
+	this->wide_stale = true;
+	return leaf;
+}
+
+void bvh_c::remove(u32 proxy) {
+	this->remove_leaf(proxy);
+	this->free_node(proxy);
+	this->wide_stale = true;
+}
+
+b8 bvh_c::update(u32 proxy, const bounds_t& bounds) {
+	bvh_node_t& node = this->nodes[proxy];
+	node.bounds = bounds;
+	if (!this->wide_stale) {
+		this->wide_leaves.set(this->wide_slots[proxy], bounds);
+	}
+
+	if (aabb_contains(node.box, aabb_from_bounds(bounds, 0))) {
+		return false;
+	}
+
+	this->remove_leaf(proxy);
+	this->nodes[proxy].box = aabb_from_bounds(bounds, this->margin);
+	this->insert_leaf(proxy);
+	if (!this->wide_stale) {
+		this->wide_refit(this->wide_slots[proxy], this->nodes[proxy].box);
+	}
+	return true;
+}
+
+void bvh_c::clear() {
+	this->nodes.clear();
+	this->free_nodes.clear();
+	this->root = BVH_NONE;
+	this->wide_stale = true;
+}
+
+u32 bvh_c::height() const {
+	return this->root == BVH_NONE ? 0 : this->nodes[this->root].height;
+}
+
+void bvh_c::insert_leaf(u32 leaf) {
+	if (this->root == BVH_NONE) {
+		this->root = leaf;
+		this->nodes[leaf].parent = BVH_NONE;
+		return;
+	}
+
+	/* descend towards the sibling that grows the tree's surface area the least */
+	const aabb_t box = this->nodes[leaf].box;
+	u32 sibling = this->root;
+	while (this->nodes[sibling].left != BVH_NONE) {
+		const bvh_node_t& node = this->nodes[sibling];
+		f64 area = aabb_surface(node.box);
+		f64 combined = aabb_surface(aabb_union(node.box, box));
+
+		/* pairing with this node creates a parent of the combined area, descending pushes the growth onto every ancestor */
+		f64 cost = 2.0 * combined;
+		f64 inheritance = 2.0 * (combined - area);
+
+		f64 child_costs[2];
+		u32 children[2] = { node.left, node.right };
+		for (usize i = 0; i < 2; i++) {
+			const bvh_node_t& child = this->nodes[children[i]];
+			f64 grown = aabb_surface(aabb_union(child.box, box));
+			child_costs[i] = (child.left == BVH_NONE ? grown : grown - aabb_surface(child.box)) + inheritance;
+		}
+
+		if (cost < child_costs[0] && cost < child_costs[1]) {
+			break;
+		}
+
+		sibling = child_costs[0] < child_costs[1] ? children[0] : children[1];
+	}
+
+	u32 old_parent = this->nodes[sibling].parent;
+	u32 parent = this->allocate_node();
+	this->nodes[parent].parent = old_parent;
+	this->nodes[parent].box = aabb_union(box, this->nodes[sibling].box);
+	this->nodes[parent].height = this->nodes[sibling].height + 1;
+	this->nodes[parent].left = sibling;
+	this->nodes[parent].right = leaf;
+	this->nodes[sibling].parent = parent;
+	this->nodes[leaf].parent = parent;
+
+	if (old_parent == BVH_NONE) {
+		this->root = parent;
+	} else if (this->nodes[old_parent].left == sibling) {
+		this->nodes[old_parent].left = parent;
+	} else {
+		this->nodes[old_parent].right = parent;
+	}
+
+	this->refit_ancestors(this->nodes[leaf].parent);
+}
+
+void bvh_c::remove_leaf(u32 leaf) {
+	if (leaf == this->root) {
+		this->root = BVH_NONE;
+		return;
+	}
+
+	u32 parent = this->nodes[leaf].parent;
+	u32 grandparent = this->nodes[parent].parent;
+	u32 sibling = this->nodes[parent].left == leaf ? this->nodes[parent].right : this->nodes[parent].left;
+
+	if (grandparent == BVH_NONE) {
+		this->root = sibling;
+		this->nodes[sibling].parent = BVH_NONE;
+		this->free_node(parent);
+		return;
+	}
+
+	if (this->nodes[grandparent].left == parent) {
+		this->nodes[grandparent].left = sibling;
+	} else {
+		this->nodes[grandparent].right = sibling;
+	}
+
+	this->nodes[sibling].parent = grandparent;
+	this->free_node(parent);
+	this->refit_ancestors(grandparent);
+}
+
+void bvh_c::refit_ancestors(u32 node) {
+	while (node != BVH_NONE) {
+		node = this->balance(node);
+
+		bvh_node_t& current = this->nodes[node];
+		const bvh_node_t& left = this->nodes[current.left];
+		const bvh_node_t& right = this->nodes[current.right];
+		current.height = 1 + std::max(left.height, right.height);
+		current.box = aabb_union(left.box, right.box);
+
+		node = current.parent;
+	}
+}
+
+/* rotates the taller child up when the children's heights differ by more than one, returns the subtree's new root */
+u32 bvh_c::balance(u32 a) {
+	bvh_node_t& node_a = this->nodes[a];
+	if (node_a.left == BVH_NONE || node_a.height < 2) {
+		return a;
+	}
+
+	u32 b = node_a.left;
+	u32 c = node_a.right;
+	bvh_node_t& node_b = this->nodes[b];
+	bvh_node_t& node_c = this->nodes[c];
+	s32 difference = static_cast<s32>(node_c.height) - static_cast<s32>(node_b.height);
+
+	if (difference > 1) {
+		u32 f = node_c.left;
+		u32 g = node_c.right;
+		bvh_node_t& node_f = this->nodes[f];
+		bvh_node_t& node_g = this->nodes[g];
+
+		node_c.left = a;
+		node_c.parent = node_a.parent;
+		node_a.parent = c;
+		if (node_c.parent == BVH_NONE) {
+			this->root = c;
+		} else if (this->nodes[node_c.parent].left == a) {
+			this->nodes[node_c.parent].left = c;
+		} else {
+			this->nodes[node_c.parent].right = c;
+		}
+
+		/* the taller grandchild stays under c, the other moves under a */
+		u32 kept = node_f.height > node_g.height ? f : g;
+		u32 moved = kept == f ? g : f;
+		node_c.right = kept;
+		node_a.right = moved;
+		this->nodes[moved].parent = a;
+		node_a.box = aabb_union(node_b.box, this->nodes[moved].box);
+		node_c.box = aabb_union(node_a.box, this->nodes[kept].box);
+		node_a.height = 1 + std::max(node_b.height, this->nodes[moved].height);
+		node_c.height = 1 + std::max(node_a.height, this->nodes[kept].height);
+		return c;
+	}
+
+	if (difference < -1) {
+		u32 d = node_b.left;
+		u32 e = node_b.right;
+		bvh_node_t& node_d = this->nodes[d];
+		bvh_node_t& node_e = this->nodes[e];
+
+		node_b.left = a;
+		node_b.parent = node_a.parent;
+		node_a.parent = b;
+		if (node_b.parent == BVH_NONE) {
+			this->root = b;
+		} else if (this->nodes[node_b.parent].left == a) {
+			this->nodes[node_b.parent].left = b;
+		} else {
+			this->nodes[node_b.parent].right = b;
+		}
+
+		u32 kept = node_d.height > node_e.height ? d : e;
+		u32 moved = kept == d ? e : d;
+		node_b.right = kept;
+		node_a.left = moved;
+		this->nodes[moved].parent = a;
+		node_a.box = aabb_union(node_c.box, this->nodes[moved].box);
+		node_b.box = aabb_union(node_a.box, this->nodes[kept].box);
+		node_a.height = 1 + std::max(node_c.height, this->nodes[moved].height);
+		node_b.height = 1 + std::max(node_a.height, this->nodes[kept].height);
+		return b;
+	}
+
+	return a;
+}
+
+void bvh_c::flatten() {
+	this->wide_nodes.clear();
+	this->wide_leaves.clear();
+	this->wide_payloads.clear();
+	this->wide_owners.clear();
+	this->wide_slots.resize(this->nodes.size());
+	if (this->root != BVH_NONE) {
+		/* frustum_cull_range reads whole vectors from the last leaves too */
+		this->wide_leaves.reserve(this->nodes.size() / 2 + 1 + BVH_WIDE);
+		this->flatten_node(this->root, BVH_NONE);
+	}
+
+	this->wide_refits = 0;
+	this->wide_stale = false;
+}
+
+/* the leaf keeps its place in the flattened tree and the lanes above it grow until one already holds the box */
+void bvh_c::wide_refit(u32 leaf, const aabb_t& box) {
+	if (++this->wide_refits > this->wide_leaves.count) {
+		this->wide_stale = true;
+		return;
+	}
+
+	for (u32 owner = this->wide_owners[leaf]; owner != BVH_NONE; owner = this->wide_nodes[owner / BVH_WIDE].parent) {
+		bvh_wide_node_t& node = this->wide_nodes[owner / BVH_WIDE];
+		u32 lane = owner % BVH_WIDE;
+		aabb_t lane_box;
+		for (usize c = 0; c < 3; c++) {
+			lane_box.min[c] = node.center[c][lane] - node.extent[c][lane];
+			lane_box.max[c] = node.center[c][lane] + node.extent[c][lane];
+		}
+
+		if (aabb_contains(lane_box, box)) {
+			break;
+		}
+
+		lane_box = aabb_union(lane_box, box);
+		for (usize c = 0; c < 3; c++) {
+			node.center[c][lane] = (lane_box.min[c] + lane_box.max[c]) * 0.5f;
+			node.extent[c][lane] = (lane_box.max[c] - lane_box.min[c]) * 0.5f;
+		}
+	}
+}
+
+/* the node's subtree is opened largest box first until it has BVH_WIDE children or only low ones are left.
+ * the wide node is written before its children, so the root is wide node 0 */
+u32 bvh_c::flatten_node(u32 node, u32 parent) {
+	u32 lanes[BVH_WIDE];
+	u32 used = 1;
+	lanes[0] = node;
+	while (used < BVH_WIDE) {
+		u32 widest = BVH_NONE;
+		f64 widest_surface = -1.0;
+		for (u32 lane = 0; lane < used; lane++) {
+			const bvh_node_t& candidate = this->nodes[lanes[lane]];
+			if (candidate.height <= BVH_WIDE_LEAF_HEIGHT) {
+				continue;
+			}
+
+			f64 surface = aabb_surface(candidate.box);
+			if (surface > widest_surface) {
+				widest = lane;
+				widest_surface = surface;
+			}
+		}
+
+		if (widest == BVH_NONE) {
+			break;
+		}
+
+		const bvh_node_t& opened = this->nodes[lanes[widest]];
+		lanes[used++] = opened.right;
+		lanes[widest] = opened.left;
+	}
+
+	u32 index = static_cast<u32>(this->wide_nodes.size());
+	this->wide_nodes.emplace_back();
+	this->wide_nodes[index].used = used;
+	this->wide_nodes[index].parent = parent;
+	for (u32 lane = 0; lane < used; lane++) {
+		const bvh_node_t& child = this->nodes[lanes[lane]];
+		u32 first = static_cast<u32>(this->wide_payloads.size());
+		u32 wide_child = BVH_NONE;
+		if (child.height > BVH_WIDE_LEAF_HEIGHT) {
+			wide_child = this->flatten_node(lanes[lane], index * BVH_WIDE + lane);
+		} else {
+			/* left before right, the same order a wide child would have laid them out in */
+			this->stack.clear();
+			this->stack.push_back(lanes[lane]);
+			while (!this->stack.empty()) {
+				u32 current = this->stack.back();
+				this->stack.pop_back();
+				const bvh_node_t& leaf = this->nodes[current];
+				if (leaf.left != BVH_NONE) {
+					this->stack.push_back(leaf.right);
+					this->stack.push_back(leaf.left);
+					continue;
+				}
+
+				this->wide_slots[current] = this->wide_leaves.push(leaf.bounds);
+				this->wide_payloads.push_back(leaf.payload);
+				this->wide_owners.push_back(index * BVH_WIDE + lane);
+			}
+		}
+
+		/* the recursion may have moved the wide nodes */
+		bvh_wide_node_t& wide = this->wide_nodes[index];
+		for (usize c = 0; c < 3; c++) {
+			wide.center[c][lane] = (child.box.min[c] + child.box.max[c]) * 0.5f;
+			wide.extent[c][lane] = (child.box.max[c] - child.box.min[c]) * 0.5f;
+		}
+		wide.child[lane] = wide_child;
+		wide.first[lane] = first;
+		wide.count[lane] = static_cast<u32>(this->wide_payloads.size()) - first;
+	}
+
+	return index;
+}
+
+void bvh_c::query_frustum(const frustum_t& frustum, std::vector<u32>& payloads) {
+	if (this->root == BVH_NONE) {
+		return;
+	}
+
+	if (this->wide_stale) {
+		this->flatten();
+	}
+
+	this->stack.clear();
+	this->stack.push_back(0);
+	while (!this->stack.empty()) {
+		const bvh_wide_node_t& node = this->wide_nodes[this->stack.back()];
+		this->stack.pop_back();
+
+		u32 outside_bits;
+		u32 inside_bits;
+		bvh_wide_classify(node, frustum, outside_bits, inside_bits);
+		for (u32 lane = 0; lane < node.used; lane++) {
+			if (outside_bits & (1u << lane)) {
+				continue;
+			}
+
+			const u32* first = this->wide_payloads.data() + node.first[lane];
+			if (inside_bits & (1u << lane)) {
+				payloads.insert(payloads.end(), first, first + node.count[lane]);
+			} else if (node.child[lane] != BVH_NONE) {
+				this->stack.push_back(node.child[lane]);
+			} else {
+				/* the leaves' own bounds decide, written as leaf indices and swapped for their payloads */
+				usize base = payloads.size();
+				payloads.resize(base + node.count[lane]);
+				usize kept = frustum_cull_range(frustum, this->wide_leaves, node.first[lane], node.count[lane], payloads.data() + base);
+				for (usize i = base; i < base + kept; i++) {
+					payloads[i] = this->wide_payloads[payloads[i]];
+				}
+				payloads.resize(base + kept);
+			}
+		}
+	}
+}
+
+void bvh_c::query_sphere(const vec3 center, f32 radius, std::vector<u32>& payloads) const {
+	if (this->root == BVH_NONE) {
+		return;
+	}
+
+	f32 radius_squared = radius * radius;
+	this->stack.clear();
+	this->stack.push_back(this->root);
+	while (!this->stack.empty()) {
+		const bvh_node_t& node = this->nodes[this->stack.back()];
+		this->stack.pop_back();
+
+		if (aabb_distance_squared(node.box, center) > radius_squared) {
+			continue;
+		}
+
+		if (node.left != BVH_NONE) {
+			this->stack.push_back(node.left);
+			this->stack.push_back(node.right);
+			continue;
+		}
+
+		/* both exact volumes have to reach the sphere */
+		vec3 offset;
+		vec3_sub(offset, center, node.bounds.center);
+		f32 reach = radius + node.bounds.radius;
+		if (vec3_mul_inner(offset, offset) <= reach * reach && aabb_distance_squared(aabb_from_bounds(node.bounds, 0), center) <= radius_squared) {
+			payloads.push_back(node.payload);
+		}
+	}
+}
+
+u32 bvh_c::query_ray(const vec3 origin, const vec3 direction, f32 max_distance, f32* distance) const {
+	if (this->root == BVH_NONE) {
+		return BVH_NONE;
+	}
+
+	vec3 inverse_direction;
+	for (usize c = 0; c < 3; c++) {
+		inverse_direction[c] = 1.0f / direction[c];
+	}
+
+	u32 nearest = BVH_NONE;
+	f32 nearest_distance = max_distance;
+	this->stack.clear();
+	this->stack.push_back(this->root);
+	while (!this->stack.empty()) {
+		const bvh_node_t& node = this->nodes[this->stack.back()];
+		this->stack.pop_back();
+
+		f32 enter;
+		if (!aabb_ray(node.box, origin, inverse_direction, nearest_distance, enter)) {
+			continue;
+		}
+
+		if (node.left != BVH_NONE) {
+			this->stack.push_back(node.left);
+			this->stack.push_back(node.right);
+			continue;
+		}
+
+		if (aabb_ray(aabb_from_bounds(node.bounds, 0), origin, inverse_direction, nearest_distance, enter)) {
+			nearest = node.payload;
+			nearest_distance = enter;
+		}
+	}
+
+	if (distance != nullptr && nearest != BVH_NONE) {
+		*distance = nearest_distance;
+	}
+
+	return nearest;
+}
@@ -0,0 +1,98 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include "types.hpp"
+#include "frustum.hpp"
+#include <vector>
+
+#define BVH_NONE U32_MAX
+/* world units leaf boxes are grown by, so small movements don't touch the tree */
+#define BVH_MARGIN_DEFAULT 0.1f
+/* children per node of the flattened tree frustum queries walk */
+#define BVH_WIDE 8
+/* subtrees this high or lower, at most 8 leaves, are one child whose leaves are tested in a single frustum_cull_range */
+#define BVH_WIDE_LEAF_HEIGHT 3
+
+struct aabb_t {
+	vec3 min;
+	vec3 max;
+};
+
+struct bvh_node_t {
+	/* leaves hold their box grown by the margin, internal nodes the union of their children */
+	aabb_t box;
+	/* exact bounds, leaves only */
+	bounds_t bounds;
+	u32 parent;
+	u32 left;
+	u32 right;
+	/* 0 for leaves */
+	u32 height;
+	u32 payload;
+};
+
+/* a node of the flattened tree, its children's boxes are lanes so one node is tested against a plane at once */
+struct bvh_wide_node_t {
+	alignas(32) f32 center[3][BVH_WIDE];
+	alignas(32) f32 extent[3][BVH_WIDE];
+	/* wide node of every child, BVH_NONE for children whose leaves are tested directly */
+	u32 child[BVH_WIDE];
+	/* every child's leaves are one range of the flattened leaves */
+	u32 first[BVH_WIDE];
+	u32 count[BVH_WIDE];
+	u32 used;
+	/* the lane holding this node as wide node * BVH_WIDE + lane, BVH_NONE for the root */
+	u32 parent;
+};
+
+/* dynamic aabb tree, leaves are placed by surface area cost on insert and the tree is kept balanced by rotations.
+ * leaves are identified by the proxy insert() returns, queries report their payloads */
+struct bvh_c {
+	std::vector<bvh_node_t> nodes;
+	std::vector<u32> free_nodes;
+	u32 root;
+	f32 margin;
+
+	bvh_c(f32 margin = BVH_MARGIN_DEFAULT);
+
+	u32 insert(const bounds_t& bounds, u32 payload);
+	void remove(u32 proxy);
+	/* the leaf is only moved in the tree when the bounds leave its grown box, returns whether it was */
+	b8 update(u32 proxy, const bounds_t& bounds);
+	void clear();
+
+	/* rebuilds the flattened tree, query_frustum does when leaves were inserted or removed since the last one.
+	 * leaves moving out of their grown box only grow the flattened boxes above them until as many have moved as there are leaves */
+	void flatten();
+	/* walks the flattened tree, subtrees entirely inside the frustum are taken as one range without testing their leaves.
+	 * reports the same payloads as frustum_cull over the leaves' exact bounds */
+	void query_frustum(const frustum_t& frustum, std::vector<u32>& payloads);
+	void query_sphere(const vec3 center, f32 radius, std::vector<u32>& payloads) const;
+	/* payload of the nearest leaf whose exact box the ray enters within max_distance, BVH_NONE when none */
+	u32 query_ray(const vec3 origin, const vec3 direction, f32 max_distance, f32* distance) const;
+
+	u32 height() const;
+
+private:
+	mutable std::vector<u32> stack;
+	/* depth first, the leaves' exact bounds and payloads in the same order */
+	std::vector<bvh_wide_node_t> wide_nodes;
+	bounds_store_c wide_leaves;
+	std::vector<u32> wide_payloads;
+	/* flattened leaf of every tree node, and the lane holding every flattened leaf */
+	std::vector<u32> wide_slots;
+	std::vector<u32> wide_owners;
+	usize wide_refits;
+	b8 wide_stale;
+
+	u32 allocate_node();
+	void free_node(u32 node);
+	void insert_leaf(u32 leaf);
+	void remove_leaf(u32 leaf);
+	void refit_ancestors(u32 node);
+	u32 balance(u32 node);
+	u32 flatten_node(u32 node, u32 parent);
+	void wide_refit(u32 leaf, const aabb_t& box);
+};
+
+#endif
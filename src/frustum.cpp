@@ -0,0 +1,235 @@
+#include "frustum.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#define BOUNDS_STORE_ALIGNMENT 32
+#define BOUNDS_STORE_LANES 8
+#define BOUNDS_STORE_COMPONENTS 7
+
+void frustum_from_matrix(frustum_t& frustum, const mat4x4 vp) {
+	/* gribb-hartmann, every clip plane is the w row plus or minus the x, y or z row */
+	for (usize i = 0; i < 3; i++) {
+		for (usize c = 0; c < 4; c++) {
+			frustum.planes[i * 2][c] = vp[c][3] + vp[c][i];
+			frustum.planes[i * 2 + 1][c] = vp[c][3] - vp[c][i];
+		}
+	}
+
+	for (usize i = 0; i < 6; i++) {
+		f32 length = std::sqrt(frustum.planes[i][0] * frustum.planes[i][0] + frustum.planes[i][1] * frustum.planes[i][1] + frustum.planes[i][2] * frustum.planes[i][2]);
+		if (length > 0) {
+			for (usize c = 0; c < 4; c++) {
+				frustum.planes[i][c] /= length;
+			}
+		}
+	}
+}
+
+bounds_t bounds_unbounded() {
+	return {
+		.center = { 0, 0, 0 },
+		.extent = { BOUNDS_UNBOUNDED, BOUNDS_UNBOUNDED, BOUNDS_UNBOUNDED },
+		.radius = BOUNDS_UNBOUNDED,
+	};
+}
+
+bounds_t bounds_from_positions(const void* vertex_data, usize stride, usize count) {
+	if (vertex_data == nullptr || count == 0 || stride < sizeof(vec3)) {
+		return bounds_unbounded();
+	}
+
+	const u8* bytes = reinterpret_cast<const u8*>(vertex_data);
+	vec3 min = { F32_MAX, F32_MAX, F32_MAX };
+	vec3 max = { -F32_MAX, -F32_MAX, -F32_MAX };
+	for (usize i = 0; i < count; i++) {
+		vec3 position;
+		std::memcpy(position, bytes + i * stride, sizeof(vec3));
+		for (usize c = 0; c < 3; c++) {
+			min[c] = std::min(min[c], position[c]);
+			max[c] = std::max(max[c], position[c]);
+		}
+	}
+
+	bounds_t bounds = {};
+	for (usize c = 0; c < 3; c++) {
+		bounds.center[c] = (min[c] + max[c]) * 0.5f;
+		bounds.extent[c] = (max[c] - min[c]) * 0.5f;
+	}
+
+	/* tighter than the half diagonal whenever the vertices do not reach the box corners */
+	f32 radius_squared = 0;
+	for (usize i = 0; i < count; i++) {
+		vec3 position;
+		std::memcpy(position, bytes + i * stride, sizeof(vec3));
+		vec3 offset;
+		vec3_sub(offset, position, bounds.center);
+		radius_squared = std::max(radius_squared, vec3_mul_inner(offset, offset));
+	}
+
+	bounds.radius = std::sqrt(radius_squared);
+	return bounds;
+}
+
+bounds_t bounds_transform(const bounds_t& bounds, const f32 model[16]) {
+	if (bounds.radius >= BOUNDS_UNBOUNDED) {
+		return bounds;
+	}
+
+	bounds_t result = {};
+	f32 scale_squared = 0;
+	for (usize r = 0; r < 3; r++) {
+		result.center[r] = model[12 + r];
+		result.extent[r] = 0;
+		for (usize c = 0; c < 3; c++) {
+			result.center[r] += model[c * 4 + r] * bounds.center[c];
+			result.extent[r] += std::fabs(model[c * 4 + r]) * bounds.extent[c];
+		}
+
+		const f32* column = model + r * 4;
+		scale_squared = std::max(scale_squared, column[0] * column[0] + column[1] * column[1] + column[2] * column[2]);
+	}
+
+	result.radius = bounds.radius * std::sqrt(scale_squared);
+	return result;
+}
+
+bounds_store_c::bounds_store_c() {
+	this->count = 0;
+	this->capacity = 0;
+	this->block = nullptr;
+	this->radius = nullptr;
+	for (usize i = 0; i < 3; i++) {
+		this->center[i] = nullptr;
+		this->extent[i] = nullptr;
+	}
+}
+
+bounds_store_c::~bounds_store_c() {
+	if (this->block != nullptr) {
+		::operator delete[](this->block, std::align_val_t(BOUNDS_STORE_ALIGNMENT));
+	}
+}
+
+void bounds_store_c::reserve(usize capacity) {
+	if (capacity <= this->capacity) {
+		return;
+	}
+
+	capacity = std::max(capacity, this->capacity * 2);
+	capacity = (capacity + BOUNDS_STORE_LANES - 1) / BOUNDS_STORE_LANES * BOUNDS_STORE_LANES;
+
+	f32* block = static_cast<f32*>(::operator new[](capacity * BOUNDS_STORE_COMPONENTS * sizeof(f32), std::align_val_t(BOUNDS_STORE_ALIGNMENT)));
+	std::memset(block, 0, capacity * BOUNDS_STORE_COMPONENTS * sizeof(f32));
+
+	f32** components[BOUNDS_STORE_COMPONENTS] = {
+		&this->center[0], &this->center[1], &this->center[2],
+		&this->extent[0], &this->extent[1], &this->extent[2],
+		&this->radius,
+	};
+
+	for (usize i = 0; i < BOUNDS_STORE_COMPONENTS; i++) {
+		f32* array = block + i * capacity;
+		if (this->count > 0) {
+			std::memcpy(array, *components[i], this->count * sizeof(f32));
+		}
+		*components[i] = array;
+	}
+
+	if (this->block != nullptr) {
+		::operator delete[](this->block, std::align_val_t(BOUNDS_STORE_ALIGNMENT));
+	}
+
+	this->block = block;
+	this->capacity = capacity;
+}
+
+void bounds_store_c::clear() {
+	this->count = 0;
+}
+
+u32 bounds_store_c::push(const bounds_t& bounds) {
+	this->reserve(this->count + 1);
+	u32 index = static_cast<u32>(this->count++);
+	this->set(index, bounds);
+	return index;
+}
+
+void bounds_store_c::set(u32 index, const bounds_t& bounds) {
+	for (usize i = 0; i < 3; i++) {
+		this->center[i][index] = bounds.center[i];
+		this->extent[i][index] = bounds.extent[i];
+	}
+	this->radius[index] = bounds.radius;
+}
+
+b8 frustum_contains(const frustum_t& frustum, const bounds_t& bounds) {
+	for (usize i = 0; i < 6; i++) {
+		const vec4& plane = frustum.planes[i];
+		f32 distance = vec3_mul_inner(plane, bounds.center) + plane[3];
+		f32 projected = std::fabs(plane[0]) * bounds.extent[0] + std::fabs(plane[1]) * bounds.extent[1] + std::fabs(plane[2]) * bounds.extent[2];
+		if (distance + std::min(bounds.radius, projected) < 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* a bounds is outside when its center is further behind any plane than the smaller of the sphere radius
+ * and the box's extent projected onto the plane normal, so each test only ever tightens the other */
+usize frustum_cull(const frustum_t& frustum, const bounds_store_c& bounds, u32* visible) {
+	return frustum_cull_range(frustum, bounds, 0, bounds.count, visible);
+}
+
+usize frustum_cull_range(const frustum_t& frustum, const bounds_store_c& bounds, usize begin, usize count, u32* visible) {
+	usize written = 0;
+	usize end = begin + count;
+
+#ifdef VF_LANES
+	for (usize first = begin; first < end; first += VF_LANES) {
+		vf cx = vf_loadu(bounds.center[0] + first);
+		vf cy = vf_loadu(bounds.center[1] + first);
+		vf cz = vf_loadu(bounds.center[2] + first);
+		vf ex = vf_loadu(bounds.extent[0] + first);
+		vf ey = vf_loadu(bounds.extent[1] + first);
+		vf ez = vf_loadu(bounds.extent[2] + first);
+		vf radius = vf_loadu(bounds.radius + first);
+
+		vf outside = vf_set(0.0f);
+		for (usize i = 0; i < 6; i++) {
+			const vec4& plane = frustum.planes[i];
+			vf distance = vf_add(vf_add(vf_mul(vf_set(plane[0]), cx), vf_mul(vf_set(plane[1]), cy)), vf_add(vf_mul(vf_set(plane[2]), cz), vf_set(plane[3])));
+			vf projected = vf_add(vf_add(vf_mul(vf_set(std::fabs(plane[0])), ex), vf_mul(vf_set(std::fabs(plane[1])), ey)), vf_mul(vf_set(std::fabs(plane[2])), ez));
+			vf reach = vf_min(radius, projected);
+			outside = vf_or(outside, vf_less(vf_add(distance, reach), vf_set(0.0f)));
+		}
+
+		usize lanes = std::min<usize>(VF_LANES, end - first);
+		u32 outside_bits = vf_mask_bits(outside);
+		for (usize lane = 0; lane < lanes; lane++) {
+			if ((outside_bits & (1u << lane)) == 0) {
+				visible[written++] = static_cast<u32>(first + lane);
+			}
+		}
+	}
+#else
+	for (usize i = begin; i < end; i++) {
+		b8 outside = false;
+		for (usize p = 0; p < 6 && !outside; p++) {
+			const vec4& plane = frustum.planes[p];
+			f32 distance = plane[0] * bounds.center[0][i] + plane[1] * bounds.center[1][i] + plane[2] * bounds.center[2][i] + plane[3];
+			f32 projected = std::fabs(plane[0]) * bounds.extent[0][i] + std::fabs(plane[1]) * bounds.extent[1][i] + std::fabs(plane[2]) * bounds.extent[2][i];
+			outside = distance + std::min(bounds.radius[i], projected) < 0;
+		}
+
+		if (!outside) {
+			visible[written++] = static_cast<u32>(i);
+		}
+	}
+#endif
+
+	return written;
+}
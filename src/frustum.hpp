@@ -0,0 +1,60 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include "types.hpp"
+#include <linmath.h>
+
+/* extent and radius of bounds that no frustum rejects, finite so the plane math never produces nan */
+#define BOUNDS_UNBOUNDED 1e30f
+
+/* axis aligned box as center and half extents, the bounding sphere shares its center */
+struct bounds_t {
+	vec3 center;
+	vec3 extent;
+	f32 radius;
+};
+
+/* normalized planes facing inwards, p is inside a plane when dot(plane.xyz, p) + plane.w >= 0 */
+struct frustum_t {
+	vec4 planes[6];
+};
+
+void frustum_from_matrix(frustum_t& frustum, const mat4x4 vp);
+
+/* positions are the first three floats of every vertex */
+bounds_t bounds_from_positions(const void* vertex_data, usize stride, usize count);
+bounds_t bounds_unbounded();
+/* the box is re-fitted around the transformed box, the radius grows with the largest axis scale */
+bounds_t bounds_transform(const bounds_t& bounds, const f32 model[16]);
+
+/* structure-of-arrays bounds for frustum_cull, padded like transform_store_c */
+struct bounds_store_c {
+	usize count;
+	usize capacity;
+	f32* center[3];
+	f32* extent[3];
+	f32* radius;
+
+	bounds_store_c();
+	~bounds_store_c();
+	bounds_store_c(const bounds_store_c&) = delete;
+	bounds_store_c& operator=(const bounds_store_c&) = delete;
+
+	void reserve(usize capacity);
+	void clear();
+	u32 push(const bounds_t& bounds);
+	void set(u32 index, const bounds_t& bounds);
+
+private:
+	f32* block;
+};
+
+/* single bounds version of frustum_cull */
+b8 frustum_contains(const frustum_t& frustum, const bounds_t& bounds);
+
+/* writes the index of every bounds whose sphere and box both touch the frustum, returns how many were written */
+usize frustum_cull(const frustum_t& frustum, const bounds_store_c& bounds, u32* visible);
+/* frustum_cull over the count bounds from begin, reads up to 7 bounds past them so the store needs the capacity */
+usize frustum_cull_range(const frustum_t& frustum, const bounds_store_c& bounds, usize begin, usize count, u32* visible);
+
+#endif
@@ -0,0 +1,275 @@
+#include "gl_state.hpp"
+#include <glad/glad.h>
+
+static u32 buffer_target_slot(u32 target) {
+	switch (target) {
+	case GL_ARRAY_BUFFER:
+		return 0;
+	case GL_ELEMENT_ARRAY_BUFFER:
+		return 1;
+	case GL_COPY_READ_BUFFER:
+		return 2;
+	case GL_COPY_WRITE_BUFFER:
+		return 3;
+	case GL_UNIFORM_BUFFER:
+		return 4;
+	case GL_TEXTURE_BUFFER:
+		return 5;
+	case GL_DRAW_INDIRECT_BUFFER:
+		return 6;
+	case GL_PIXEL_UNPACK_BUFFER:
+		return 7;
+	default:
+		return GL_STATE_UNKNOWN;
+	}
+}
+
+static u32 texture_target_slot(u32 target) {
+	switch (target) {
+	case GL_TEXTURE_2D:
+		return 0;
+	case GL_TEXTURE_2D_ARRAY:
+		return 1;
+	case GL_TEXTURE_CUBE_MAP:
+		return 2;
+	case GL_TEXTURE_BUFFER:
+		return 3;
+	default:
+		return GL_STATE_UNKNOWN;
+	}
+}
+
+static u32 capability_slot(u32 capability) {
+	switch (capability) {
+	case GL_DEPTH_TEST:
+		return 0;
+	case GL_CULL_FACE:
+		return 1;
+	case GL_BLEND:
+		return 2;
+	case GL_SCISSOR_TEST:
+		return 3;
+	default:
+		return GL_STATE_UNKNOWN;
+	}
+}
+
+/* counts the call and says whether it has to be issued */
+static b8 gl_state_changes(u32& current, u32 value, gl_state_call_stats_t& stats) {
+	if (current == value) {
+		++stats.redundant;
+		return false;
+	}
+
+	current = value;
+	++stats.issued;
+	return true;
+}
+
+gl_state_c::gl_state_c() {
+	this->invalidate();
+	this->reset_stats();
+}
+
+void gl_state_c::invalidate() {
+	this->program = GL_STATE_UNKNOWN;
+	this->vertex_array = GL_STATE_UNKNOWN;
+	for (u32 i = 0; i < buffer_targets; i++) {
+		this->buffers[i] = GL_STATE_UNKNOWN;
+	}
+
+	this->active_texture = GL_STATE_UNKNOWN;
+	for (u32 unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+		for (u32 i = 0; i < texture_targets; i++) {
+			this->textures[unit][i] = GL_STATE_UNKNOWN;
+		}
+	}
+
+	this->read_framebuffer = GL_STATE_UNKNOWN;
+	this->draw_framebuffer = GL_STATE_UNKNOWN;
+	for (u32 i = 0; i < capabilities; i++) {
+		this->enabled[i] = GL_STATE_UNKNOWN;
+	}
+
+	this->depth_write = GL_STATE_UNKNOWN;
+	this->depth_compare = GL_STATE_UNKNOWN;
+	this->viewport_known = false;
+}
+
+void gl_state_c::reset_stats() {
+	this->stats = {};
+}
+
+u32 gl_state_c::redundant() const {
+	return this->stats.programs.redundant + this->stats.vertex_arrays.redundant + this->stats.buffers.redundant + this->stats.textures.redundant + this->stats.framebuffers.redundant + this->stats.fixed_function.redundant;
+}
+
+void gl_state_c::use_program(u32 program) {
+	if (gl_state_changes(this->program, program, this->stats.programs)) {
+		glUseProgram(program);
+	}
+}
+
+void gl_state_c::bind_vertex_array(u32 vertex_array) {
+	if (gl_state_changes(this->vertex_array, vertex_array, this->stats.vertex_arrays)) {
+		glBindVertexArray(vertex_array);
+		this->buffers[buffer_target_slot(GL_ELEMENT_ARRAY_BUFFER)] = GL_STATE_UNKNOWN;
+	}
+}
+
+void gl_state_c::bind_buffer(u32 target, u32 buffer) {
+	u32 slot = buffer_target_slot(target);
+	if (slot == GL_STATE_UNKNOWN) {
+		++this->stats.buffers.issued;
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (gl_state_changes(this->buffers[slot], buffer, this->stats.buffers)) {
+		glBindBuffer(target, buffer);
+	}
+}
+
+void gl_state_c::bind_buffer_base(u32 target, u32 index, u32 buffer) {
+	/* the indexed binding itself isn't tracked */
+	++this->stats.buffers.issued;
+	glBindBufferBase(target, index, buffer);
+
+	u32 slot = buffer_target_slot(target);
+	if (slot != GL_STATE_UNKNOWN) {
+		this->buffers[slot] = buffer;
+	}
+}
+
+void gl_state_c::activate_texture(u32 unit) {
+	if (gl_state_changes(this->active_texture, unit, this->stats.textures)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+}
+
+void gl_state_c::bind_texture(u32 unit, u32 target, u32 texture) {
+	u32 slot = texture_target_slot(target);
+	if (unit >= GL_STATE_TEXTURE_UNITS || slot == GL_STATE_UNKNOWN) {
+		this->activate_texture(unit);
+		++this->stats.textures.issued;
+		glBindTexture(target, texture);
+		return;
+	}
+
+	if (this->textures[unit][slot] == texture) {
+		++this->stats.textures.redundant;
+		return;
+	}
+
+	this->activate_texture(unit);
+	this->textures[unit][slot] = texture;
+	++this->stats.textures.issued;
+	glBindTexture(target, texture);
+}
+
+void gl_state_c::bind_framebuffer(u32 target, u32 framebuffer) {
+	b8 read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	b8 draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	if ((!read || this->read_framebuffer == framebuffer) && (!draw || this->draw_framebuffer == framebuffer)) {
+		++this->stats.framebuffers.redundant;
+		return;
+	}
+
+	glBindFramebuffer(target, framebuffer);
+	++this->stats.framebuffers.issued;
+	if (read) {
+		this->read_framebuffer = framebuffer;
+	}
+
+	if (draw) {
+		this->draw_framebuffer = framebuffer;
+	}
+}
+
+void gl_state_c::set_capability(u32 capability, b8 enabled) {
+	u32 slot = capability_slot(capability);
+	if (slot != GL_STATE_UNKNOWN && !gl_state_changes(this->enabled[slot], enabled ? 1 : 0, this->stats.fixed_function)) {
+		return;
+	}
+
+	if (slot == GL_STATE_UNKNOWN) {
+		++this->stats.fixed_function.issued;
+	}
+
+	if (enabled) {
+		glEnable(capability);
+	} else {
+		glDisable(capability);
+	}
+}
+
+void gl_state_c::depth_mask(b8 enabled) {
+	if (gl_state_changes(this->depth_write, enabled ? 1 : 0, this->stats.fixed_function)) {
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+	}
+}
+
+void gl_state_c::depth_func(u32 func) {
+	if (gl_state_changes(this->depth_compare, func, this->stats.fixed_function)) {
+		glDepthFunc(func);
+	}
+}
+
+void gl_state_c::viewport(s32 x, s32 y, s32 width, s32 height) {
+	if (this->viewport_known && this->viewport_rect[0] == x && this->viewport_rect[1] == y && this->viewport_rect[2] == width && this->viewport_rect[3] == height) {
+		++this->stats.fixed_function.redundant;
+		return;
+	}
+
+	glViewport(x, y, width, height);
+	++this->stats.fixed_function.issued;
+	this->viewport_rect[0] = x;
+	this->viewport_rect[1] = y;
+	this->viewport_rect[2] = width;
+	this->viewport_rect[3] = height;
+	this->viewport_known = true;
+}
+
+/* a program in use stays alive until another one replaces it, so the binding stays valid */
+void gl_state_c::delete_program(u32 program) {
+	glDeleteProgram(program);
+}
+
+void gl_state_c::delete_vertex_array(u32 vertex_array) {
+	glDeleteVertexArrays(1, &vertex_array);
+	if (this->vertex_array == vertex_array) {
+		this->vertex_array = 0;
+		this->buffers[buffer_target_slot(GL_ELEMENT_ARRAY_BUFFER)] = GL_STATE_UNKNOWN;
+	}
+}
+
+void gl_state_c::delete_buffer(u32 buffer) {
+	glDeleteBuffers(1, &buffer);
+	for (u32 i = 0; i < buffer_targets; i++) {
+		if (this->buffers[i] == buffer) {
+			this->buffers[i] = 0;
+		}
+	}
+}
+
+void gl_state_c::delete_texture(u32 texture) {
+	glDeleteTextures(1, &texture);
+	for (u32 unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+		for (u32 i = 0; i < texture_targets; i++) {
+			if (this->textures[unit][i] == texture) {
+				this->textures[unit][i] = 0;
+			}
+		}
+	}
+}
+
+void gl_state_c::delete_framebuffer(u32 framebuffer) {
+	glDeleteFramebuffers(1, &framebuffer);
+	if (this->read_framebuffer == framebuffer) {
+		this->read_framebuffer = 0;
+	}
+
+	if (this->draw_framebuffer == framebuffer) {
+		this->draw_framebuffer = 0;
+	}
+}
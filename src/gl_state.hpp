@@ -0,0 +1,85 @@
+#ifndef GL_STATE_HPP
+#define GL_STATE_HPP
+
+#include "types.hpp"
+
+/* texture units with a shadow copy, binds on higher units are always issued */
+#define GL_STATE_TEXTURE_UNITS 16
+#define GL_STATE_UNKNOWN U32_MAX
+
+/* calls issued to gl and calls dropped because the state already held the value */
+struct gl_state_call_stats_t {
+	u32 issued;
+	u32 redundant;
+};
+
+struct gl_state_stats_t {
+	gl_state_call_stats_t programs;
+	gl_state_call_stats_t vertex_arrays;
+	gl_state_call_stats_t buffers;
+	/* active texture unit switches count as texture calls */
+	gl_state_call_stats_t textures;
+	gl_state_call_stats_t framebuffers;
+	/* capabilities, depth mask and func, viewport */
+	gl_state_call_stats_t fixed_function;
+};
+
+/* shadow copy of the gl state the renderer changes, every change goes through it so setting a value that is already
+ * in place costs no driver call. deleting a bound object unbinds it, so deletes go through it too.
+ * gl enums and names are plain u32 here so the header needs no loader, untracked targets pass straight through.
+ * anything that changes gl state behind its back has to invalidate() it */
+struct gl_state_c {
+	gl_state_stats_t stats;
+
+	gl_state_c();
+
+	/* forgets every value, the next call of each kind is issued */
+	void invalidate();
+	void reset_stats();
+	/* redundant calls of every kind */
+	u32 redundant() const;
+
+	void use_program(u32 program);
+	/* the element array buffer is vertex array state, so it is unknown after the vertex array changes */
+	void bind_vertex_array(u32 vertex_array);
+	void bind_buffer(u32 target, u32 buffer);
+	/* also sets the target's generic binding, like gl does */
+	void bind_buffer_base(u32 target, u32 index, u32 buffer);
+	void bind_texture(u32 unit, u32 target, u32 texture);
+	/* bind_texture skips the unit switch when the texture is already bound, calls acting on the active unit's binding
+	 * (glTexBuffer, glTexImage2D) select it with this */
+	void activate_texture(u32 unit);
+	/* GL_FRAMEBUFFER sets the read and draw bindings */
+	void bind_framebuffer(u32 target, u32 framebuffer);
+	void set_capability(u32 capability, b8 enabled);
+	void depth_mask(b8 enabled);
+	void depth_func(u32 func);
+	void viewport(s32 x, s32 y, s32 width, s32 height);
+
+	void delete_program(u32 program);
+	void delete_vertex_array(u32 vertex_array);
+	void delete_buffer(u32 buffer);
+	void delete_texture(u32 texture);
+	void delete_framebuffer(u32 framebuffer);
+
+private:
+	static const u32 buffer_targets = 8;
+	static const u32 texture_targets = 4;
+	static const u32 capabilities = 4;
+
+	u32 program;
+	u32 vertex_array;
+	u32 buffers[buffer_targets];
+	u32 active_texture;
+	u32 textures[GL_STATE_TEXTURE_UNITS][texture_targets];
+	u32 read_framebuffer;
+	u32 draw_framebuffer;
+	/* 0, 1 or GL_STATE_UNKNOWN */
+	u32 enabled[capabilities];
+	u32 depth_write;
+	u32 depth_compare;
+	s32 viewport_rect[4];
+	b8 viewport_known;
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "gpu_timer.hpp"
+#include <glad/glad.h>
+#include <algorithm>
+#include <stdexcept>
+
+const char* gpu_pass_name(gpu_pass pass) {
+	switch (pass) {
+	case gpu_pass::GEOMETRY:
+		return "geometry";
+	case gpu_pass::SHADOW_DEPTH:
+		return "shadow depth";
+	case gpu_pass::LIGHT:
+		return "light";
+	case gpu_pass::UPSCALE:
+		return "upscale";
+	default:
+		return "unknown";
+	}
+}
+
+static void history_record(gpu_timer_history_t& history, gpu_pass_stats_t& stats, f32 ms) {
+	history.samples[history.head] = ms;
+	history.head = (history.head + 1) % GPU_TIMER_HISTORY;
+	history.count = std::min<u32>(history.count + 1, GPU_TIMER_HISTORY);
+
+	/* the window is small enough to rescan, which keeps min and max exact as old samples fall out */
+	f32 min = ms;
+	f32 max = ms;
+	f32 sum = 0;
+	for (u32 i = 0; i < history.count; i++) {
+		min = std::min(min, history.samples[i]);
+		max = std::max(max, history.samples[i]);
+		sum += history.samples[i];
+	}
+
+	stats = {
+		.last_ms = ms,
+		.min_ms = min,
+		.avg_ms = sum / history.count,
+		.max_ms = max,
+		.samples = history.count,
+	};
+}
+
+gpu_timer_c::gpu_timer_c() {
+	for (frame_t& frame : this->frames) {
+		frame = {};
+	}
+
+	this->next = 0;
+	this->pending = 0;
+	this->recording = false;
+	this->running = gpu_pass::COUNT;
+	for (gpu_timer_history_t& history : this->histories) {
+		history = {};
+	}
+
+	this->result = {};
+}
+
+void gpu_timer_c::create() {
+	for (frame_t& frame : this->frames) {
+		glGenQueries(GPU_PASS_COUNT, frame.queries);
+	}
+}
+
+void gpu_timer_c::destroy() {
+	for (frame_t& frame : this->frames) {
+		glDeleteQueries(GPU_PASS_COUNT, frame.queries);
+		frame = {};
+	}
+
+	this->pending = 0;
+	this->recording = false;
+	this->running = gpu_pass::COUNT;
+}
+
+b8 gpu_timer_c::collect(f32& frame_ms) {
+	if (this->pending == 0) {
+		return false;
+	}
+
+	frame_t& frame = this->frames[(this->next + GPU_TIMER_FRAMES - this->pending) % GPU_TIMER_FRAMES];
+
+	/* results arrive in submission order, but checking each keeps this independent of the driver */
+	for (usize i = 0; i < GPU_PASS_COUNT; i++) {
+		if (!frame.used[i]) {
+			continue;
+		}
+
+		GLint available = 0;
+		glGetQueryObjectiv(frame.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			return false;
+		}
+	}
+
+	frame_ms = 0;
+	for (usize i = 0; i < GPU_PASS_COUNT; i++) {
+		if (!frame.used[i]) {
+			continue;
+		}
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &nanoseconds);
+		f32 ms = static_cast<f32>(nanoseconds / 1e6);
+		history_record(this->histories[i], this->result.passes[i], ms);
+		frame_ms += ms;
+	}
+
+	history_record(this->histories[GPU_PASS_COUNT], this->result.frame, frame_ms);
+	++this->result.frames;
+	--this->pending;
+	return true;
+}
+
+void gpu_timer_c::begin_frame() {
+	if (this->recording) {
+		throw std::runtime_error("GPU timer frame began twice");
+	}
+
+	this->recording = this->pending < GPU_TIMER_FRAMES;
+	if (this->recording) {
+		std::fill(std::begin(this->frames[this->next].used), std::end(this->frames[this->next].used), false);
+	}
+}
+
+void gpu_timer_c::end_frame() {
+	if (this->running != gpu_pass::COUNT) {
+		throw std::runtime_error("GPU timer frame ended inside a pass");
+	}
+
+	if (!this->recording) {
+		return;
+	}
+
+	this->recording = false;
+	const frame_t& frame = this->frames[this->next];
+	if (std::none_of(std::begin(frame.used), std::end(frame.used), [](b8 used) { return used; })) {
+		return;
+	}
+
+	this->next = (this->next + 1) % GPU_TIMER_FRAMES;
+	++this->pending;
+}
+
+void gpu_timer_c::begin(gpu_pass pass) {
+	if (this->running != gpu_pass::COUNT || pass == gpu_pass::COUNT) {
+		throw std::runtime_error("GPU timer passes can't nest");
+	}
+
+	this->running = pass;
+	if (!this->recording) {
+		return;
+	}
+
+	frame_t& frame = this->frames[this->next];
+	usize index = static_cast<usize>(pass);
+	if (frame.used[index]) {
+		throw std::runtime_error("GPU timer pass ran twice in one frame");
+	}
+
+	frame.used[index] = true;
+	glBeginQuery(GL_TIME_ELAPSED, frame.queries[index]);
+}
+
+void gpu_timer_c::end() {
+	if (this->running == gpu_pass::COUNT) {
+		throw std::runtime_error("GPU timer pass ended without beginning");
+	}
+
+	this->running = gpu_pass::COUNT;
+	if (this->recording) {
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+}
+
+const gpu_timing_t& gpu_timer_c::timing() const {
+	return this->result;
+}
@@ -0,0 +1,89 @@
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+#include "types.hpp"
+
+/* frames of queries in flight, results are read this many frames late at the latest */
+#define GPU_TIMER_FRAMES 4
+/* timings the rolling statistics cover */
+#define GPU_TIMER_HISTORY 64
+
+/* passes of renderer_c::draw() in the order it runs them */
+enum class gpu_pass {
+	GEOMETRY = 0,
+	SHADOW_DEPTH,
+	LIGHT,
+	/* only runs when rendering below the framebuffer's resolution */
+	UPSCALE,
+	COUNT,
+};
+
+#define GPU_PASS_COUNT static_cast<usize>(gpu_pass::COUNT)
+
+/* milliseconds over the last GPU_TIMER_HISTORY frames the pass ran in, all 0 before its first result */
+struct gpu_pass_stats_t {
+	f32 last_ms;
+	f32 min_ms;
+	f32 avg_ms;
+	f32 max_ms;
+	u32 samples;
+};
+
+struct gpu_timing_t {
+	gpu_pass_stats_t passes[GPU_PASS_COUNT];
+	/* sum of the passes a frame ran */
+	gpu_pass_stats_t frame;
+	/* frames whose results came back */
+	u64 frames;
+};
+
+const char* gpu_pass_name(gpu_pass pass);
+
+/* ring of the latest timings one gpu_pass_stats_t is computed from */
+struct gpu_timer_history_t {
+	f32 samples[GPU_TIMER_HISTORY];
+	u32 count;
+	u32 head;
+};
+
+/* gpu time of each pass from GL_TIME_ELAPSED queries. every frame gets its own set of queries from a ring and a set is
+ * only read once all of its results are available, so reading never waits on the gpu. when the whole ring is still in
+ * flight the frame goes untimed. elapsed time queries can't nest, so passes can't either and the frame's time is the
+ * sum of its passes */
+struct gpu_timer_c {
+	gpu_timer_c();
+
+	/* needs a current context */
+	void create();
+	void destroy();
+
+	/* reads the oldest frame if all of its results are in, frame_ms is its summed time. call until it returns false
+	 * to drain every finished frame */
+	b8 collect(f32& frame_ms);
+	void begin_frame();
+	void end_frame();
+	/* one pass at a time, each at most once per frame */
+	void begin(gpu_pass pass);
+	void end();
+
+	const gpu_timing_t& timing() const;
+
+private:
+	struct frame_t {
+		u32 queries[GPU_PASS_COUNT];
+		b8 used[GPU_PASS_COUNT];
+	};
+
+	frame_t frames[GPU_TIMER_FRAMES];
+	/* the frame recorded next, frames in flight sit right before it */
+	u32 next;
+	u32 pending;
+	b8 recording;
+	/* the pass between begin() and end(), COUNT when none */
+	gpu_pass running;
+	/* one per pass and the frame last */
+	gpu_timer_history_t histories[GPU_PASS_COUNT + 1];
+	gpu_timing_t result;
+};
+
+#endif
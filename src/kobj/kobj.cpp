@@ -1,8 +1,10 @@
 #include "kobj.hpp"
+#include "../profiler.hpp"
 #include <stdlib.h>
 #include <string.h>
 
 int kobj_load(kobj_t * out_obj, void * buffer, unsigned long long int length) {
+	PROFILE_ZONE("kobj_load");
 	if (out_obj == NULL || buffer == NULL || length == 0) {
 		return 1;
 	}
@@ -1,4 +1,5 @@
 #include "ktga.hpp"
+#include "../profiler.hpp"
 #include <stdlib.h>
 #include <string.h>
 
@@ -6,6 +7,7 @@
 #define U16(buf, i) *(((unsigned char *) buf) + i) | (*(((unsigned char *) buf) + i + 1) << 8)
 
 int ktga_load(ktga_t * out_tga, void * buffer, unsigned long long int buffer_length) {
+	PROFILE_ZONE("ktga_load");
 	if (buffer_length <= 18 || buffer == NULL) {
 		return 1;
 	}
@@ -0,0 +1,253 @@
+#include "light_clusters.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+static_assert(LIGHT_CLUSTERS_X <= 256 && LIGHT_CLUSTERS_Y <= 256 && LIGHT_CLUSTERS_Z <= 256, "cluster ranges are stored in bytes");
+
+light_clusters_c::light_clusters_c() {
+	this->offsets.assign(LIGHT_CLUSTERS + 1, 0);
+	this->stats = {};
+	this->depth_scale = 0;
+	this->depth_bias = 0;
+}
+
+static u8 light_cluster_cell(f32 position, u32 cells) {
+	f32 cell = std::floor(position);
+	return static_cast<u8>(std::clamp(cell, 0.0f, static_cast<f32>(cells - 1)));
+}
+
+/* the part of the sphere inside one slice is taken as a box in view space, lateral half size is the sphere's
+ * widest cross section within the slice. its corners bound its projection, which is intersected with the whole sphere's */
+void light_clusters_c::add_ranges(u32 light, f32 view_x, f32 view_y, f32 depth, f32 radius, const f32 ndc_low[2], const f32 ndc_high[2], b8 orthographic) {
+	if (depth + radius < this->slice_depths[0] || depth - radius > this->slice_depths[LIGHT_CLUSTERS_Z]) {
+		return;
+	}
+
+	for (usize axis = 0; axis < 2; axis++) {
+		if (ndc_high[axis] < -1.0f || ndc_low[axis] > 1.0f) {
+			return;
+		}
+	}
+
+	f32 slice_near = (depth - radius > 0) ? std::log(depth - radius) * this->depth_scale + this->depth_bias : 0.0f;
+	f32 slice_far = std::log(depth + radius) * this->depth_scale + this->depth_bias;
+	u32 z_first = light_cluster_cell(slice_near, LIGHT_CLUSTERS_Z);
+	u32 z_last = light_cluster_cell(slice_far, LIGHT_CLUSTERS_Z);
+
+	const f32 view[2] = { view_x, view_y };
+	const u32 cells[2] = { LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y };
+	for (u32 z = z_first; z <= z_last; z++) {
+		f32 low[2] = { ndc_low[0], ndc_low[1] };
+		f32 high[2] = { ndc_high[0], ndc_high[1] };
+
+		if (!orthographic) {
+			f32 near = std::max(this->slice_depths[z], depth - radius);
+			f32 far = std::min(this->slice_depths[z + 1], depth + radius);
+			f32 offset = (depth < near) ? near - depth : ((depth > far) ? depth - far : 0.0f);
+			f32 extent = std::sqrt(std::max(radius * radius - offset * offset, 0.0f));
+
+			for (usize axis = 0; axis < 2; axis++) {
+				f32 corners[4] = {
+					(view[axis] - extent) / near,
+					(view[axis] - extent) / far,
+					(view[axis] + extent) / near,
+					(view[axis] + extent) / far,
+				};
+
+				low[axis] = std::max(low[axis], this->scale[axis] * std::min(std::min(corners[0], corners[1]), std::min(corners[2], corners[3])));
+				high[axis] = std::min(high[axis], this->scale[axis] * std::max(std::max(corners[0], corners[1]), std::max(corners[2], corners[3])));
+			}
+		}
+
+		u8 first[2];
+		u8 last[2];
+		for (usize axis = 0; axis < 2; axis++) {
+			first[axis] = light_cluster_cell((low[axis] * 0.5f + 0.5f) * cells[axis], cells[axis]);
+			last[axis] = light_cluster_cell((high[axis] * 0.5f + 0.5f) * cells[axis], cells[axis]);
+		}
+
+		light_range_t range = {
+			.light = static_cast<u16>(light),
+			.z = static_cast<u8>(z),
+			.x = { first[0], last[0] },
+			.y = { first[1], last[1] },
+		};
+
+		this->ranges.push_back(range);
+	}
+}
+
+#ifndef VF_LANES
+/* the tangent lines from the eye bound the sphere's projection along each screen axis (mara and mcguire 2013).
+ * a is the center's view space coordinate on the axis, depth its view depth and scale the projection's focal length.
+ * the eye must be in front of the sphere, depth > radius */
+static void light_cluster_axis(f32 a, f32 depth, f32 radius, f32 scale, f32& low, f32& high) {
+	f32 tangent = std::sqrt(a * a + depth * depth - radius * radius);
+	low = scale * (a * tangent - radius * depth) / (depth * tangent + radius * a);
+	high = scale * (a * tangent + radius * depth) / (depth * tangent - radius * a);
+}
+#endif
+
+void light_clusters_c::build(const bounds_store_c& lights, const mat4x4 vp, f32 near, f32 far, b8 orthographic) {
+	if (lights.count > static_cast<usize>(U16_MAX) + 1) {
+		throw std::runtime_error("Too many lights for the cluster light lists");
+	}
+
+	this->depth_scale = LIGHT_CLUSTERS_Z / std::log(far / near);
+	this->depth_bias = -std::log(near) * this->depth_scale;
+	for (usize z = 0; z <= LIGHT_CLUSTERS_Z; z++) {
+		this->slice_depths[z] = std::exp((z - this->depth_bias) / this->depth_scale);
+	}
+	this->slice_depths[0] = near;
+	this->slice_depths[LIGHT_CLUSTERS_Z] = far;
+	this->ranges.clear();
+
+	/* clip x and y rows, their length is the focal length for perspective and the ndc scale for orthographic */
+	f32 scale_x = std::sqrt(vp[0][0] * vp[0][0] + vp[1][0] * vp[1][0] + vp[2][0] * vp[2][0]);
+	f32 scale_y = std::sqrt(vp[0][1] * vp[0][1] + vp[1][1] * vp[1][1] + vp[2][1] * vp[2][1]);
+	this->scale[0] = scale_x;
+	this->scale[1] = scale_y;
+
+	usize visible = 0;
+#ifdef VF_LANES
+	vf row_x[4], row_y[4], row_w[4];
+	for (usize c = 0; c < 4; c++) {
+		row_x[c] = vf_set(vp[c][0]);
+		row_y[c] = vf_set(vp[c][1]);
+		row_w[c] = vf_set(vp[c][3]);
+	}
+
+	vf vscale_x = vf_set(scale_x);
+	vf vscale_y = vf_set(scale_y);
+	vf one = vf_set(1.0f);
+	vf minus_one = vf_set(-1.0f);
+	for (usize first = 0; first < lights.count; first += VF_LANES) {
+		vf cx = vf_load(lights.center[0] + first);
+		vf cy = vf_load(lights.center[1] + first);
+		vf cz = vf_load(lights.center[2] + first);
+		vf radius = vf_load(lights.radius + first);
+
+		vf clip_x = vf_add(vf_add(vf_mul(row_x[0], cx), vf_mul(row_x[1], cy)), vf_add(vf_mul(row_x[2], cz), row_x[3]));
+		vf clip_y = vf_add(vf_add(vf_mul(row_y[0], cx), vf_mul(row_y[1], cy)), vf_add(vf_mul(row_y[2], cz), row_y[3]));
+		vf depth = vf_add(vf_add(vf_mul(row_w[0], cx), vf_mul(row_w[1], cy)), vf_add(vf_mul(row_w[2], cz), row_w[3]));
+		vf ax = vf_div(clip_x, vscale_x);
+		vf ay = vf_div(clip_y, vscale_y);
+
+		vf x_low, x_high, y_low, y_high;
+		if (orthographic) {
+			x_low = vf_sub(clip_x, vf_mul(vscale_x, radius));
+			x_high = vf_add(clip_x, vf_mul(vscale_x, radius));
+			y_low = vf_sub(clip_y, vf_mul(vscale_y, radius));
+			y_high = vf_add(clip_y, vf_mul(vscale_y, radius));
+		} else {
+			/* spheres reaching behind the eye get the whole screen here and are only narrowed per slice */
+			vf in_front = vf_less(radius, depth);
+			vf depth_squared = vf_sub(vf_mul(depth, depth), vf_mul(radius, radius));
+			vf radius_depth = vf_mul(radius, depth);
+
+			vf tangent_x = vf_sqrt(vf_max(vf_add(vf_mul(ax, ax), depth_squared), vf_set(0.0f)));
+			vf depth_tangent_x = vf_mul(depth, tangent_x);
+			vf radius_ax = vf_mul(radius, ax);
+			x_low = vf_mul(vscale_x, vf_div(vf_sub(vf_mul(ax, tangent_x), radius_depth), vf_add(depth_tangent_x, radius_ax)));
+			x_high = vf_mul(vscale_x, vf_div(vf_add(vf_mul(ax, tangent_x), radius_depth), vf_sub(depth_tangent_x, radius_ax)));
+
+			vf tangent_y = vf_sqrt(vf_max(vf_add(vf_mul(ay, ay), depth_squared), vf_set(0.0f)));
+			vf depth_tangent_y = vf_mul(depth, tangent_y);
+			vf radius_ay = vf_mul(radius, ay);
+			y_low = vf_mul(vscale_y, vf_div(vf_sub(vf_mul(ay, tangent_y), radius_depth), vf_add(depth_tangent_y, radius_ay)));
+			y_high = vf_mul(vscale_y, vf_div(vf_add(vf_mul(ay, tangent_y), radius_depth), vf_sub(depth_tangent_y, radius_ay)));
+
+			x_low = vf_select(in_front, x_low, minus_one);
+			x_high = vf_select(in_front, x_high, one);
+			y_low = vf_select(in_front, y_low, minus_one);
+			y_high = vf_select(in_front, y_high, one);
+		}
+
+		f32 lanes[8][VF_LANES];
+		vf_storeu(lanes[0], ax);
+		vf_storeu(lanes[1], ay);
+		vf_storeu(lanes[2], depth);
+		vf_storeu(lanes[3], radius);
+		vf_storeu(lanes[4], x_low);
+		vf_storeu(lanes[5], y_low);
+		vf_storeu(lanes[6], x_high);
+		vf_storeu(lanes[7], y_high);
+
+		usize count = std::min<usize>(VF_LANES, lights.count - first);
+		for (usize lane = 0; lane < count; lane++) {
+			usize before = this->ranges.size();
+			const f32 low[2] = { lanes[4][lane], lanes[5][lane] };
+			const f32 high[2] = { lanes[6][lane], lanes[7][lane] };
+			this->add_ranges(static_cast<u32>(first + lane), lanes[0][lane], lanes[1][lane], lanes[2][lane], lanes[3][lane], low, high, orthographic);
+			visible += this->ranges.size() > before;
+		}
+	}
+#else
+	for (usize i = 0; i < lights.count; i++) {
+		f32 cx = lights.center[0][i];
+		f32 cy = lights.center[1][i];
+		f32 cz = lights.center[2][i];
+		f32 radius = lights.radius[i];
+
+		f32 clip_x = vp[0][0] * cx + vp[1][0] * cy + vp[2][0] * cz + vp[3][0];
+		f32 clip_y = vp[0][1] * cx + vp[1][1] * cy + vp[2][1] * cz + vp[3][1];
+		f32 depth = vp[0][3] * cx + vp[1][3] * cy + vp[2][3] * cz + vp[3][3];
+
+		f32 low[2] = { -1.0f, -1.0f };
+		f32 high[2] = { 1.0f, 1.0f };
+		if (orthographic) {
+			low[0] = clip_x - scale_x * radius;
+			high[0] = clip_x + scale_x * radius;
+			low[1] = clip_y - scale_y * radius;
+			high[1] = clip_y + scale_y * radius;
+		} else if (radius < depth) {
+			light_cluster_axis(clip_x / scale_x, depth, radius, scale_x, low[0], high[0]);
+			light_cluster_axis(clip_y / scale_y, depth, radius, scale_y, low[1], high[1]);
+		}
+
+		usize before = this->ranges.size();
+		this->add_ranges(static_cast<u32>(i), clip_x / scale_x, clip_y / scale_y, depth, radius, low, high, orthographic);
+		visible += this->ranges.size() > before;
+	}
+#endif
+
+	/* counting sort of the ranges into per cluster lists */
+	std::vector<u32>& offsets = this->offsets;
+	std::fill(offsets.begin(), offsets.end(), 0);
+	for (usize i = 0; i < this->ranges.size(); i++) {
+		const light_range_t& range = this->ranges[i];
+		for (u32 y = range.y[0]; y <= range.y[1]; y++) {
+			u32 row = (range.z * LIGHT_CLUSTERS_Y + y) * LIGHT_CLUSTERS_X;
+			for (u32 x = range.x[0]; x <= range.x[1]; x++) {
+				++offsets[row + x + 1];
+			}
+		}
+	}
+
+	u32 max_per_cluster = 0;
+	for (usize c = 0; c < LIGHT_CLUSTERS; c++) {
+		max_per_cluster = std::max(max_per_cluster, offsets[c + 1]);
+		offsets[c + 1] += offsets[c];
+	}
+
+	this->indices.resize(offsets[LIGHT_CLUSTERS]);
+	this->cursors.assign(offsets.begin(), offsets.end() - 1);
+	for (usize i = 0; i < this->ranges.size(); i++) {
+		const light_range_t& range = this->ranges[i];
+		for (u32 y = range.y[0]; y <= range.y[1]; y++) {
+			u32 row = (range.z * LIGHT_CLUSTERS_Y + y) * LIGHT_CLUSTERS_X;
+			for (u32 x = range.x[0]; x <= range.x[1]; x++) {
+				this->indices[this->cursors[row + x]++] = range.light;
+			}
+		}
+	}
+
+	this->stats = {
+		.lights = static_cast<u32>(lights.count),
+		.visible = static_cast<u32>(visible),
+		.indices = offsets[LIGHT_CLUSTERS],
+		.max_per_cluster = max_per_cluster,
+	};
+}
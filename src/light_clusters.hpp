@@ -0,0 +1,62 @@
+#ifndef LIGHT_CLUSTERS_HPP
+#define LIGHT_CLUSTERS_HPP
+
+#include "types.hpp"
+#include "frustum.hpp"
+#include <linmath.h>
+#include <vector>
+
+/* screen tiles times depth slices, the light pass reads the same grid through its uniforms */
+#define LIGHT_CLUSTERS_X 16
+#define LIGHT_CLUSTERS_Y 9
+#define LIGHT_CLUSTERS_Z 24
+#define LIGHT_CLUSTERS (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z)
+
+struct light_cluster_stats_t {
+	u32 lights;
+	/* lights touching at least one cluster */
+	u32 visible;
+	/* entries over every cluster's list */
+	u32 indices;
+	u32 max_per_cluster;
+};
+
+/* bins light spheres into a froxel grid of the camera's view. tiles split the screen evenly, slices split view depth
+ * logarithmically between near and far, so a fragment finds its cluster from its window position and view depth alone.
+ * each slice a light spans gets the cells its part of the sphere projects to, bounds are conservative so a light may
+ * be listed in a cell it just misses but never left out of one it reaches */
+struct light_clusters_c {
+	/* LIGHT_CLUSTERS + 1 entries, cluster c's lights are indices[offsets[c]] up to indices[offsets[c + 1]] */
+	std::vector<u32> offsets;
+	/* positions of the lights in the store build() was given */
+	std::vector<u16> indices;
+	light_cluster_stats_t stats;
+	/* slice = floor(log(view depth) * depth_scale + depth_bias) */
+	f32 depth_scale;
+	f32 depth_bias;
+
+	light_clusters_c();
+
+	/* lights are the spheres of the bounds (center and radius), vp is the camera's.
+	 * view depth is clip w, so with an orthographic camera every fragment lands in one slice */
+	void build(const bounds_store_c& lights, const mat4x4 vp, f32 near, f32 far, b8 orthographic);
+
+private:
+	/* cells of one visible light in one slice, ranges are inclusive */
+	struct light_range_t {
+		u16 light;
+		u8 z;
+		u8 x[2];
+		u8 y[2];
+	};
+
+	std::vector<light_range_t> ranges;
+	std::vector<u32> cursors;
+	/* view depth where every slice starts, the last entry is far */
+	f32 slice_depths[LIGHT_CLUSTERS_Z + 1];
+	f32 scale[2];
+
+	void add_ranges(u32 light, f32 view_x, f32 view_y, f32 depth, f32 radius, const f32 ndc_low[2], const f32 ndc_high[2], b8 orthographic);
+};
+
+#endif
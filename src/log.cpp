@@ -0,0 +1,145 @@
+#include "log.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <thread>
+
+#define LOG_IDLE_SLEEP_MS 1
+
+static_assert((LOG_CAPACITY & (LOG_CAPACITY - 1)) == 0, "LOG_CAPACITY has to be a power of two");
+
+/* sequence says who owns the slot: position means free for the producer at position,
+ * position + 1 means written and waiting for the logger thread */
+struct log_slot_t {
+	std::atomic<u64> sequence;
+	log_level level;
+	char text[LOG_MESSAGE_SIZE];
+};
+
+/* bounded multi-producer ring with the logger thread as the only consumer */
+struct logger_t {
+	log_slot_t slots[LOG_CAPACITY];
+	std::atomic<u64> head;
+	std::atomic<u64> written;
+	std::atomic<u64> dropped;
+	std::atomic<u8> level;
+	std::atomic<b8> stopping;
+	std::thread thread;
+
+	logger_t() : head(0), written(0), dropped(0), level(static_cast<u8>(log_level::INFO)), stopping(false) {
+		for (u64 i = 0; i < LOG_CAPACITY; i++) {
+			this->slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		this->thread = std::thread(&logger_t::drain, this);
+	}
+
+	~logger_t() {
+		this->stopping.store(true, std::memory_order_release);
+		this->thread.join();
+	}
+
+	void drain() {
+		static const char* const names[] = { "trace", "debug", "info", "warn", "error" };
+
+		u64 tail = 0;
+		for (;;) {
+			b8 stopping = this->stopping.load(std::memory_order_acquire);
+
+			usize drained = 0;
+			for (;;) {
+				log_slot_t& slot = this->slots[tail & (LOG_CAPACITY - 1)];
+				if (slot.sequence.load(std::memory_order_acquire) != tail + 1) {
+					break;
+				}
+
+				std::FILE* stream = (slot.level >= log_level::WARN) ? stderr : stdout;
+				std::fprintf(stream, "[%s] %s\n", names[static_cast<u8>(slot.level)], slot.text);
+
+				slot.sequence.store(tail + LOG_CAPACITY, std::memory_order_release);
+				++tail;
+				++drained;
+				this->written.store(tail, std::memory_order_release);
+			}
+
+			if (drained > 0) {
+				std::fflush(stdout);
+				std::fflush(stderr);
+				continue;
+			}
+
+			/* everything published before stopping was seen has been written */
+			if (stopping) {
+				return;
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(LOG_IDLE_SLEEP_MS));
+		}
+	}
+};
+
+static logger_t& logger() {
+	static logger_t instance;
+	return instance;
+}
+
+void log_write(log_level level, const char* format, ...) {
+	logger_t& state = logger();
+
+	u64 position = state.head.load(std::memory_order_relaxed);
+	log_slot_t* slot;
+	for (;;) {
+		slot = &state.slots[position & (LOG_CAPACITY - 1)];
+		s64 lag = static_cast<s64>(slot->sequence.load(std::memory_order_acquire) - position);
+		if (lag == 0) {
+			if (state.head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (lag < 0) {
+			/* the slot still holds a message from a lap ago, the ring is full. errors wait for room instead of being lost */
+			if (level < log_level::ERROR) {
+				state.dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			std::this_thread::yield();
+			position = state.head.load(std::memory_order_relaxed);
+		} else {
+			position = state.head.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->level = level;
+	va_list arguments;
+	va_start(arguments, format);
+	std::vsnprintf(slot->text, LOG_MESSAGE_SIZE, format, arguments);
+	va_end(arguments);
+
+	slot->sequence.store(position + 1, std::memory_order_release);
+
+	/* an error is usually followed by a throw that can end the process before the logger thread wakes up */
+	if (level >= log_level::ERROR) {
+		log_flush();
+	}
+}
+
+void log_set_level(log_level level) {
+	logger().level.store(static_cast<u8>(level), std::memory_order_relaxed);
+}
+
+b8 log_enabled(log_level level) {
+	return static_cast<u8>(level) >= logger().level.load(std::memory_order_relaxed);
+}
+
+void log_flush() {
+	logger_t& state = logger();
+	u64 target = state.head.load(std::memory_order_acquire);
+	while (state.written.load(std::memory_order_acquire) < target) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(LOG_IDLE_SLEEP_MS));
+	}
+}
+
+u64 log_dropped() {
+	return logger().dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,57 @@
+#ifndef LOG_HPP
+#define LOG_HPP
+
+#include "types.hpp"
+
+enum class log_level : u8 {
+	TRACE = 0,
+	DEBUG,
+	INFO,
+	WARN,
+	ERROR,
+};
+
+/* levels below this are compiled out along with their arguments, build with -DLOG_LEVEL_MIN=0 to keep trace logs */
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN 2
+#endif
+
+/* ring slots, a power of two */
+#define LOG_CAPACITY 1024
+/* longer messages are truncated */
+#define LOG_MESSAGE_SIZE 248
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LOG_PRINTF_FORMAT(format_index, first_argument) __attribute__((format(printf, format_index, first_argument)))
+#else
+#define LOG_PRINTF_FORMAT(format_index, first_argument)
+#endif
+
+/* printf style. the message is formatted by the calling thread straight into a slot of a lock-free ring
+ * and written out by the logger's own thread, so logging never waits on console i/o or allocates.
+ * a message that finds the ring full is dropped and counted instead of waiting.
+ * errors are the exception, they wait for room and return once written, so they are out before a throw can terminate */
+void log_write(log_level level, const char* format, ...) LOG_PRINTF_FORMAT(2, 3);
+/* runtime filter on top of LOG_LEVEL_MIN, INFO by default */
+void log_set_level(log_level level);
+b8 log_enabled(log_level level);
+/* waits until everything logged so far has been written */
+void log_flush();
+u64 log_dropped();
+
+#define LOG_AT(level, ...) \
+	do { \
+		if constexpr (static_cast<u8>(level) >= LOG_LEVEL_MIN) { \
+			if (log_enabled(level)) { \
+				log_write(level, __VA_ARGS__); \
+			} \
+		} \
+	} while (0)
+
+#define LOG_TRACE(...) LOG_AT(log_level::TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(log_level::DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(log_level::INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(log_level::WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(log_level::ERROR, __VA_ARGS__)
+
+#endif
@@ -2,14 +2,18 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <linmath.h>
-#include <iostream>
 #include <fstream>
 #include <cmath>
+#include <cstring>
+#include <algorithm>
 #include <exception>
 #include "renderer.hpp"
 #include "input.hpp"
 #include "camera.hpp"
 #include "platforms.hpp"
+#include "log.hpp"
+#include "profiler.hpp"
+#include "self_check.hpp"
 #include "ktga/ktga.hpp"
 #include "kobj/kobj.hpp"
 
@@ -17,40 +21,314 @@
 #include <filesystem>
 #endif
 
-int main(int argc, char ** argv) {
-	glfwSetErrorCallback([](int error, const char* description) {
-		std::cerr << "Error: " << description << "\n";
-	});
+/* --light-bench: a floor of pillars under a grid of small moving point lights */
+#define LIGHT_BENCH_SIDE 64
+#define LIGHT_BENCH_PILLARS 16
+#define LIGHT_BENCH_EXTENT 20.0f
+#define LIGHT_BENCH_INTENSITY 0.4f
 
-	if (!glfwInit()) {
-		return -1;
+static void light_bench_create(renderer_c& renderer, const mesh_t* cube, const material_t& material, std::vector<light_t*>& lights) {
+	transform_t transform = {
+		.position = { 0, -0.6f, 0 },
+		.rotation = { 0, 0, 0 },
+		.scale = { LIGHT_BENCH_EXTENT * 2, 0.1f, LIGHT_BENCH_EXTENT },
+	};
+
+	mesh_t* floor = renderer.create_mesh(transform, material, cube->shader);
+	renderer.mesh_share_geometry(floor, cube);
+	renderer.set_static(floor, true);
+
+	f32 spacing = LIGHT_BENCH_EXTENT * 2 / LIGHT_BENCH_PILLARS;
+	for (usize z = 0; z < LIGHT_BENCH_PILLARS; z++) {
+		for (usize x = 0; x < LIGHT_BENCH_PILLARS; x++) {
+			transform = {
+				.position = { -LIGHT_BENCH_EXTENT + (x + 0.5f) * spacing, 0.4f, -LIGHT_BENCH_EXTENT + (z + 0.5f) * spacing },
+				.rotation = { 0, 0, 0 },
+				.scale = { 0.4f, 2.0f, 0.2f },
+			};
+
+			mesh_t* pillar = renderer.create_mesh(transform, material, cube->shader);
+			renderer.mesh_share_geometry(pillar, cube);
+			renderer.set_static(pillar, true);
+		}
 	}
-	
-	/* pylauncher workaround (glfwInit() resets the working dir for some reason on macOS) */
-	#ifdef PYLAUNCHER
-	if (argc >= 2) {
-		std::filesystem::current_path(argv[1]);
+
+	spacing = LIGHT_BENCH_EXTENT * 2 / LIGHT_BENCH_SIDE;
+	for (usize z = 0; z < LIGHT_BENCH_SIDE; z++) {
+		for (usize x = 0; x < LIGHT_BENCH_SIDE; x++) {
+			usize i = z * LIGHT_BENCH_SIDE + x;
+			vec3 position = { -LIGHT_BENCH_EXTENT + (x + 0.5f) * spacing, 0, -LIGHT_BENCH_EXTENT + (z + 0.5f) * spacing };
+			vec3 color = { 0.5f + 0.5f * std::sinf(i * 0.37f), 0.5f + 0.5f * std::sinf(i * 0.61f + 2.0f), 0.5f + 0.5f * std::sinf(i * 0.83f + 4.0f) };
+			lights.push_back(renderer.create_light(position, color, LIGHT_BENCH_INTENSITY));
+		}
 	}
-	#endif
+}
 
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	#ifdef PLATFORM_APPLE_MACOS
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+/* every light bobs on its own phase so the clusters are rebuilt from moving lights */
+static void light_bench_update(std::vector<light_t*>& lights, f32 time) {
+	for (usize i = 0; i < lights.size(); i++) {
+		lights[i]->position[1] = 0.3f + 0.5f * (1.0f + std::sinf(time * 1.5f + i * 0.1f));
+	}
+}
+
+/* --upload-bench: meshes uploaded one after another into the shader's growing buffers, then as many uploads of data
+ * that is already there, which are shared instead of stored */
+#define UPLOAD_BENCH_MESHES 100000
+
+static int upload_bench_run(renderer_c& renderer, const material_t& material, shader_t shader, const vertex_t* vertices, usize vcount, u32* indices, usize icount) {
+	transform_t transform = {
+		.position = { 0, 0, 0 },
+		.rotation = { 0, 0, 0 },
+		.scale = { 1, 1, 1 },
+	};
+
+	std::vector<mesh_t*> meshes(UPLOAD_BENCH_MESHES);
+	for (usize i = 0; i < meshes.size(); i++) {
+		meshes[i] = renderer.create_mesh(transform, material, shader);
+	}
+
+	/* every copy is nudged so it hashes differently, otherwise uploads after the first just share its geometry */
+	std::vector<vertex_t> copy(vertices, vertices + vcount);
+	f64 start = glfwGetTime();
+	for (usize i = 0; i < meshes.size(); i++) {
+		for (usize v = 0; v < vcount; v++) {
+			copy[v].pos[0] = vertices[v].pos[0] + i * 1e-3f;
+		}
+		renderer.mesh_upload(meshes[i], copy.data(), vcount * sizeof(vertex_t), indices, icount * sizeof(u32));
+	}
+	glFinish();
+	f64 seconds = glfwGetTime() - start;
+
+	f64 bytes = static_cast<f64>(meshes.size()) * (vcount * sizeof(vertex_t) + icount * sizeof(u32));
+	shader_buffer_stats_t stats = renderer.shader_buffer_stats(shader);
+	LOG_INFO("upload bench: %zu meshes in %.1f ms, %.0f meshes/s, %.1f MiB/s", meshes.size(), seconds * 1e3, meshes.size() / seconds, bytes / (1024.0 * 1024.0) / seconds);
+	LOG_INFO("upload bench: buffers hold %u of %u vertices and %u of %u indices", stats.vertices.used, stats.vertices.capacity, stats.indices.used, stats.indices.capacity);
+
+	/* the first unique upload wasn't nudged, so every one of these matches it */
+	std::vector<mesh_t*> duplicates(UPLOAD_BENCH_MESHES);
+	for (usize i = 0; i < duplicates.size(); i++) {
+		duplicates[i] = renderer.create_mesh(transform, material, shader);
+	}
+
+	copy.assign(vertices, vertices + vcount);
+	start = glfwGetTime();
+	for (usize i = 0; i < duplicates.size(); i++) {
+		renderer.mesh_upload(duplicates[i], copy.data(), vcount * sizeof(vertex_t), indices, icount * sizeof(u32));
+	}
+	glFinish();
+	seconds = glfwGetTime() - start;
+
+	shader_buffer_stats_t shared = renderer.shader_buffer_stats(shader);
+	LOG_INFO("upload bench: %zu duplicate meshes in %.1f ms, %.0f meshes/s, %u vertices added to the buffers", duplicates.size(), seconds * 1e3, duplicates.size() / seconds,
+		shared.vertices.used - stats.vertices.used);
+	return 0;
+}
+
+/* --mdi-bench: the geometry pass with one multi draw per shader and texture set against one draw per geometry.
+ * every mesh gets its own geometry, so without multi draw each one is its own draw call */
+#define MDI_BENCH_WARMUP_FRAMES 100
+/* the gpu timer's history only holds this many, so every sample averaged is from the current setting */
+#define MDI_BENCH_FRAMES GPU_TIMER_HISTORY
+#define MDI_BENCH_SIDE 250
+
+static int mdi_bench_run(GLFWwindow* window, renderer_c& renderer, const material_t& material, shader_t shader, const vertex_t* vertices, usize vcount, u32* indices, usize icount) {
+	const usize counts[] = { 1000, 10000, 50000 };
+	glfwSwapInterval(0);
+
+	std::vector<vertex_t> copy(vertices, vertices + vcount);
+	std::vector<mesh_t*> meshes;
+	for (usize count : counts) {
+		while (meshes.size() < count) {
+			usize i = meshes.size();
+			transform_t transform = {
+				.position = { (static_cast<f32>(i % MDI_BENCH_SIDE) - MDI_BENCH_SIDE / 2) * 0.2f, (static_cast<f32>(i / MDI_BENCH_SIDE) - MDI_BENCH_SIDE / 4) * 0.2f, -30.0f },
+				.rotation = { 0, 0, 0 },
+				.scale = { 0.1f, 0.1f, 0.1f },
+			};
+
+			for (usize v = 0; v < vcount; v++) {
+				copy[v].pos[0] = vertices[v].pos[0] + i * 1e-4f;
+			}
+
+			meshes.push_back(renderer.create_mesh(transform, material, shader));
+			renderer.mesh_upload(meshes.back(), copy.data(), vcount * sizeof(vertex_t), indices, icount * sizeof(u32));
+		}
+
+		for (b8 enabled : { false, true }) {
+			if (renderer.set_multi_draw_indirect(enabled) != enabled) {
+				LOG_INFO("mdi bench: %zu meshes, multi draw indirect isn't supported by this context", count);
+				continue;
+			}
+
+			f64 cpu = 0;
+			for (usize frame = 0; frame < MDI_BENCH_WARMUP_FRAMES + MDI_BENCH_FRAMES; frame++) {
+				f64 start = glfwGetTime();
+				renderer.draw();
+				if (frame >= MDI_BENCH_WARMUP_FRAMES) {
+					cpu += glfwGetTime() - start;
+				}
+
+				glfwSwapBuffers(window);
+				glfwPollEvents();
+			}
+
+			const gpu_pass_stats_t& geometry = renderer.gpu_timing().passes[static_cast<usize>(gpu_pass::GEOMETRY)];
+			LOG_INFO("mdi bench: %zu meshes, multi draw %s, %u visible, %u draw calls, draw() %.3f ms cpu, geometry pass %.3f ms gpu", count, enabled ? "on" : "off",
+				renderer.cull_stats().geometry.visible, renderer.bind_stats().draw_calls, cpu * 1e3 / MDI_BENCH_FRAMES, geometry.avg_ms);
+		}
+	}
+
+	return 0;
+}
+
+/* --allocation-check: the default scene's light goes round once to let every per-frame buffer reach its largest size,
+ * then the same lap again, where no frame may allocate. the main loop's warning only skips the first few frames */
+#define ALLOCATION_CHECK_FRAMES 240
+#define ALLOCATION_WARN_WARMUP_FRAMES 3
+
+static int allocation_check_run(GLFWwindow* window, renderer_c& renderer, light_t* light, mesh_t* light_mesh) {
+	#ifndef ALLOCATION_COUNTING
+	(void) window;
+	(void) renderer;
+	(void) light;
+	(void) light_mesh;
+	LOG_ERROR("allocation check: draw() allocations are only counted in builds with -DALLOCATION_COUNTING, make mac-*-counting builds one");
+	return 1;
+	#else
+	usize allocating = 0;
+	for (usize frame = 0; frame < 2 * ALLOCATION_CHECK_FRAMES; frame++) {
+		f32 time = (frame % ALLOCATION_CHECK_FRAMES) * 2 * static_cast<f32>(M_PI) / ALLOCATION_CHECK_FRAMES;
+		light->position[0] = std::sinf(time);
+		light->position[2] = std::cosf(time);
+		light_mesh->transform.position[0] = light->position[0];
+		light_mesh->transform.position[2] = light->position[2];
+		light_mesh->transform.rotation[1] = std::sinf(time) * 6;
+
+		renderer.draw();
+		if (frame >= ALLOCATION_CHECK_FRAMES && renderer.draw_allocations() != 0) {
+			LOG_ERROR("allocation check: frame %zu, draw() allocated %llu times", frame, static_cast<unsigned long long>(renderer.draw_allocations()));
+			++allocating;
+		}
+
+		glfwSwapBuffers(window);
+		glfwPollEvents();
+	}
+
+	LOG_INFO("allocation check: %zu of %d frames of the second lap allocated, %s", allocating, ALLOCATION_CHECK_FRAMES, allocating == 0 ? "passed" : "failed");
+	return allocating == 0 ? 0 : 1;
 	#endif
+}
 
-	GLFWwindow* window = glfwCreateWindow(800, 600, "GameJam Engine", NULL, NULL);
-	if (window == nullptr) {
-		glfwTerminate();
-		return -1;
+/* --draw-bench: the per-draw uniform of the geometry pass set once per draw, the way draw() used to, by name through
+ * the cached location table and by precomputed id */
+#define DRAW_BENCH_DRAWS 10000
+#define DRAW_BENCH_RUNS 5
+
+/* shader_uniform as it was before locations were cached: the caller's literal becomes a temporary string, the shader's
+ * uniforms are scanned with a string compare and the location is queried from gl on every call */
+static s32 draw_bench_uniform_uncached(GLuint program, const std::vector<std::string>& uniforms, const std::string& name, s32 value) {
+	usize uniform = USIZE_MAX;
+	for (usize i = 0; i < uniforms.size(); i++) {
+		if (name.compare(uniforms[i]) == 0) {
+			uniform = i;
+			break;
+		}
+	}
+
+	if (uniform == USIZE_MAX) {
+		return 3;
+	}
+
+	GLint location = glGetUniformLocation(program, name.c_str());
+	if (location == -1) {
+		return 5;
+	}
+
+	glUniform1i(location, value);
+	return 0;
+}
+
+static int draw_bench_run(renderer_c& renderer, shader_t shader) {
+	const uniform_id_t id = uniform_id("unif_draw_index");
+	renderer.shader_use(shader);
+
+	/* the names the old scan compared against, in the order the program reports them */
+	GLint program = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	GLint active = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &active);
+	std::vector<std::string> uniforms;
+	for (GLint i = 0; i < active; i++) {
+		GLchar uniform[256];
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(program, static_cast<GLuint>(i), sizeof(uniform), &length, &size, &type, uniform);
+		uniforms.emplace_back(uniform, length);
+	}
+
+	f64 uncached = 1e30;
+	f64 by_name = 1e30;
+	f64 by_id = 1e30;
+	s32 failed = 0;
+	for (usize run = 0; run < DRAW_BENCH_RUNS; run++) {
+		f64 start = glfwGetTime();
+		for (s32 i = 0; i < DRAW_BENCH_DRAWS; i++) {
+			failed |= draw_bench_uniform_uncached(program, uniforms, "unif_draw_index", i);
+		}
+		glFinish();
+		uncached = std::min(uncached, glfwGetTime() - start);
+
+		start = glfwGetTime();
+		for (s32 i = 0; i < DRAW_BENCH_DRAWS; i++) {
+			failed |= renderer.shader_uniform(shader, "unif_draw_index", &i, sizeof(i));
+		}
+		glFinish();
+		by_name = std::min(by_name, glfwGetTime() - start);
+
+		start = glfwGetTime();
+		for (s32 i = 0; i < DRAW_BENCH_DRAWS; i++) {
+			failed |= renderer.shader_uniform(shader, id, &i, sizeof(i));
+		}
+		glFinish();
+		by_id = std::min(by_id, glfwGetTime() - start);
 	}
 
+	if (failed != 0) {
+		LOG_ERROR("draw bench: setting unif_draw_index failed");
+		return 1;
+	}
+
+	LOG_INFO("draw bench: %d draws, uncached %.3f ms (%.1f ns a draw), by name %.3f ms (%.1f ns a draw), by id %.3f ms (%.1f ns a draw)", DRAW_BENCH_DRAWS,
+		uncached * 1e3, uncached * 1e9 / DRAW_BENCH_DRAWS, by_name * 1e3, by_name * 1e9 / DRAW_BENCH_DRAWS, by_id * 1e3, by_id * 1e9 / DRAW_BENCH_DRAWS);
+	LOG_INFO("draw bench: by id is %.1fx the uncached path and %.1fx by name", uncached / by_id, by_name / by_id);
+	return 0;
+}
+
+static int run(GLFWwindow* window, int argc, char ** argv) {
 	input::register_input(window);
 	
+	b8 light_bench = false;
+	b8 draw_bench = false;
+	b8 upload_bench = false;
+	b8 mdi_bench = false;
+	b8 allocation_check = false;
+	b8 compact_gbuffer = false;
+	b8 dynamic_resolution = false;
+	for (int i = 1; i < argc; i++) {
+		light_bench = light_bench || std::strcmp(argv[i], "--light-bench") == 0;
+		draw_bench = draw_bench || std::strcmp(argv[i], "--draw-bench") == 0;
+		upload_bench = upload_bench || std::strcmp(argv[i], "--upload-bench") == 0;
+		mdi_bench = mdi_bench || std::strcmp(argv[i], "--mdi-bench") == 0;
+		allocation_check = allocation_check || std::strcmp(argv[i], "--allocation-check") == 0;
+		compact_gbuffer = compact_gbuffer || std::strcmp(argv[i], "--compact-gbuffer") == 0;
+		dynamic_resolution = dynamic_resolution || std::strcmp(argv[i], "--dynamic-resolution") == 0;
+	}
+
 	camera_c camera = camera_c(80, 0.1f, 100.0, 4.0 / 3.0);
-	renderer_c renderer = renderer_c(window, camera);
+	renderer_c renderer = renderer_c(window, camera, compact_gbuffer ? gbuffer_layout::COMPACT : gbuffer_layout::STANDARD);
 	glfwSwapInterval(1);
+	renderer.set_dynamic_resolution(dynamic_resolution, 1000.0f / 60.0f);
 
 	transform_t transform = {
 		.position = { 0, 0, 0 },
@@ -170,7 +448,9 @@ int main(int argc, char ** argv) {
 		0, 4, 7, 7, 3, 0
 	};
 
-	renderer.mesh_upload(renderer.create_mesh(transform, material, 0), testv, sizeof(testv), testi, sizeof(testi));
+	mesh_t* cube = renderer.create_mesh(transform, material, 0);
+	renderer.mesh_upload(cube, testv, sizeof(testv), testi, sizeof(testi));
+	renderer.set_static(cube, true);
 	transform.scale[0] = 1;
 	transform.scale[1] = 1;
 	transform.scale[2] = 1;
@@ -180,7 +460,7 @@ int main(int argc, char ** argv) {
 	material.textures[2] = specular;
 
 	mesh_t* light_mesh = renderer.create_mesh(transform, material, 0);
-	renderer.mesh_upload(light_mesh, testv, sizeof(testv), testi, sizeof(testi));
+	renderer.mesh_share_geometry(light_mesh, cube);
 	light_mesh->transform.position[1] = 1;
 
 	light_mesh->transform.scale[0] *= 0.05f;
@@ -194,10 +474,11 @@ int main(int argc, char ** argv) {
 	std::vector<mesh_t*> meshes = std::vector<mesh_t*>(6);
 	for (usize i = 0; i < meshes.size(); ++i) {
 		meshes[i] = renderer.create_mesh(transform, material, 0);
-		renderer.mesh_upload(meshes[i], testv, sizeof(testv), testi, sizeof(testi));
+		renderer.mesh_share_geometry(meshes[i], cube);
 		meshes[i]->transform.position[0] = std::sinf(i) * 2;
 		meshes[i]->transform.position[1] = std::sinf(i) / 5 + 0.5f;
 		meshes[i]->transform.position[2] = std::cosf(i) * 2;
+		renderer.set_static(meshes[i], true);
 	}
 
 	light_t* light = nullptr;
@@ -205,12 +486,45 @@ int main(int argc, char ** argv) {
 		vec3 pos = { 0, 0, 0 };
 		vec3 color = { 1, 1, 1 };
 		light = renderer.create_light(pos, color, 20);
+		light->casts_shadows = true;
+	}
+
+	/* one-shot benches measure and exit instead of running the scene */
+	if (draw_bench) {
+		return draw_bench_run(renderer, cube->shader);
+	}
+	if (upload_bench) {
+		return upload_bench_run(renderer, material, cube->shader, testv, sizeof(testv) / sizeof(vertex_t), testi, sizeof(testi) / sizeof(u32));
+	}
+	if (allocation_check) {
+		return allocation_check_run(window, renderer, light, light_mesh);
+	}
+	if (mdi_bench) {
+		return mdi_bench_run(window, renderer, material, cube->shader, testv, sizeof(testv) / sizeof(vertex_t), testi, sizeof(testi) / sizeof(u32));
+	}
+
+	std::vector<light_t*> bench_lights;
+	if (light_bench) {
+		light_bench_create(renderer, cube, material, bench_lights);
+		camera.transform.position[1] = 3;
+		/* frame times are what the bench measures, so don't wait for vblank */
+		glfwSwapInterval(0);
+		LOG_INFO("light bench: %zu lights", bench_lights.size());
 	}
 
 	double time;
 	float delta_time = 0;
+	#ifdef ALLOCATION_COUNTING
+	usize counted_frames = 0;
+	#endif
+	double bench_report_time = glfwGetTime();
+	usize bench_frames = 0;
 	while (!glfwWindowShouldClose(window)) {
+		PROFILE_ZONE("frame");
 		time = glfwGetTime();
+		if (light_bench) {
+			light_bench_update(bench_lights, time);
+		}
 		/*
 		mesh->material.r = std::abs(std::sin(glfwGetTime()));
 		mesh->material.g = std::abs(std::cos(glfwGetTime()));
@@ -230,6 +544,15 @@ int main(int argc, char ** argv) {
 			break;
 		}
 
+		/* the trace holds each thread's latest PROFILER_THREAD_CAPACITY zones, this frame's zone ends after the write */
+		if (input::key_down(GLFW_KEY_F12)) {
+			if (profiler_write_trace("trace.json")) {
+				LOG_INFO("wrote trace.json, %llu zones recorded so far", static_cast<unsigned long long>(profiler_zone_count()));
+			} else {
+				LOG_WARN("failed to write trace.json");
+			}
+		}
+
 		vec3 forward = { std::sinf(camera.transform.rotation[1] * (M_PI / 180.0)), 0, -std::cosf(camera.transform.rotation[1] * (M_PI / 180.0)) };
 		vec3 up = { 0, 1, 0 };
 		vec3 right;
@@ -272,12 +595,83 @@ int main(int argc, char ** argv) {
 		}
 
 		renderer.draw();
-		glfwSwapBuffers(window);
+		#ifdef ALLOCATION_COUNTING
+		/* the first frames size the renderer's per-frame storage, after that draw() must not allocate */
+		if (++counted_frames > ALLOCATION_WARN_WARMUP_FRAMES && renderer.draw_allocations() != 0) {
+			LOG_WARN("draw() allocated %llu times", static_cast<unsigned long long>(renderer.draw_allocations()));
+		}
+		#endif
+		{
+			PROFILE_ZONE("glfwSwapBuffers");
+			glfwSwapBuffers(window);
+		}
 		input::update();
 		delta_time = glfwGetTime() - time;
+
+		if (light_bench) {
+			++bench_frames;
+			if (glfwGetTime() - bench_report_time >= 1.0) {
+				light_cluster_stats_t stats = renderer.light_cluster_stats();
+				f64 frame_ms = (glfwGetTime() - bench_report_time) * 1000.0 / bench_frames;
+				LOG_INFO("light bench: %.2f ms per frame, %.2f ms gpu at %.2f scale, %u of %u lights visible, %u cluster entries, at most %u in a cluster", frame_ms, renderer.gpu_frame_ms(), renderer.resolution_scale(), stats.visible, stats.lights, stats.indices, stats.max_per_cluster);
+				gpu_timing_t timing = renderer.gpu_timing();
+				for (usize i = 0; i < GPU_PASS_COUNT; i++) {
+					const gpu_pass_stats_t& pass = timing.passes[i];
+					if (pass.samples > 0) {
+						LOG_INFO("light bench: %s pass %.2f ms gpu, %.2f to %.2f over %u frames", gpu_pass_name(static_cast<gpu_pass>(i)), pass.avg_ms, pass.min_ms, pass.max_ms, pass.samples);
+					}
+				}
+				bench_report_time = glfwGetTime();
+				bench_frames = 0;
+			}
+		}
 	}
 
+	return 0;
+}
+
+int main(int argc, char ** argv) {
+	/* headless, runs before glfw so it works without a display */
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--self-check") == 0) {
+			return self_check_run() ? 0 : 1;
+		}
+	}
+
+	glfwSetErrorCallback([](int error, const char* description) {
+		LOG_ERROR("glfw %d: %s", error, description);
+	});
+
+	if (!glfwInit()) {
+		return -1;
+	}
+
+	profiler_set_thread_name("main");
+	
+	/* pylauncher workaround (glfwInit() resets the working dir for some reason on macOS) */
+	#ifdef PYLAUNCHER
+	if (argc >= 2) {
+		std::filesystem::current_path(argv[1]);
+	}
+	#endif
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	#ifdef PLATFORM_APPLE_MACOS
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+	#endif
+
+	GLFWwindow* window = glfwCreateWindow(800, 600, "GameJam Engine", NULL, NULL);
+	if (window == nullptr) {
+		glfwTerminate();
+		return -1;
+	}
+
+	/* everything that holds on to the window, the renderer included, is gone by the time run() returns */
+	int result = run(window, argc, argv);
+
 	glfwDestroyWindow(window);
 	glfwTerminate();
-	return 0;
+	return result;
 }
@@ -0,0 +1,417 @@
+#include "occlusion.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#define OCCLUSION_ROW_ALIGNMENT 8
+/* bounds tested per job in test() */
+#define OCCLUSION_TEST_BATCH 128
+/* texels a box may cover at the level it is refined to before it is just assumed visible */
+#define OCCLUSION_REFINE_TEXELS 64
+
+struct clip_vertex_t {
+	f32 x, y, z, w;
+};
+
+occlusion_culler_c::occlusion_culler_c(u32 width, u32 height, worker_pool_c* pool) {
+	if (width == 0 || height == 0 || width % OCCLUSION_ROW_ALIGNMENT != 0) {
+		throw std::runtime_error("Occlusion buffer width must be a non-zero multiple of 8");
+	}
+
+	this->width = width;
+	this->height = height;
+	this->pool = pool;
+	this->depth.assign(static_cast<usize>(width) * height, 1.0f);
+	mat4x4_identity(this->vp);
+
+	u32 level_width = width;
+	u32 level_height = height;
+	while (level_width > 1 || level_height > 1) {
+		level_width = (level_width + 1) / 2;
+		level_height = (level_height + 1) / 2;
+
+		occlusion_pyramid_level_t level = {
+			.width = level_width,
+			.height = level_height,
+			.min = std::vector<f32>(static_cast<usize>(level_width) * level_height, 1.0f),
+			.max = std::vector<f32>(static_cast<usize>(level_width) * level_height, 1.0f),
+		};
+		this->pyramid.push_back(std::move(level));
+	}
+}
+
+u32 occlusion_culler_c::add_model(const f32* positions, usize vertex_count, const u32* indices, usize index_count) {
+	for (usize i = 0; i < index_count; i++) {
+		if (indices[i] >= vertex_count) {
+			throw std::runtime_error("Occluder index out of range");
+		}
+	}
+
+	u32 id = static_cast<u32>(this->models.size());
+	if (!this->free_models.empty()) {
+		id = this->free_models.back();
+		this->free_models.pop_back();
+	} else {
+		this->models.emplace_back();
+	}
+
+	occlusion_model_t& model = this->models[id];
+	model.positions.assign(positions, positions + vertex_count * 3);
+	model.indices.assign(indices, indices + index_count - index_count % 3);
+	return id;
+}
+
+void occlusion_culler_c::remove_model(u32 model) {
+	if (model >= this->models.size()) {
+		return;
+	}
+
+	this->models[model] = {};
+	this->free_models.push_back(model);
+}
+
+void occlusion_culler_c::begin(const mat4x4 vp) {
+	mat4x4_dup(this->vp, vp);
+	std::fill(this->depth.begin(), this->depth.end(), 1.0f);
+	this->occluders.clear();
+}
+
+void occlusion_culler_c::add_occluder(u32 model, const f32 model_matrix[16]) {
+	if (model >= this->models.size()) {
+		return;
+	}
+
+	occluder_t occluder;
+	occluder.model = model;
+
+	mat4x4 m;
+	std::memcpy(m, model_matrix, sizeof(mat4x4));
+	mat4x4_mul(occluder.mvp, this->vp, m);
+	this->occluders.push_back(occluder);
+}
+
+static clip_vertex_t clip_vertex_lerp(const clip_vertex_t& a, const clip_vertex_t& b, f32 t) {
+	return {
+		a.x + (b.x - a.x) * t,
+		a.y + (b.y - a.y) * t,
+		a.z + (b.z - a.z) * t,
+		a.w + (b.w - a.w) * t,
+	};
+}
+
+void occlusion_culler_c::setup_triangles() {
+	this->triangles.clear();
+
+	f32 width = static_cast<f32>(this->width);
+	f32 height = static_cast<f32>(this->height);
+	for (usize o = 0; o < this->occluders.size(); o++) {
+		const occluder_t& occluder = this->occluders[o];
+		const occlusion_model_t& model = this->models[occluder.model];
+
+		for (usize i = 0; i + 2 < model.indices.size(); i += 3) {
+			clip_vertex_t vertices[3];
+			for (usize v = 0; v < 3; v++) {
+				const f32* p = &model.positions[model.indices[i + v] * 3];
+				vec4 position = { p[0], p[1], p[2], 1 };
+				vec4 clip;
+				mat4x4_mul_vec4(clip, occluder.mvp, position);
+				vertices[v] = { clip[0], clip[1], clip[2], clip[3] };
+			}
+
+			/* entirely outside one side plane */
+			if ((vertices[0].x > vertices[0].w && vertices[1].x > vertices[1].w && vertices[2].x > vertices[2].w) ||
+				(vertices[0].x < -vertices[0].w && vertices[1].x < -vertices[1].w && vertices[2].x < -vertices[2].w) ||
+				(vertices[0].y > vertices[0].w && vertices[1].y > vertices[1].w && vertices[2].y > vertices[2].w) ||
+				(vertices[0].y < -vertices[0].w && vertices[1].y < -vertices[1].w && vertices[2].y < -vertices[2].w)) {
+				continue;
+			}
+
+			/* only the near plane is clipped, everything else is handled by the bounding box clamp */
+			clip_vertex_t clipped[4];
+			usize count = 0;
+			for (usize v = 0; v < 3; v++) {
+				const clip_vertex_t& current = vertices[v];
+				const clip_vertex_t& next = vertices[(v + 1) % 3];
+				f32 current_distance = current.z + current.w;
+				f32 next_distance = next.z + next.w;
+
+				if (current_distance >= 0) {
+					clipped[count++] = current;
+				}
+
+				if ((current_distance >= 0) != (next_distance >= 0)) {
+					clipped[count++] = clip_vertex_lerp(current, next, current_distance / (current_distance - next_distance));
+				}
+			}
+
+			if (count < 3) {
+				continue;
+			}
+
+			f32 window[4][3];
+			b8 behind = false;
+			for (usize v = 0; v < count; v++) {
+				if (clipped[v].w <= 1e-6f) {
+					behind = true;
+					break;
+				}
+
+				f32 inverse_w = 1.0f / clipped[v].w;
+				window[v][0] = (clipped[v].x * inverse_w * 0.5f + 0.5f) * width;
+				window[v][1] = (clipped[v].y * inverse_w * 0.5f + 0.5f) * height;
+				window[v][2] = clipped[v].z * inverse_w * 0.5f + 0.5f;
+			}
+
+			if (behind) {
+				continue;
+			}
+
+			for (usize v = 1; v + 1 < count; v++) {
+				const f32* a = window[0];
+				const f32* b = window[v];
+				const f32* c = window[v + 1];
+
+				f32 area = (b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]);
+				if (std::fabs(area) < 1e-8f) {
+					continue;
+				}
+
+				/* occluders are drawn double sided, clockwise triangles are flipped */
+				if (area < 0) {
+					std::swap(b, c);
+					area = -area;
+				}
+
+				triangle_t triangle;
+				triangle.x[0] = a[0]; triangle.x[1] = b[0]; triangle.x[2] = c[0];
+				triangle.y[0] = a[1]; triangle.y[1] = b[1]; triangle.y[2] = c[1];
+				triangle.dzdx = ((b[2] - a[2]) * (c[1] - a[1]) - (c[2] - a[2]) * (b[1] - a[1])) / area;
+				triangle.dzdy = ((c[2] - a[2]) * (b[0] - a[0]) - (b[2] - a[2]) * (c[0] - a[0])) / area;
+				triangle.z = a[2] - triangle.dzdx * a[0] - triangle.dzdy * a[1];
+				triangle.min_x = std::min(a[0], std::min(b[0], c[0]));
+				triangle.max_x = std::max(a[0], std::max(b[0], c[0]));
+				triangle.min_y = std::min(a[1], std::min(b[1], c[1]));
+				triangle.max_y = std::max(a[1], std::max(b[1], c[1]));
+
+				if (triangle.max_x < 0 || triangle.min_x >= width || triangle.max_y < 0 || triangle.min_y >= height) {
+					continue;
+				}
+
+				this->triangles.push_back(triangle);
+			}
+		}
+	}
+}
+
+/* rows are independent, so every worker takes a band of them and walks every triangle */
+void occlusion_culler_c::rasterize_rows(u32 first_row, u32 end_row) {
+	for (usize t = 0; t < this->triangles.size(); t++) {
+		const triangle_t& triangle = this->triangles[t];
+		if (triangle.max_y < static_cast<f32>(first_row) || triangle.min_y >= static_cast<f32>(end_row)) {
+			continue;
+		}
+
+		s32 x0 = std::max(0, static_cast<s32>(std::floor(triangle.min_x)));
+		s32 x1 = std::min(static_cast<s32>(this->width) - 1, static_cast<s32>(std::floor(triangle.max_x)));
+		s32 y0 = std::max(static_cast<s32>(first_row), static_cast<s32>(std::floor(triangle.min_y)));
+		s32 y1 = std::min(static_cast<s32>(end_row) - 1, static_cast<s32>(std::floor(triangle.max_y)));
+
+		/* edge functions a * x + b * y + c, non-negative inside a counter-clockwise triangle */
+		f32 a[3], b[3], c[3];
+		for (usize e = 0; e < 3; e++) {
+			usize next = (e + 1) % 3;
+			a[e] = triangle.y[e] - triangle.y[next];
+			b[e] = triangle.x[next] - triangle.x[e];
+			c[e] = -(a[e] * triangle.x[e] + b[e] * triangle.y[e]);
+		}
+
+		for (s32 y = y0; y <= y1; y++) {
+			f32 py = static_cast<f32>(y) + 0.5f;
+			f32* row = this->depth.data() + static_cast<usize>(y) * this->width;
+
+#ifdef VF_LANES
+			s32 first_x = x0 - x0 % OCCLUSION_ROW_ALIGNMENT;
+			alignas(32) f32 offsets[VF_LANES];
+			for (usize lane = 0; lane < VF_LANES; lane++) {
+				offsets[lane] = static_cast<f32>(lane);
+			}
+
+			vf lane_offsets = vf_load(offsets);
+			vf zero = vf_set(0.0f);
+			for (s32 x = first_x; x <= x1; x += VF_LANES) {
+				vf px = vf_add(vf_set(static_cast<f32>(x) + 0.5f), lane_offsets);
+				vf e0 = vf_add(vf_mul(vf_set(a[0]), px), vf_set(b[0] * py + c[0]));
+				vf e1 = vf_add(vf_mul(vf_set(a[1]), px), vf_set(b[1] * py + c[1]));
+				vf e2 = vf_add(vf_mul(vf_set(a[2]), px), vf_set(b[2] * py + c[2]));
+				vf outside = vf_or(vf_less(e0, zero), vf_or(vf_less(e1, zero), vf_less(e2, zero)));
+				if (vf_mask_bits(outside) == (1u << VF_LANES) - 1) {
+					continue;
+				}
+
+				vf z = vf_add(vf_mul(vf_set(triangle.dzdx), px), vf_set(triangle.z + triangle.dzdy * py));
+				vf stored = vf_loadu(row + x);
+				vf_storeu(row + x, vf_select(outside, stored, vf_min(stored, z)));
+			}
+#else
+			for (s32 x = x0; x <= x1; x++) {
+				f32 px = static_cast<f32>(x) + 0.5f;
+				if (a[0] * px + b[0] * py + c[0] < 0 || a[1] * px + b[1] * py + c[1] < 0 || a[2] * px + b[2] * py + c[2] < 0) {
+					continue;
+				}
+
+				f32 z = triangle.z + triangle.dzdx * px + triangle.dzdy * py;
+				row[x] = std::min(row[x], z);
+			}
+#endif
+		}
+	}
+}
+
+void occlusion_culler_c::build_pyramid() {
+	for (usize l = 0; l < this->pyramid.size(); l++) {
+		occlusion_pyramid_level_t& level = this->pyramid[l];
+		u32 source_width = l == 0 ? this->width : this->pyramid[l - 1].width;
+		u32 source_height = l == 0 ? this->height : this->pyramid[l - 1].height;
+		const f32* source_min = l == 0 ? this->depth.data() : this->pyramid[l - 1].min.data();
+		const f32* source_max = l == 0 ? this->depth.data() : this->pyramid[l - 1].max.data();
+
+		for (u32 y = 0; y < level.height; y++) {
+			u32 y0 = y * 2;
+			u32 y1 = std::min(y0 + 1, source_height - 1);
+			for (u32 x = 0; x < level.width; x++) {
+				u32 x0 = x * 2;
+				u32 x1 = std::min(x0 + 1, source_width - 1);
+
+				level.min[y * level.width + x] = std::min(
+					std::min(source_min[y0 * source_width + x0], source_min[y0 * source_width + x1]),
+					std::min(source_min[y1 * source_width + x0], source_min[y1 * source_width + x1]));
+				level.max[y * level.width + x] = std::max(
+					std::max(source_max[y0 * source_width + x0], source_max[y0 * source_width + x1]),
+					std::max(source_max[y1 * source_width + x0], source_max[y1 * source_width + x1]));
+			}
+		}
+	}
+}
+
+void occlusion_culler_c::render() {
+	this->setup_triangles();
+
+	if (this->pool != nullptr && this->pool->concurrency() > 1 && !this->triangles.empty()) {
+		u32 bands = std::min<u32>(this->height, static_cast<u32>(this->pool->concurrency()) * 2);
+		this->pool->parallel_for(bands, [this, bands](usize band) {
+			this->rasterize_rows(static_cast<u32>(band * this->height / bands), static_cast<u32>((band + 1) * this->height / bands));
+		});
+	} else {
+		this->rasterize_rows(0, this->height);
+	}
+
+	this->build_pyramid();
+}
+
+/* level 0 is the depth buffer itself, where min and max are the same */
+f32 occlusion_culler_c::pyramid_depth(u32 level, u32 x, u32 y, b8 max) const {
+	if (level == 0) {
+		return this->depth[static_cast<usize>(y) * this->width + x];
+	}
+
+	const occlusion_pyramid_level_t& source = this->pyramid[level - 1];
+	return (max ? source.max : source.min)[static_cast<usize>(y) * source.width + x];
+}
+
+b8 occlusion_culler_c::visible(const bounds_t& bounds) const {
+	if (bounds.radius >= BOUNDS_UNBOUNDED) {
+		return true;
+	}
+
+	f32 min_x = F32_MAX, min_y = F32_MAX, max_x = -F32_MAX, max_y = -F32_MAX, min_z = F32_MAX;
+	for (usize corner = 0; corner < 8; corner++) {
+		vec4 position = {
+			bounds.center[0] + ((corner & 1) ? bounds.extent[0] : -bounds.extent[0]),
+			bounds.center[1] + ((corner & 2) ? bounds.extent[1] : -bounds.extent[1]),
+			bounds.center[2] + ((corner & 4) ? bounds.extent[2] : -bounds.extent[2]),
+			1,
+		};
+		vec4 clip;
+		mat4x4_mul_vec4(clip, this->vp, position);
+
+		/* boxes reaching the near plane can't be placed on screen reliably */
+		if (clip[3] <= 1e-6f || clip[2] < -clip[3]) {
+			return true;
+		}
+
+		f32 inverse_w = 1.0f / clip[3];
+		min_x = std::min(min_x, clip[0] * inverse_w);
+		max_x = std::max(max_x, clip[0] * inverse_w);
+		min_y = std::min(min_y, clip[1] * inverse_w);
+		max_y = std::max(max_y, clip[1] * inverse_w);
+		min_z = std::min(min_z, clip[2] * inverse_w);
+	}
+
+	min_z = min_z * 0.5f + 0.5f;
+	f32 left = (min_x * 0.5f + 0.5f) * this->width;
+	f32 right = (max_x * 0.5f + 0.5f) * this->width;
+	f32 bottom = (min_y * 0.5f + 0.5f) * this->height;
+	f32 top = (max_y * 0.5f + 0.5f) * this->height;
+	if (right < 0 || left >= this->width || top < 0 || bottom >= this->height) {
+		return true;
+	}
+
+	u32 x0 = static_cast<u32>(std::max(0.0f, std::floor(left)));
+	u32 x1 = std::min(this->width - 1, static_cast<u32>(std::floor(right)));
+	u32 y0 = static_cast<u32>(std::max(0.0f, std::floor(bottom)));
+	u32 y1 = std::min(this->height - 1, static_cast<u32>(std::floor(top)));
+
+	/* start where the box covers at most 2x2 texels, then refine while the answer is unclear */
+	u32 level = 0;
+	u32 levels = static_cast<u32>(this->pyramid.size()) + 1;
+	while (level + 1 < levels && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+		++level;
+	}
+
+	for (;;) {
+		f32 region_max = 0;
+		f32 region_min = 1;
+		for (u32 y = y0 >> level; y <= y1 >> level; y++) {
+			for (u32 x = x0 >> level; x <= x1 >> level; x++) {
+				region_max = std::max(region_max, this->pyramid_depth(level, x, y, true));
+				region_min = std::min(region_min, this->pyramid_depth(level, x, y, false));
+			}
+		}
+
+		/* behind the farthest occluder depth anywhere in the region */
+		if (min_z > region_max) {
+			return false;
+		}
+
+		/* in front of the nearest, no finer level can hide it */
+		if (min_z <= region_min || level == 0) {
+			return true;
+		}
+
+		--level;
+		usize texels = static_cast<usize>((x1 >> level) - (x0 >> level) + 1) * ((y1 >> level) - (y0 >> level) + 1);
+		if (texels > OCCLUSION_REFINE_TEXELS) {
+			return true;
+		}
+	}
+}
+
+void occlusion_culler_c::test(const bounds_t* bounds, usize count, u8* visible) const {
+	usize batches = (count + OCCLUSION_TEST_BATCH - 1) / OCCLUSION_TEST_BATCH;
+	auto job = [this, bounds, count, visible](usize batch) {
+		usize end = std::min(count, (batch + 1) * OCCLUSION_TEST_BATCH);
+		for (usize i = batch * OCCLUSION_TEST_BATCH; i < end; i++) {
+			visible[i] = this->visible(bounds[i]) ? 1 : 0;
+		}
+	};
+
+	if (this->pool != nullptr && batches > 1) {
+		this->pool->parallel_for(batches, job);
+	} else {
+		for (usize batch = 0; batch < batches; batch++) {
+			job(batch);
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+
+#include "types.hpp"
+#include "frustum.hpp"
+#include "worker_pool.hpp"
+#include <linmath.h>
+#include <vector>
+
+#define OCCLUSION_NONE U32_MAX
+/* depth buffer size, widths are kept a multiple of 8 so rows never need a scalar tail */
+#define OCCLUSION_WIDTH_DEFAULT 256
+#define OCCLUSION_HEIGHT_DEFAULT 128
+
+/* cpu copy of an occluder's triangles, positions are xyz */
+struct occlusion_model_t {
+	std::vector<f32> positions;
+	std::vector<u32> indices;
+};
+
+struct occlusion_pyramid_level_t {
+	u32 width;
+	u32 height;
+	std::vector<f32> min;
+	std::vector<f32> max;
+};
+
+/* rasterizes occluder triangles into a small depth buffer and tests boxes against a min-max pyramid of it.
+ * depth is window depth in [0, 1], nearer is smaller. no gl, so it can run anywhere */
+struct occlusion_culler_c {
+	u32 width;
+	u32 height;
+	std::vector<f32> depth;
+	/* level 0 is half the depth buffer's size */
+	std::vector<occlusion_pyramid_level_t> pyramid;
+	/* rasterization and tests spread over the pool's threads when there is one */
+	worker_pool_c* pool;
+
+	occlusion_culler_c(u32 width = OCCLUSION_WIDTH_DEFAULT, u32 height = OCCLUSION_HEIGHT_DEFAULT, worker_pool_c* pool = nullptr);
+
+	/* indices are triangles, returns the model's id */
+	u32 add_model(const f32* positions, usize vertex_count, const u32* indices, usize index_count);
+	void remove_model(u32 model);
+
+	/* clears the depth buffer and the occluder list */
+	void begin(const mat4x4 vp);
+	void add_occluder(u32 model, const f32 model_matrix[16]);
+	/* rasterizes the occluders added since begin() and builds the pyramid */
+	void render();
+
+	/* false only when the box is certainly behind the occluders */
+	b8 visible(const bounds_t& bounds) const;
+	void test(const bounds_t* bounds, usize count, u8* visible) const;
+
+private:
+	struct occluder_t {
+		u32 model;
+		mat4x4 mvp;
+	};
+
+	/* window space, counter-clockwise, with the depth plane solved at setup */
+	struct triangle_t {
+		f32 x[3];
+		f32 y[3];
+		f32 z;
+		f32 dzdx;
+		f32 dzdy;
+		f32 min_x, max_x, min_y, max_y;
+	};
+
+	mat4x4 vp;
+	std::vector<occlusion_model_t> models;
+	std::vector<u32> free_models;
+	std::vector<occluder_t> occluders;
+	std::vector<triangle_t> triangles;
+
+	void setup_triangles();
+	void rasterize_rows(u32 first_row, u32 end_row);
+	void build_pyramid();
+	f32 pyramid_depth(u32 level, u32 x, u32 y, b8 max) const;
+};
+
+#endif
@@ -0,0 +1,144 @@
+#include "offset_allocator.hpp"
+#include <stdexcept>
+
+offset_allocator_c::offset_allocator_c(u32 capacity) {
+	this->capacity = capacity;
+	this->used = 0;
+
+	if (capacity > 0) {
+		this->insert_range(0, capacity);
+	}
+}
+
+void offset_allocator_c::insert_range(u32 offset, u32 size) {
+	this->free_by_offset.emplace(offset, size);
+	this->free_by_size.emplace(size, offset);
+}
+
+void offset_allocator_c::erase_range(u32 offset, u32 size) {
+	this->free_by_offset.erase(offset);
+
+	auto range = this->free_by_size.equal_range(size);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == offset) {
+			this->free_by_size.erase(it);
+			return;
+		}
+	}
+}
+
+u32 offset_allocator_c::take(std::multimap<u32, u32>::iterator it, u32 size) {
+	u32 range_size = it->first;
+	u32 offset = it->second;
+	this->erase_range(offset, range_size);
+
+	if (range_size > size) {
+		this->insert_range(offset + size, range_size - size);
+	}
+
+	this->used += size;
+	return offset;
+}
+
+u32 offset_allocator_c::allocate(u32 size) {
+	if (size == 0) {
+		return OFFSET_ALLOCATOR_INVALID;
+	}
+
+	auto it = this->free_by_size.lower_bound(size);
+	if (it == this->free_by_size.end()) {
+		return OFFSET_ALLOCATOR_INVALID;
+	}
+
+	return this->take(it, size);
+}
+
+u32 offset_allocator_c::allocate_below(u32 size, u32 limit) {
+	if (size == 0) {
+		return OFFSET_ALLOCATOR_INVALID;
+	}
+
+	for (auto it = this->free_by_size.lower_bound(size); it != this->free_by_size.end(); ++it) {
+		if (it->second + size <= limit) {
+			return this->take(it, size);
+		}
+	}
+
+	return OFFSET_ALLOCATOR_INVALID;
+}
+
+void offset_allocator_c::free(u32 offset, u32 size) {
+	if (size == 0) {
+		return;
+	}
+
+	if (offset + size > this->capacity || size > this->used) {
+		throw std::runtime_error("Offset allocator free out of range");
+	}
+
+	this->used -= size;
+
+	auto next = this->free_by_offset.lower_bound(offset);
+	if (next != this->free_by_offset.end() && next->first == offset + size) {
+		u32 next_size = next->second;
+		this->erase_range(next->first, next_size);
+		size += next_size;
+	}
+
+	auto next_after = this->free_by_offset.lower_bound(offset);
+	if (next_after != this->free_by_offset.begin()) {
+		auto prev = std::prev(next_after);
+		if (prev->first + prev->second == offset) {
+			u32 prev_offset = prev->first;
+			u32 prev_size = prev->second;
+			this->erase_range(prev_offset, prev_size);
+			offset = prev_offset;
+			size += prev_size;
+		}
+	}
+
+	this->insert_range(offset, size);
+}
+
+void offset_allocator_c::grow(u32 new_capacity) {
+	if (new_capacity <= this->capacity) {
+		return;
+	}
+
+	u32 old_capacity = this->capacity;
+	this->capacity = new_capacity;
+
+	/* the added tail is handed to free() as if it had been allocated, so it coalesces */
+	this->used += new_capacity - old_capacity;
+	this->free(old_capacity, new_capacity - old_capacity);
+}
+
+u32 offset_allocator_c::high_water() const {
+	if (this->free_by_offset.empty()) {
+		return this->capacity;
+	}
+
+	auto last = std::prev(this->free_by_offset.end());
+	if (last->first + last->second == this->capacity) {
+		return last->first;
+	}
+
+	return this->capacity;
+}
+
+offset_allocator_stats_t offset_allocator_c::stats() const {
+	offset_allocator_stats_t stats = {
+		.capacity = this->capacity,
+		.used = this->used,
+		.free = this->capacity - this->used,
+		.free_ranges = static_cast<u32>(this->free_by_offset.size()),
+		.largest_free = this->free_by_size.empty() ? 0 : std::prev(this->free_by_size.end())->first,
+		.fragmentation = 0,
+	};
+
+	if (stats.free > 0) {
+		stats.fragmentation = 1.0f - static_cast<f32>(stats.largest_free) / static_cast<f32>(stats.free);
+	}
+
+	return stats;
+}
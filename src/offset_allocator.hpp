@@ -0,0 +1,44 @@
+#ifndef OFFSET_ALLOCATOR_HPP
+#define OFFSET_ALLOCATOR_HPP
+
+#include "types.hpp"
+#include <map>
+
+#define OFFSET_ALLOCATOR_INVALID U32_MAX
+
+struct offset_allocator_stats_t {
+	u32 capacity;
+	u32 used;
+	u32 free;
+	u32 free_ranges;
+	u32 largest_free;
+	/* 0 when all free space is one range, approaches 1 as it splinters */
+	f32 fragmentation;
+};
+
+/* best-fit sub-allocator over an abstract [0, capacity) range, frees coalesce with their neighbours */
+struct offset_allocator_c {
+	u32 capacity;
+	u32 used;
+	std::map<u32, u32> free_by_offset;
+	std::multimap<u32, u32> free_by_size;
+
+	offset_allocator_c(u32 capacity);
+
+	u32 allocate(u32 size);
+	/* best-fit restricted to ranges ending at or below limit */
+	u32 allocate_below(u32 size, u32 limit);
+	void free(u32 offset, u32 size);
+	void grow(u32 new_capacity);
+
+	/* end of the highest allocation, everything above is free */
+	u32 high_water() const;
+	offset_allocator_stats_t stats() const;
+
+private:
+	void insert_range(u32 offset, u32 size);
+	void erase_range(u32 offset, u32 size);
+	u32 take(std::multimap<u32, u32>::iterator it, u32 size);
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "profiler.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+static_assert((PROFILER_THREAD_CAPACITY & (PROFILER_THREAD_CAPACITY - 1)) == 0, "PROFILER_THREAD_CAPACITY has to be a power of two");
+
+/* fields are relaxed atomics so a trace can read a slot while its thread rewrites it, head tells which reads to keep */
+struct profiler_zone_t {
+	std::atomic<const char*> name;
+	std::atomic<u64> begin;
+	std::atomic<u64> end;
+};
+
+/* one per thread that recorded, only that thread writes it. they are never freed, so threads that exited still show up */
+struct profiler_thread_t {
+	profiler_zone_t zones[PROFILER_THREAD_CAPACITY];
+	/* zones written so far, the slot of zone i is i % capacity */
+	std::atomic<u64> head;
+	std::atomic<const char*> name;
+	u32 id;
+	profiler_thread_t* next;
+};
+
+static std::atomic<profiler_thread_t*> profiler_threads(nullptr);
+static std::atomic<u32> profiler_thread_ids(0);
+static thread_local profiler_thread_t* profiler_current = nullptr;
+
+static std::chrono::steady_clock::time_point profiler_epoch() {
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	return epoch;
+}
+
+/* pushed onto the front of the list, the list is only ever walked and never shrinks */
+static profiler_thread_t* profiler_thread() {
+	if (profiler_current != nullptr) {
+		return profiler_current;
+	}
+
+	profiler_thread_t* thread = new profiler_thread_t();
+	thread->head.store(0, std::memory_order_relaxed);
+	thread->name.store(nullptr, std::memory_order_relaxed);
+	thread->id = profiler_thread_ids.fetch_add(1, std::memory_order_relaxed) + 1;
+	thread->next = profiler_threads.load(std::memory_order_relaxed);
+	while (!profiler_threads.compare_exchange_weak(thread->next, thread, std::memory_order_release, std::memory_order_relaxed)) {
+	}
+
+	profiler_current = thread;
+	return thread;
+}
+
+u64 profiler_now() {
+	return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler_epoch()).count());
+}
+
+void profiler_record(const char* name, u64 begin, u64 end) {
+	profiler_thread_t* thread = profiler_thread();
+	u64 head = thread->head.load(std::memory_order_relaxed);
+	profiler_zone_t& zone = thread->zones[head & (PROFILER_THREAD_CAPACITY - 1)];
+	/* pairs with the fence in profiler_write_trace, a trace that sees any of these stores sees the head from before them */
+	std::atomic_thread_fence(std::memory_order_release);
+	zone.name.store(name, std::memory_order_relaxed);
+	zone.begin.store(begin, std::memory_order_relaxed);
+	zone.end.store(end, std::memory_order_relaxed);
+	thread->head.store(head + 1, std::memory_order_release);
+}
+
+void profiler_set_thread_name(const char* name) {
+	profiler_thread()->name.store(name, std::memory_order_relaxed);
+}
+
+/* zone and thread names are plain identifiers in practice, but quotes and control characters would break the json */
+static void profiler_write_string(std::FILE* file, const char* text) {
+	std::fputc('"', file);
+	for (; *text != '\0'; ++text) {
+		unsigned char c = static_cast<unsigned char>(*text);
+		if (c == '"' || c == '\\') {
+			std::fputc('\\', file);
+			std::fputc(c, file);
+		} else if (c < 0x20) {
+			std::fprintf(file, "\\u%04x", c);
+		} else {
+			std::fputc(c, file);
+		}
+	}
+	std::fputc('"', file);
+}
+
+b8 profiler_write_trace(const char* path) {
+	std::FILE* file = std::fopen(path, "w");
+	if (file == nullptr) {
+		return false;
+	}
+
+	/* timestamps are microseconds in the format, three decimals keep the nanoseconds */
+	std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	b8 first = true;
+	for (profiler_thread_t* thread = profiler_threads.load(std::memory_order_acquire); thread != nullptr; thread = thread->next) {
+		const char* name = thread->name.load(std::memory_order_relaxed);
+		if (name != nullptr) {
+			std::fprintf(file, "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",", thread->id);
+			profiler_write_string(file, name);
+			std::fprintf(file, "}}");
+			first = false;
+		}
+
+		u64 head = thread->head.load(std::memory_order_acquire);
+		u64 oldest = (head > PROFILER_THREAD_CAPACITY) ? head - PROFILER_THREAD_CAPACITY : 0;
+		for (u64 i = oldest; i < head; i++) {
+			const profiler_zone_t& zone = thread->zones[i & (PROFILER_THREAD_CAPACITY - 1)];
+			const char* zone_name = zone.name.load(std::memory_order_relaxed);
+			u64 begin = zone.begin.load(std::memory_order_relaxed);
+			u64 end = zone.end.load(std::memory_order_relaxed);
+
+			/* the thread kept recording while this was read, a slot it came back around to may hold a mix of two zones */
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (thread->head.load(std::memory_order_relaxed) >= i + PROFILER_THREAD_CAPACITY) {
+				continue;
+			}
+
+			std::fprintf(file, "%s\n{\"ph\":\"X\",\"name\":", first ? "" : ",");
+			profiler_write_string(file, zone_name);
+			std::fprintf(file, ",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03llu,\"dur\":%llu.%03llu}", thread->id,
+				static_cast<unsigned long long>(begin / 1000), static_cast<unsigned long long>(begin % 1000),
+				static_cast<unsigned long long>((end - begin) / 1000), static_cast<unsigned long long>((end - begin) % 1000));
+			first = false;
+		}
+	}
+
+	std::fprintf(file, "\n]}\n");
+	return std::fclose(file) == 0;
+}
+
+u64 profiler_zone_count() {
+	u64 count = 0;
+	for (profiler_thread_t* thread = profiler_threads.load(std::memory_order_acquire); thread != nullptr; thread = thread->next) {
+		count += thread->head.load(std::memory_order_acquire);
+	}
+
+	return count;
+}
@@ -0,0 +1,43 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "types.hpp"
+
+/* zones each thread keeps, a power of two. older zones are overwritten, so a trace holds each thread's latest ones */
+#define PROFILER_THREAD_CAPACITY 16384
+
+/* nanoseconds on a steady clock since the profiler's first use */
+u64 profiler_now();
+/* name is kept by pointer and read by whoever writes a trace, so it has to be a literal or live as long */
+void profiler_record(const char* name, u64 begin, u64 end);
+/* shown for the calling thread in traces, same lifetime rule as zone names */
+void profiler_set_thread_name(const char* name);
+/* chrome trace_event json of every thread's recorded zones, opens in chrome://tracing and perfetto.
+ * safe to call while other threads record, zones they overwrite during the write are left out. false when the file can't be written */
+b8 profiler_write_trace(const char* path);
+/* zones recorded by every thread so far, overwritten ones included */
+u64 profiler_zone_count();
+
+/* times its own lifetime. zones are recorded when they end, so a zone still open when a trace is written is missing from it */
+struct profiler_zone_c {
+	explicit profiler_zone_c(const char* name) : name(name), begin(profiler_now()) {}
+	~profiler_zone_c() { profiler_record(this->name, this->begin, profiler_now()); }
+	profiler_zone_c(const profiler_zone_c&) = delete;
+	profiler_zone_c& operator=(const profiler_zone_c&) = delete;
+
+private:
+	const char* name;
+	u64 begin;
+};
+
+#define PROFILER_CONCAT_INNER(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_INNER(a, b)
+
+/* times the rest of the enclosing scope. build with -DPROFILER_DISABLED to compile zones out, traces are empty then */
+#ifndef PROFILER_DISABLED
+#define PROFILE_ZONE(name) profiler_zone_c PROFILER_CONCAT(profiler_zone_, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name) ((void) 0)
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+#include "radix_sort.hpp"
+
+#define RADIX_SORT_DIGIT_BITS 8
+#define RADIX_SORT_BUCKETS (1 << RADIX_SORT_DIGIT_BITS)
+#define RADIX_SORT_DIGITS (64 / RADIX_SORT_DIGIT_BITS)
+
+void radix_sort(std::vector<u64>& keys, std::vector<u32>& values, std::vector<u64>& key_scratch, std::vector<u32>& value_scratch) {
+	usize count = keys.size();
+	if (count < 2) {
+		return;
+	}
+
+	key_scratch.resize(count);
+	value_scratch.resize(count);
+
+	/* every digit's histogram in one read of the keys */
+	u32 histograms[RADIX_SORT_DIGITS][RADIX_SORT_BUCKETS] = {};
+	for (usize i = 0; i < count; i++) {
+		u64 key = keys[i];
+		for (u32 digit = 0; digit < RADIX_SORT_DIGITS; digit++) {
+			++histograms[digit][(key >> (digit * RADIX_SORT_DIGIT_BITS)) & (RADIX_SORT_BUCKETS - 1)];
+		}
+	}
+
+	for (u32 digit = 0; digit < RADIX_SORT_DIGITS; digit++) {
+		u32 shift = digit * RADIX_SORT_DIGIT_BITS;
+		u32* histogram = histograms[digit];
+
+		/* a digit all keys share would scatter them back into the same order */
+		if (histogram[(keys[0] >> shift) & (RADIX_SORT_BUCKETS - 1)] == count) {
+			continue;
+		}
+
+		u32 offset = 0;
+		for (u32 bucket = 0; bucket < RADIX_SORT_BUCKETS; bucket++) {
+			u32 bucket_count = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucket_count;
+		}
+
+		for (usize i = 0; i < count; i++) {
+			u32 destination = histogram[(keys[i] >> shift) & (RADIX_SORT_BUCKETS - 1)]++;
+			key_scratch[destination] = keys[i];
+			value_scratch[destination] = values[i];
+		}
+
+		keys.swap(key_scratch);
+		values.swap(value_scratch);
+	}
+}
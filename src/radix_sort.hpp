@@ -0,0 +1,12 @@
+#ifndef RADIX_SORT_HPP
+#define RADIX_SORT_HPP
+
+#include "types.hpp"
+#include <vector>
+
+/* stable ascending sort of keys that carries values along, least significant byte first.
+ * bytes every key shares are skipped, the sorted data may end up in what were the scratch vectors' buffers.
+ * at most U32_MAX keys */
+void radix_sort(std::vector<u64>& keys, std::vector<u32>& values, std::vector<u64>& key_scratch, std::vector<u32>& value_scratch);
+
+#endif
@@ -1,50 +1,300 @@
 #define _USE_MATH_DEFINES
 #include "renderer.hpp"
+#include "transform_store.hpp"
+#include "frustum.hpp"
+#include "bvh.hpp"
+#include "occlusion.hpp"
+#include "worker_pool.hpp"
+#include "radix_sort.hpp"
+#include "gl_state.hpp"
+#include "allocation_counter.hpp"
+#include "log.hpp"
+#include "light_clusters.hpp"
+#include "shadow_atlas.hpp"
+#include "resolution_controller.hpp"
+#include "profiler.hpp"
 #include <glad/glad.h>
 #include <linmath.h>
-#include <iostream>
 #include <fstream>
 #include <exception>
 #include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <map>
 
-struct mesh_internal_t {
-	mesh_t* mesh;
+#define GEOMETRY_NONE U32_MAX
+
+/* uploaded vertex/index ranges, shared by every mesh that references them */
+struct geometry_internal_t {
+	shader_t shader;
 	u32 vindex;
 	u32 vcount;
 	u32 iindex;
 	u32 icount;
+	u32 references;
+	u64 hash;
+	/* object space, from the vertex positions at upload */
+	bounds_t bounds;
+};
+
+struct mesh_internal_t {
+	mesh_t* mesh;
+	u32 geometry;
+	/* occlusion culler model of an occluder mesh, OCCLUSION_NONE otherwise */
+	u32 occluder_model;
+	b8 is_static;
+};
+
+/* what one record is drawn with, filled while its key is built so batching never goes back to the meshes */
+struct draw_item_t {
+	u32 mesh;
+	u32 shader;
+	u32 texture_set;
+	u32 geometry;
+};
+
+/* records with the same geometry (and textures, for passes that bind them), drawn as one instanced draw.
+ * carries everything the pass loops need so they never touch meshes, shaders or geometry */
+struct draw_batch_t {
+	u32 shader;
+	u32 texture_set;
+	u32 geometry;
+	u32 vertex_array;
+	u32 icount;
+	u32 iindex;
+	u32 vindex;
+	u32 first;
+	u32 count;
+};
+
+/* a material's textures as a range of texture_set_names, in attachment order */
+struct texture_set_t {
+	u32 first;
+	u32 count;
 };
 
 struct light_internal_t {
 	light_t* light;
 };
 
+/* indexed by mesh id, matrices are only rebuilt for meshes whose transform differs from the cached copy,
+ * which catches transforms written directly through mesh_t without needing a dirty flag.
+ * changing a mesh's geometry clears valid so its world bounds follow */
+struct transform_cache_t {
+	std::vector<transform_t> transforms;
+	std::vector<transform_matrices_t> matrices;
+	/* world space, refreshed with the matrices */
+	std::vector<bounds_t> bounds;
+	std::vector<u8> valid;
+	/* every mesh with bounds has a leaf, payloads are mesh ids */
+	bvh_c bvh;
+	std::vector<u32> proxies;
+	/* leaves were inserted or removed since the last frame. flattening the bvh again costs tens of linear culls, so that
+	 * frame's passes cull linearly over drawn, the same bounds in draw order, and the next frame flattens it */
+	b8 reshaped;
+	b8 linear;
+	bounds_store_c drawn;
+	/* this frame's moved transforms packed for batch composition, dirty holds their mesh ids */
+	transform_store_c moved;
+	std::vector<u32> dirty;
+	usize updated;
+};
+
+/* per-frame light table, built once in draw() and read by the shadow depth pass, one entry per light with an atlas tile */
+struct light_frame_t {
+	mat4x4 vp;
+	frustum_t frustum;
+	/* index into the renderer's lights */
+	u32 light;
+	shadow_tile_t tile;
+	/* the static atlas still holds this light's static casters, so its records are dynamic casters only */
+	b8 cached;
+	/* this light's range of shadow_visible and light_batches, static casters first */
+	u32 first_visible;
+	u32 visible_count;
+	u32 static_count;
+	u32 first_batch;
+	u32 static_batches;
+	u32 batch_count;
+};
+
 struct texture_internal_t {
 	u32 gl;
 };
 
+/* no position target, the light pass rebuilds positions from depth */
 struct gbuffer_t {
 	u32 framebuffer;
-	u32 geometry;
 	u32 normal;
 	u32 albedo_specular;
 	u32 depth;
-	u32 shadows;
 	shader_t light_pass;
 	u32 quad_vbo;
+	/* the light pass' result when rendering below the framebuffer's resolution, upscaled to the default framebuffer */
+	u32 output_framebuffer;
+	u32 output;
+	gbuffer_layout layout;
+	/* allocated size, the passes render into the bottom left scale * framebuffer size of it */
+	u32 width;
+	u32 height;
+};
+
+/* texture formats of one g-buffer layout's color targets */
+struct gbuffer_formats_t {
+	u32 internal_format;
+	u32 format;
+	u32 type;
+};
+
+/* texture buffer refilled every frame, its storage is orphaned before each fill so the gpu keeps reading last frame's */
+struct stream_texture_buffer_t {
+	u32 buffer;
+	u32 texture;
+	u32 format;
+	u32 texel_size;
+	usize capacity;
 };
 
+/* two RGBA32F texels per light for the light pass */
+struct light_data_t {
+	vec4 position_radius;
+	/* color times intensity, w is the light's entry in the shadow data or -1 without a tile */
+	vec4 color_shadow;
+};
+
+/* every light binned into the camera's clusters, rebuilt each frame */
+struct light_grid_t {
+	bounds_store_c bounds;
+	light_clusters_c clusters;
+	std::vector<light_data_t> data;
+	stream_texture_buffer_t lights;
+	stream_texture_buffer_t offsets;
+	stream_texture_buffer_t indices;
+};
+
+/* five RGBA32F texels per light with an atlas tile for the light pass */
+struct shadow_data_t {
+	mat4x4 vp;
+	/* tile origin and size in atlas uv, w is half a texel to keep filtering inside the tile */
+	vec4 tile;
+};
+
+/* static caster depth a light last rendered into its tile of the static atlas */
+struct shadow_cache_t {
+	b8 valid;
+	shadow_tile_t tile;
+	mat4x4 vp;
+};
+
+/* every shadow casting light renders into its own tile of one depth texture, sized by how much of the screen it lights.
+ * static casters go into the same tile of a second atlas that is kept across frames, each frame a tile starts as a copy
+ * of its static depth and only the dynamic casters are drawn over it */
 struct shadow_map_t {
 	u32 framebuffer;
 	u32 texture;
-	u32 width;
-	u32 height;
+	u32 static_framebuffer;
+	u32 static_texture;
 	shader_t depth_shader;
-	shader_t shadow_composite;
+	shadow_atlas_c atlas;
+	/* this frame's casting lights in view, their requested tile sizes and the tiles they got */
+	std::vector<u32> casters;
+	std::vector<u32> sizes;
+	std::vector<shadow_tile_t> tiles;
+	/* caster positions by requested size, only used when there are more casters than the sort key has views for */
+	std::vector<u32> priority;
+	/* set once the caster cap was hit, it is logged the first time only */
+	b8 capped;
+	std::vector<shadow_data_t> data;
+	stream_texture_buffer_t stream;
+	/* per light, indexed like the renderer's lights */
+	std::vector<shadow_cache_t> caches;
+	/* world bounds static meshes left or entered since the last draw(), lights seeing any of them re-render their static depth */
+	std::vector<bounds_t> changes;
+	shadow_stats_t stats;
 };
 
 #define SHADER_VERTEX_PREALLOCATION_DEFAULT 1024
 #define SHADER_INDEX_PREALLOCATION_DEFAULT 1024
+#define SHADER_BUFFER_GROWTH_FACTOR 2
+
+#define FRAME_DATA_BINDING 0
+#define DRAW_DATA_TEXTURE_UNIT 15
+#define DRAW_DATA_RING_FRAMES 3
+#define DRAW_DATA_RECORDS_DEFAULT 256
+#define DRAW_RECORD_ATTRIBUTE 15
+/* after the g-buffer textures and the shadow atlas of the light pass */
+#define SHADOW_ATLAS_TEXTURE_UNIT 3
+#define LIGHT_DATA_TEXTURE_UNIT 4
+#define CLUSTER_OFFSETS_TEXTURE_UNIT 5
+#define CLUSTER_LIGHTS_TEXTURE_UNIT 6
+#define SHADOW_DATA_TEXTURE_UNIT 7
+#define STREAM_TEXTURE_BUFFER_CAPACITY_DEFAULT 256
+
+/* a light's reach is where intensity / distance^2 drops to this, the light pass fades it out towards there */
+#define LIGHT_ATTENUATION_CUTOFF 0.05f
+
+/* draw sort key fields, most significant first. the view and caster kind are exact so each view's records come out contiguous,
+ * the others only order draws and may alias once ids outgrow their bits, batching still compares the real values */
+#define DRAW_KEY_VIEW_BITS 12
+/* a light's static casters sort ahead of its dynamic ones, the camera's records are all 0 here */
+#define DRAW_KEY_CASTER_BITS 1
+#define DRAW_KEY_SHADER_BITS 8
+#define DRAW_KEY_TEXTURES_BITS 12
+#define DRAW_KEY_GEOMETRY_BITS 16
+#define DRAW_KEY_DEPTH_BITS 15
+/* view depth is stored as log2(1 + depth) over this range, so near draws get the finer steps */
+#define DRAW_KEY_DEPTH_LOG2_RANGE 16.0f
+/* every shadowed light takes one view after the camera's */
+#define DRAW_KEY_SHADOW_LIGHTS_MAX ((1u << DRAW_KEY_VIEW_BITS) - 1)
+
+/* gl 4.3 / ARB_multi_draw_indirect, not part of the 4.1 core loader so it is fetched at runtime */
+typedef void (APIENTRYP PFN_GL_MULTI_DRAW_ELEMENTS_INDIRECT)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+
+struct draw_elements_indirect_command_t {
+	u32 count;
+	u32 instance_count;
+	u32 first_index;
+	s32 base_vertex;
+	u32 base_instance;
+};
+
+/* std140 layout of the frame_data uniform block */
+struct frame_data_t {
+	mat4x4 vp;
+	vec4 view_pos;
+	f32 time;
+	f32 padding[3];
+	mat4x4 inverse_vp;
+};
+
+/* one record per mesh per frame, read by the shaders as 9 RGBA32F texels */
+struct draw_data_t {
+	mat4x4 model;
+	mat4x4 model_rotation;
+	vec4 material_color;
+};
+
+/* texture buffer split into DRAW_DATA_RING_FRAMES segments, each frame writes the next segment once
+ * (unsynchronized map guarded by a fence, gl 4.1 has no persistent mapping) */
+struct draw_data_ring_t {
+	u32 buffer;
+	u32 texture;
+	/* 0..n, fed to DRAW_RECORD_ATTRIBUTE with divisor 1 so base_instance can select the record */
+	u32 record_ids;
+	u32 capacity;
+	u32 frame;
+	u32 base;
+	GLsync fences[DRAW_DATA_RING_FRAMES];
+};
+
+/* resolved once at create_shader time so draws never query locations */
+struct shader_uniform_location_t {
+	uniform_id_t id;
+	GLint location;
+	shader_data_type type;
+	u32 size;
+};
 
 struct shader_internal_t {
 	shader_t shader;
@@ -53,23 +303,91 @@ struct shader_internal_t {
 	GLuint vao;
 	GLuint vbo;
 	GLuint ibo;
-	u32 vbuffer_size;
-	u32 ibuffer_size;
 	u32 vbuffer_capacity;
 	u32 ibuffer_capacity;
+	offset_allocator_c vallocator;
+	offset_allocator_c iallocator;
+	/* live geometry ids by their offset in each buffer, kept up to date with the allocators so compaction walks them as they are */
+	std::map<u32, u32> vertex_geometries;
+	std::map<u32, u32> index_geometries;
+	/* compaction's last full walk of the buffer moved nothing, it is skipped until an upload or release changes the buffer */
+	b8 vertices_packed;
+	b8 indices_packed;
 
 	std::vector<shader_input_t> inputs;
 	std::vector<shader_uniform_t> uniforms;
 	std::vector<shader_texture_attachment_t> texture_attachments;
+	std::vector<shader_uniform_location_t> uniform_locations;
+	std::vector<uniform_id_t> texture_attachment_ids;
 };
 
 struct renderer_internal_t {
 	std::vector<mesh_internal_t> meshes;
+	std::vector<geometry_internal_t> geometries;
 	std::vector<shader_internal_t> shaders;
 	std::vector<texture_internal_t> textures;
 	std::vector<light_internal_t> lights;
+	std::vector<u32> free_mesh_ids;
+	std::vector<u32> free_geometry_ids;
+	std::unordered_multimap<u64, u32> geometry_lookup;
+	/* by geometry id, the vertex bytes and then the index bytes it was uploaded with. a hash match is compared against
+	 * these, which keeps a second copy of every geometry on the cpu but never reads back from a buffer the gpu may be using */
+	std::vector<std::vector<u8>> geometry_bytes;
+	usize compaction_budget;
+
+	/* rebuilt every frame, kept here so their storage is reused */
+	std::vector<u32> draw_order;
+	/* one item and key per record of every view, draw_sorted holds item indices radix sorted into record order */
+	std::vector<draw_item_t> draw_items;
+	std::vector<u64> draw_keys;
+	std::vector<u32> draw_sorted;
+	std::vector<u64> draw_key_scratch;
+	std::vector<u32> draw_sorted_scratch;
+	std::vector<draw_batch_t> batches;
+	std::vector<draw_batch_t> light_batches;
+	/* mesh ids that survived culling, the camera's and every light's back to back */
+	std::vector<u32> visible;
+	std::vector<u32> shadow_visible;
+	std::vector<u32> bvh_results;
+	/* indices of the lights reaching into the view */
+	std::vector<u32> lights_visible;
+
+	worker_pool_c workers;
+	occlusion_culler_c occlusion;
+	b8 occlusion_culling;
+	/* mesh ids rasterized into the occlusion buffer */
+	std::vector<u32> occluders;
+	std::vector<bounds_t> occlusion_bounds;
+	std::vector<u8> occlusion_results;
+	b8 frustum_culling;
+	cull_stats_t cull_stats;
+	/* material texture lists interned to the ids in the draw keys, never released as sets are few */
+	std::map<std::vector<texture_t>, u32> texture_sets;
+	std::vector<texture_set_t> texture_set_table;
+	std::vector<GLuint> texture_set_names;
+	gl_state_c gl;
+	u32 draw_calls;
+	u64 draw_allocations;
+	std::vector<draw_elements_indirect_command_t> indirect_commands;
+	std::vector<light_frame_t> light_table;
+	transform_cache_t transform_cache;
+
+	PFN_GL_MULTI_DRAW_ELEMENTS_INDIRECT multi_draw_elements_indirect;
+	b8 use_multi_draw_indirect;
+	u32 indirect_buffer;
+
 	gbuffer_t gbuffer;
+	/* last framebuffer size glfw reported in pixels, the render targets follow it lazily in draw() */
+	u32 framebuffer_width;
+	u32 framebuffer_height;
+	GLFWframebuffersizefun previous_framebuffer_size_callback;
+	gpu_timer_c gpu_timer;
+	resolution_controller_c resolution;
+	b8 dynamic_resolution;
+	light_grid_t light_grid;
 	shadow_map_t shadow_map;
+	u32 frame_ubo;
+	draw_data_ring_t draw_data;
 };
 
 inline const GLenum shader_data_type_to_gl(shader_data_type type) {
@@ -160,229 +478,994 @@ inline const GLenum texture_wrap_to_gl(texture_wrap filter) {
 	}
 }
 
-static b8 internal_shader_uniform_exists(const shader_internal_t & shader, const std::string & name);
+static constexpr uniform_id_t UNIFORM_DRAW_DATA = uniform_id("unif_draw_data");
+static constexpr uniform_id_t UNIFORM_DRAW_INDEX = uniform_id("unif_draw_index");
+static constexpr uniform_id_t UNIFORM_LIGHT_VP = uniform_id("unif_light_vp");
+static constexpr uniform_id_t UNIFORM_SHADOW_ATLAS = uniform_id("unif_shadow_atlas");
+static constexpr uniform_id_t UNIFORM_SHADOW_DATA = uniform_id("unif_shadow_data");
+static constexpr uniform_id_t UNIFORM_SCREEN = uniform_id("unif_screen");
+static constexpr uniform_id_t UNIFORM_GBUFFER_DEPTH = uniform_id("unif_gbuffer_depth");
+static constexpr uniform_id_t UNIFORM_GBUFFER_NORMAL = uniform_id("unif_gbuffer_normal");
+static constexpr uniform_id_t UNIFORM_GBUFFER_ALBEDO_SPECULAR = uniform_id("unif_gbuffer_albedo_specular");
+static constexpr uniform_id_t UNIFORM_LIGHT_DATA = uniform_id("unif_light_data");
+static constexpr uniform_id_t UNIFORM_CLUSTER_OFFSETS = uniform_id("unif_cluster_offsets");
+static constexpr uniform_id_t UNIFORM_CLUSTER_LIGHTS = uniform_id("unif_cluster_lights");
+static constexpr uniform_id_t UNIFORM_CLUSTER_GRID = uniform_id("unif_cluster_grid");
+static constexpr uniform_id_t UNIFORM_CLUSTER_DEPTH = uniform_id("unif_cluster_depth");
+
+static b8 gl_uniform_type_to_shader(GLenum gl_type, shader_data_type& type, u32& components) {
+	switch (gl_type) {
+	case GL_FLOAT: type = shader_data_type::F32; components = 1; return true;
+	case GL_FLOAT_VEC2: type = shader_data_type::F32; components = 2; return true;
+	case GL_FLOAT_VEC3: type = shader_data_type::F32; components = 3; return true;
+	case GL_FLOAT_VEC4: type = shader_data_type::F32; components = 4; return true;
+	case GL_BOOL:
+	case GL_INT: type = shader_data_type::S32; components = 1; return true;
+	case GL_INT_VEC2: type = shader_data_type::S32; components = 2; return true;
+	case GL_INT_VEC3: type = shader_data_type::S32; components = 3; return true;
+	case GL_INT_VEC4: type = shader_data_type::S32; components = 4; return true;
+	case GL_UNSIGNED_INT: type = shader_data_type::U32; components = 1; return true;
+	case GL_UNSIGNED_INT_VEC2: type = shader_data_type::U32; components = 2; return true;
+	case GL_UNSIGNED_INT_VEC3: type = shader_data_type::U32; components = 3; return true;
+	case GL_UNSIGNED_INT_VEC4: type = shader_data_type::U32; components = 4; return true;
+	case GL_FLOAT_MAT4: type = shader_data_type::MAT4x4; components = 1; return true;
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_BUFFER:
+	case GL_INT_SAMPLER_BUFFER:
+	case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+	case GL_SAMPLER_CUBE: type = shader_data_type::TEXTURE; components = 1; return true;
+	default:
+		return false;
+	}
+}
 
-renderer_c::renderer_c(GLFWwindow* window, camera_c& camera) : camera(camera) {
-	this->window = window;
-	glfwMakeContextCurrent(window);
-	if (gladLoadGLLoader((GLADloadproc) glfwGetProcAddress) == 0) {
-		throw std::runtime_error("Failed to initialize GLAD");
+static const shader_uniform_location_t* shader_internal_find_uniform(const shader_internal_t& shader_internal, uniform_id_t id) {
+	for (usize i = 0; i < shader_internal.uniform_locations.size(); ++i) {
+		if (shader_internal.uniform_locations[i].id == id) {
+			return &shader_internal.uniform_locations[i];
+		}
 	}
 
-	this->internal = new renderer_internal_t;
-	
-	shader_stage_t vshader = create_shader_stage(shader_stage_type::VERTEX, "assets/shaders/default.vert");
-	shader_stage_t fshader = create_shader_stage(shader_stage_type::FRAGMENT, "assets/shaders/default.frag");
+	return nullptr;
+}
 
-	shader_descriptor_t desc = {
-		.stages = {
-			shader_stage_type::VERTEX,
-			shader_stage_type::FRAGMENT,
-		},
-		.starting_stage = shader_stage_type::VERTEX,
-		.inputs = {
-			{ shader_data_type::F32, 3 },
-			{ shader_data_type::F32, 2 },
-			{ shader_data_type::F32, 3 },
-		},
-		.uniforms = {
-			{ shader_data_type::F32, 3, "unif_material_color" },
-			{ shader_data_type::TEXTURE, 1, "unif_texture_albedo" },
-			{ shader_data_type::TEXTURE, 1, "unif_texture_normal" },
-			{ shader_data_type::TEXTURE, 1, "unif_texture_specular" },
-			{ shader_data_type::MAT4x4, 1, "unif_mvp" },
-		},
-		.texture_attachments = {
-			{ shader_texture_attachment_type::ALBEDO, "unif_texture_albedo" },
-			{ shader_texture_attachment_type::NORMAL, "unif_texture_normal" },
-			{ shader_texture_attachment_type::SPECULAR, "unif_texture_specular" },
-		},
-	};
+static const shader_uniform_t* shader_internal_find_declared_uniform(const shader_internal_t& shader_internal, const char* name) {
+	for (usize i = 0; i < shader_internal.uniforms.size(); ++i) {
+		if (std::strcmp(name, shader_internal.uniforms[i].name) == 0) {
+			return &shader_internal.uniforms[i];
+		}
+	}
 
-	std::vector<shader_stage_t> stages = {
-		vshader,
-		fshader,
-	};
+	return nullptr;
+}
 
-	create_shader(desc, stages);
+static void shader_internal_resolve_uniforms(shader_internal_t& shader_internal) {
+	GLint active = 0;
+	glGetProgramiv(shader_internal.program, GL_ACTIVE_UNIFORMS, &active);
+
+	for (GLint i = 0; i < active; ++i) {
+		GLchar name[256];
+		GLsizei length = 0;
+		GLint count = 0;
+		GLenum gl_type = GL_NONE;
+		glGetActiveUniform(shader_internal.program, i, sizeof(name), &length, &count, &gl_type, name);
+
+		/* arrays report "name[0]" */
+		char* bracket = std::strchr(name, '[');
+		if (bracket != nullptr) {
+			*bracket = '\0';
+		}
 
-	shader_stage_t vlight_pass = create_shader_stage(shader_stage_type::VERTEX, "assets/shaders/default_light.vert");
-	shader_stage_t flight_pass = create_shader_stage(shader_stage_type::FRAGMENT, "assets/shaders/default_light.frag");
+		/* uniform block members have no location */
+		GLint location = glGetUniformLocation(shader_internal.program, name);
+		if (location == -1) {
+			continue;
+		}
 
-	shader_descriptor_t light_pass_desc = {
-		.stages = {
-			shader_stage_type::VERTEX,
-			shader_stage_type::FRAGMENT,
-		},
-		.starting_stage = shader_stage_type::VERTEX,
-		.inputs = {
-			{ shader_data_type::F32, 2 },
-		},
-		.uniforms = {
-			{ shader_data_type::TEXTURE, 1, "unif_gbuffer_geometry" },
-			{ shader_data_type::TEXTURE, 1, "unif_gbuffer_normal" },
-			{ shader_data_type::TEXTURE, 1, "unif_gbuffer_albedo_specular" },
-			{ shader_data_type::TEXTURE, 1, "unif_gbuffer_shadows" },
-			{ shader_data_type::F32, 2, "unif_screen" },
-		},
-		.texture_attachments = {
-			{ shader_texture_attachment_type::UNKNOWN, "unif_gbuffer_geometry" },
-			{ shader_texture_attachment_type::NORMAL, "unif_gbuffer_normal" },
-			{ shader_texture_attachment_type::UNKNOWN, "unif_gbuffer_albedo_specular" },
-		},
-	};
+		shader_uniform_location_t uniform_location = {
+			.id = uniform_id(name),
+			.location = location,
+			.type = shader_data_type::F32,
+			.size = 0,
+		};
 
-	std::vector<shader_stage_t> light_pass_stages = {
-		vlight_pass,
-		flight_pass,
-	};
+		u32 components = 0;
+		if (!gl_uniform_type_to_shader(gl_type, uniform_location.type, components)) {
+			continue;
+		}
+		uniform_location.size = components * count;
 
-	this->internal->gbuffer.light_pass = create_shader(light_pass_desc, light_pass_stages);
+		if (shader_internal_find_uniform(shader_internal, uniform_location.id) != nullptr) {
+			std::string error = "Uniform id collision ";
+			error += name;
+			LOG_ERROR("%s", error.c_str());
+			throw std::runtime_error(error);
+		}
 
-	glFrontFace(GL_CCW);
-	glCullFace(GL_BACK);
-	glEnable(GL_DEPTH_TEST);
+		shader_internal.uniform_locations.push_back(uniform_location);
+	}
+}
 
-	glGenFramebuffers(1, &this->internal->gbuffer.framebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, this->internal->gbuffer.framebuffer);
+static void gl_uniform(GLint location, shader_data_type type, usize amount, const void* data) {
+	switch (type) {
+	case shader_data_type::U32:
+		if (amount == 1) {
+			glUniform1ui(location, reinterpret_cast<const u32*>(data)[0]);
+		} else if (amount == 2) {
+			glUniform2ui(location, reinterpret_cast<const u32*>(data)[0], reinterpret_cast<const u32*>(data)[1]);
+		} else if (amount == 3) {
+			glUniform3ui(location, reinterpret_cast<const u32*>(data)[0], reinterpret_cast<const u32*>(data)[1], reinterpret_cast<const u32*>(data)[2]);
+		} else if (amount == 4) {
+			glUniform4ui(location, reinterpret_cast<const u32*>(data)[0], reinterpret_cast<const u32*>(data)[1], reinterpret_cast<const u32*>(data)[2], reinterpret_cast<const u32*>(data)[3]);
+		} else {
+			glUniform1uiv(location, amount, reinterpret_cast<const u32*>(data));
+		}
+		break;
+	case shader_data_type::S32:
+		if (amount == 1) {
+			glUniform1i(location, reinterpret_cast<const s32*>(data)[0]);
+		} else if (amount == 2) {
+			glUniform2i(location, reinterpret_cast<const s32*>(data)[0], reinterpret_cast<const s32*>(data)[1]);
+		} else if (amount == 3) {
+			glUniform3i(location, reinterpret_cast<const s32*>(data)[0], reinterpret_cast<const s32*>(data)[1], reinterpret_cast<const s32*>(data)[2]);
+		} else if (amount == 4) {
+			glUniform4i(location, reinterpret_cast<const s32*>(data)[0], reinterpret_cast<const s32*>(data)[1], reinterpret_cast<const s32*>(data)[2], reinterpret_cast<const s32*>(data)[3]);
+		} else {
+			glUniform1iv(location, amount, reinterpret_cast<const s32*>(data));
+		}
+		break;
+	case shader_data_type::F32:
+		if (amount == 1) {
+			glUniform1f(location, reinterpret_cast<const f32*>(data)[0]);
+		} else if (amount == 2) {
+			glUniform2f(location, reinterpret_cast<const f32*>(data)[0], reinterpret_cast<const f32*>(data)[1]);
+		} else if (amount == 3) {
+			glUniform3f(location, reinterpret_cast<const f32*>(data)[0], reinterpret_cast<const f32*>(data)[1], reinterpret_cast<const f32*>(data)[2]);
+		} else if (amount == 4) {
+			glUniform4f(location, reinterpret_cast<const f32*>(data)[0], reinterpret_cast<const f32*>(data)[1], reinterpret_cast<const f32*>(data)[2], reinterpret_cast<const f32*>(data)[3]);
+		} else {
+			glUniform1fv(location, amount, reinterpret_cast<const f32*>(data));
+		}
+		break;
+	case shader_data_type::MAT4x4:
+		glUniformMatrix4fv(location, amount, false, reinterpret_cast<const f32*>(data));
+		break;
+	default:
+		throw std::runtime_error("Invalid uniform data type");
+	}
+}
 
-	int w, h;
-	glfwGetWindowSize(window, &w, &h);
+/* expects the shader's vao and vbo to be bound */
+static void shader_internal_bind_inputs(const shader_internal_t& shader_internal) {
+	usize offset = 0;
+	for (usize i = 0; i < shader_internal.inputs.size(); i++) {
+		glVertexAttribPointer(i, shader_internal.inputs[i].size, shader_data_type_to_gl(shader_internal.inputs[i].type), GL_FALSE, shader_internal.vertex_size, (void*) offset);
+		glEnableVertexAttribArray(i);
+		offset += shader_internal.inputs[i].size * shader_data_type_size(shader_internal.inputs[i].type);
+	}
+}
 
-	glGenTextures(5, &this->internal->gbuffer.geometry);
-	glBindTexture(GL_TEXTURE_2D, this->internal->gbuffer.geometry);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_FLOAT, nullptr);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->internal->gbuffer.geometry, 0);
-	
-	glBindTexture(GL_TEXTURE_2D, this->internal->gbuffer.normal);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_FLOAT, nullptr);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, this->internal->gbuffer.normal, 0);
+/* reallocates a gpu buffer and copies the used range over on the gpu (no cpu round trip), returns the new buffer */
+static GLuint gl_buffer_grow(gl_state_c& gl, GLuint buffer, usize used_bytesize, usize new_bytesize) {
+	GLuint grown;
+	glGenBuffers(1, &grown);
+	gl.bind_buffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, new_bytesize, nullptr, GL_DYNAMIC_DRAW);
 
-	glBindTexture(GL_TEXTURE_2D, this->internal->gbuffer.albedo_specular);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_FLOAT, nullptr);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, this->internal->gbuffer.albedo_specular, 0);
+	if (used_bytesize > 0) {
+		gl.bind_buffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used_bytesize);
+	}
 
-	glBindTexture(GL_TEXTURE_2D, this->internal->gbuffer.shadows);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, w, h, 0, GL_RGBA, GL_FLOAT, nullptr);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, this->internal->gbuffer.shadows, 0);
+	gl.delete_buffer(buffer);
+	return grown;
+}
 
-	glBindTexture(GL_TEXTURE_2D, this->internal->gbuffer.depth);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, w, h, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->internal->gbuffer.depth, 0);
+static u32 shader_buffer_grown_capacity(u32 capacity, usize required) {
+	usize grown = (capacity == 0) ? 1 : capacity;
+	while (grown < required) {
+		grown *= SHADER_BUFFER_GROWTH_FACTOR;
+	}
 
-	u32 attachments[4] = {
-		GL_COLOR_ATTACHMENT0,
-		GL_COLOR_ATTACHMENT1,
-		GL_COLOR_ATTACHMENT2,
-		GL_COLOR_ATTACHMENT3,
-	};
-	glDrawBuffers(4, attachments);
+	if (grown > U32_MAX) {
+		throw std::runtime_error("Shader buffer capacity overflow");
+	}
 
-	glGenVertexArrays(1, &this->internal->shaders[this->internal->gbuffer.light_pass].vao);
-	glBindVertexArray(this->internal->shaders[this->internal->gbuffer.light_pass].vao);
-	glGenBuffers(1, &this->internal->gbuffer.quad_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, this->internal->gbuffer.quad_vbo);
-	float vertices[12] = {
-		-1, -1,
-		-1,  1,
-		 1, -1,
-		 1,  1,
-	};
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	return static_cast<u32>(grown);
+}
 
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*) 0);
-	glEnableVertexAttribArray(0);
-	glBindVertexArray(0);
+/* offsets (vindex/iindex) of already uploaded meshes stay valid as the used range is copied to the same place */
+static void shader_internal_reserve(gl_state_c& gl, shader_internal_t& shader_internal, usize vcapacity, usize icapacity) {
+	if (vcapacity > shader_internal.vbuffer_capacity) {
+		u32 capacity = shader_buffer_grown_capacity(shader_internal.vbuffer_capacity, vcapacity);
+		shader_internal.vbo = gl_buffer_grow(gl, shader_internal.vbo, shader_internal.vallocator.high_water() * shader_internal.vertex_size, capacity * shader_internal.vertex_size);
+		shader_internal.vbuffer_capacity = capacity;
+		shader_internal.vallocator.grow(capacity);
+
+		/* the vao captured the old vbo in its attribute pointers */
+		gl.bind_vertex_array(shader_internal.vao);
+		gl.bind_buffer(GL_ARRAY_BUFFER, shader_internal.vbo);
+		shader_internal_bind_inputs(shader_internal);
+		gl.bind_vertex_array(0);
+	}
 
-	/* shadow map */
-	shader_stage_t vshadow_depth_pass = create_shader_stage(shader_stage_type::VERTEX, "assets/shaders/shadow_depth.vert");
-	shader_stage_t fshadow_depth_pass = create_shader_stage(shader_stage_type::FRAGMENT, "assets/shaders/shadow_depth.frag");
+	if (icapacity > shader_internal.ibuffer_capacity) {
+		u32 capacity = shader_buffer_grown_capacity(shader_internal.ibuffer_capacity, icapacity);
+		shader_internal.ibo = gl_buffer_grow(gl, shader_internal.ibo, shader_internal.iallocator.high_water() * sizeof(u32), capacity * sizeof(u32));
+		shader_internal.ibuffer_capacity = capacity;
+		shader_internal.iallocator.grow(capacity);
 
-	shader_descriptor_t shadow_depth_pass_desc = {
-		.stages = {
-			shader_stage_type::VERTEX,
-			shader_stage_type::FRAGMENT,
-		},
-		.starting_stage = shader_stage_type::VERTEX,
-		.inputs = {
-			{ shader_data_type::F32, 3 },
-			{ shader_data_type::F32, 2 },
-			{ shader_data_type::F32, 3 },
-		},
-		.uniforms = {
-			{ shader_data_type::MAT4x4, 1, "unif_light_vp" },
-			{ shader_data_type::MAT4x4, 1, "unif_model" },
-		},
-		.texture_attachments = {
+		/* element buffer binding is vao state */
+		gl.bind_vertex_array(shader_internal.vao);
+		gl.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, shader_internal.ibo);
+		gl.bind_vertex_array(0);
+	}
+}
 
-		},
-	};
+/* allocates from the free ranges first and only grows the buffers when nothing fits */
+static void shader_internal_allocate(gl_state_c& gl, shader_internal_t& shader_internal, u32 vcount, u32 icount, u32& vindex, u32& iindex) {
+	vindex = shader_internal.vallocator.allocate(vcount);
+	if (vindex == OFFSET_ALLOCATOR_INVALID) {
+		shader_internal_reserve(gl, shader_internal, static_cast<usize>(shader_internal.vallocator.high_water()) + vcount, 0);
+		vindex = shader_internal.vallocator.allocate(vcount);
+	}
 
-	std::vector<shader_stage_t> shadow_depth_pass_stages = {
-		vshadow_depth_pass,
-		fshadow_depth_pass,
-	};
+	iindex = shader_internal.iallocator.allocate(icount);
+	if (iindex == OFFSET_ALLOCATOR_INVALID) {
+		shader_internal_reserve(gl, shader_internal, 0, static_cast<usize>(shader_internal.iallocator.high_water()) + icount);
+		iindex = shader_internal.iallocator.allocate(icount);
+	}
+}
 
-	this->internal->shadow_map.depth_shader = create_shader(shadow_depth_pass_desc, shadow_depth_pass_stages);
+/* adds or removes a geometry in its shader's offset index, empty ranges were never allocated so they aren't in it */
+static void shader_internal_track(shader_internal_t& shader_internal, const geometry_internal_t& geometry, u32 id, b8 live) {
+	if (geometry.vcount > 0) {
+		if (live) {
+			shader_internal.vertex_geometries.emplace(geometry.vindex, id);
+		} else {
+			shader_internal.vertex_geometries.erase(geometry.vindex);
+		}
+	}
 
-	shader_stage_t vshadow_composite_pass = create_shader_stage(shader_stage_type::VERTEX, "assets/shaders/shadow_composite.vert");
-	shader_stage_t fshadow_composite_pass = create_shader_stage(shader_stage_type::FRAGMENT, "assets/shaders/shadow_composite.frag");
+	if (geometry.icount > 0) {
+		if (live) {
+			shader_internal.index_geometries.emplace(geometry.iindex, id);
+		} else {
+			shader_internal.index_geometries.erase(geometry.iindex);
+		}
+	}
 
-	shader_descriptor_t shadow_composite_pass_desc = {
-		.stages = {
-			shader_stage_type::VERTEX,
-			shader_stage_type::FRAGMENT,
-		},
-		.starting_stage = shader_stage_type::VERTEX,
-		.inputs = {
-			{ shader_data_type::F32, 3 },
-			{ shader_data_type::F32, 2 },
-			{ shader_data_type::F32, 3 },
-		},
-		.uniforms = {
-			{ shader_data_type::MAT4x4, 1, "unif_light_vp" },
-			{ shader_data_type::MAT4x4, 1, "unif_model" },
-			{ shader_data_type::MAT4x4, 1, "unif_vp" },
-			{ shader_data_type::TEXTURE, 1, "unif_shadow_depth" },
-		},
-		.texture_attachments = {
+	shader_internal.vertices_packed = false;
+	shader_internal.indices_packed = false;
+}
 
-		},
-	};
+/* moves one range of a shared buffer into a lower free range, same-buffer copies are fine since the ranges never overlap */
+static void gl_buffer_move(gl_state_c& gl, GLuint buffer, usize from_bytes, usize to_bytes, usize bytesize) {
+	gl.bind_buffer(GL_COPY_READ_BUFFER, buffer);
+	gl.bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from_bytes, to_bytes, bytesize);
+}
 
-	std::vector<shader_stage_t> shadow_composite_pass_stages = {
-		vshadow_composite_pass,
-		fshadow_composite_pass,
-	};
+static void gl_sync_wait(GLsync& fence) {
+	if (fence == nullptr) {
+		return;
+	}
 
-	this->internal->shadow_map.shadow_composite = create_shader(shadow_composite_pass_desc, shadow_composite_pass_stages);
+	while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+	glDeleteSync(fence);
+	fence = nullptr;
+}
 
-	this->internal->shadow_map.width = 1024;
-	this->internal->shadow_map.height = 1024;
+static void draw_data_ring_reserve(gl_state_c& gl, draw_data_ring_t& ring, u32 records) {
+	if (records <= ring.capacity) {
+		return;
+	}
 
-	glGenFramebuffers(1, &this->internal->shadow_map.framebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, this->internal->shadow_map.framebuffer);
+	u32 capacity = (ring.capacity == 0) ? DRAW_DATA_RECORDS_DEFAULT : ring.capacity;
+	while (capacity < records) {
+		capacity *= 2;
+	}
 
-	glGenTextures(1, &this->internal->shadow_map.texture);
-	glBindTexture(GL_TEXTURE_2D, this->internal->shadow_map.texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, this->internal->shadow_map.width, this->internal->shadow_map.height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	GLint max_texels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+	if (static_cast<usize>(capacity) * DRAW_DATA_RING_FRAMES * (sizeof(draw_data_t) / sizeof(vec4)) > static_cast<usize>(max_texels)) {
+		throw std::runtime_error("Draw data exceeds the maximum texture buffer size");
+	}
+
+	/* the new storage is not referenced by any in flight frame */
+	for (usize i = 0; i < DRAW_DATA_RING_FRAMES; ++i) {
+		if (ring.fences[i] != nullptr) {
+			glDeleteSync(ring.fences[i]);
+			ring.fences[i] = nullptr;
+		}
+	}
+
+	ring.capacity = capacity;
+
+	std::vector<u32> record_ids(static_cast<usize>(capacity) * DRAW_DATA_RING_FRAMES);
+	for (usize i = 0; i < record_ids.size(); ++i) {
+		record_ids[i] = static_cast<u32>(i);
+	}
+
+	gl.bind_buffer(GL_ARRAY_BUFFER, ring.record_ids);
+	glBufferData(GL_ARRAY_BUFFER, record_ids.size() * sizeof(u32), record_ids.data(), GL_STATIC_DRAW);
+
+	gl.bind_buffer(GL_TEXTURE_BUFFER, ring.buffer);
+	glBufferData(GL_TEXTURE_BUFFER, static_cast<usize>(capacity) * DRAW_DATA_RING_FRAMES * sizeof(draw_data_t), nullptr, GL_STREAM_DRAW);
+
+	gl.bind_texture(DRAW_DATA_TEXTURE_UNIT, GL_TEXTURE_BUFFER, ring.texture);
+	gl.activate_texture(DRAW_DATA_TEXTURE_UNIT);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, ring.buffer);
+}
+
+/* waits until the gpu is done with the next segment and maps it, records are indexed from ring.base */
+static draw_data_t* draw_data_ring_map(gl_state_c& gl, draw_data_ring_t& ring) {
+	gl_sync_wait(ring.fences[ring.frame]);
+
+	ring.base = ring.frame * ring.capacity;
+	gl.bind_buffer(GL_TEXTURE_BUFFER, ring.buffer);
+	void* mapped = glMapBufferRange(GL_TEXTURE_BUFFER, ring.base * sizeof(draw_data_t), ring.capacity * sizeof(draw_data_t), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped == nullptr) {
+		throw std::runtime_error("Failed to map draw data");
+	}
+
+	return reinterpret_cast<draw_data_t*>(mapped);
+}
+
+static void draw_data_ring_unmap(gl_state_c& gl, draw_data_ring_t& ring) {
+	gl.bind_buffer(GL_TEXTURE_BUFFER, ring.buffer);
+	glUnmapBuffer(GL_TEXTURE_BUFFER);
+}
+
+/* called once every draw using the current segment has been submitted */
+static void draw_data_ring_advance(draw_data_ring_t& ring) {
+	ring.fences[ring.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring.frame = (ring.frame + 1) % DRAW_DATA_RING_FRAMES;
+}
+
+static void stream_texture_buffer_create(stream_texture_buffer_t& stream, u32 format, u32 texel_size) {
+	stream = {
+		.buffer = 0,
+		.texture = 0,
+		.format = format,
+		.texel_size = texel_size,
+		.capacity = 0,
+	};
+
+	glGenBuffers(1, &stream.buffer);
+	glGenTextures(1, &stream.texture);
+}
+
+/* leaves the texture bound to unit */
+static void stream_texture_buffer_fill(gl_state_c& gl, stream_texture_buffer_t& stream, u32 unit, const void* data, usize bytesize) {
+	usize capacity = (stream.capacity == 0) ? STREAM_TEXTURE_BUFFER_CAPACITY_DEFAULT : stream.capacity;
+	while (capacity < bytesize) {
+		capacity *= 2;
+	}
+
+	gl.bind_buffer(GL_TEXTURE_BUFFER, stream.buffer);
+	glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+	if (bytesize > 0) {
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, bytesize, data);
+	}
+
+	gl.bind_texture(unit, GL_TEXTURE_BUFFER, stream.texture);
+	if (capacity != stream.capacity) {
+		GLint max_texels = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+		if (capacity / stream.texel_size > static_cast<usize>(max_texels)) {
+			throw std::runtime_error("Stream data exceeds the maximum texture buffer size");
+		}
+
+		gl.activate_texture(unit);
+		glTexBuffer(GL_TEXTURE_BUFFER, stream.format, stream.buffer);
+		stream.capacity = capacity;
+	}
+}
+
+static void stream_texture_buffer_destroy(gl_state_c& gl, stream_texture_buffer_t& stream) {
+	gl.delete_texture(stream.texture);
+	gl.delete_buffer(stream.buffer);
+}
+
+static void shader_internal_bind_draw_records(gl_state_c& gl, const shader_internal_t& shader_internal, GLuint record_ids) {
+	gl.bind_vertex_array(shader_internal.vao);
+	gl.bind_buffer(GL_ARRAY_BUFFER, record_ids);
+	glVertexAttribIPointer(DRAW_RECORD_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0, (void*) 0);
+	glVertexAttribDivisor(DRAW_RECORD_ATTRIBUTE, 1);
+	glEnableVertexAttribArray(DRAW_RECORD_ATTRIBUTE);
+	gl.bind_vertex_array(0);
+}
+
+/* vaos capture the record id buffer, so they are re-pointed whenever the ring reallocates it */
+static void renderer_internal_reserve_draw_data(renderer_internal_t* internal, u32 records) {
+	if (records <= internal->draw_data.capacity) {
+		return;
+	}
+
+	draw_data_ring_reserve(internal->gl, internal->draw_data, records);
+	for (usize i = 0; i < internal->shaders.size(); ++i) {
+		shader_internal_bind_draw_records(internal->gl, internal->shaders[i], internal->draw_data.record_ids);
+	}
+}
+
+static b8 gl_extension_supported(const char* name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i) {
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (extension != nullptr && std::strcmp(extension, name) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static gbuffer_formats_t gbuffer_normal_formats(gbuffer_layout layout) {
+	switch (layout) {
+	case gbuffer_layout::COMPACT:
+		return { GL_RG16, GL_RG, GL_UNSIGNED_SHORT };
+	default:
+		return { GL_RGBA16F, GL_RGBA, GL_FLOAT };
+	}
+}
+
+static gbuffer_formats_t gbuffer_albedo_formats(gbuffer_layout layout) {
+	switch (layout) {
+	case gbuffer_layout::COMPACT:
+		return { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE };
+	default:
+		return { GL_RGBA16F, GL_RGBA, GL_FLOAT };
+	}
+}
+
+/* color targets plus DEPTH_COMPONENT32F */
+static u32 gbuffer_bytes_per_pixel(gbuffer_layout layout) {
+	switch (layout) {
+	case gbuffer_layout::COMPACT:
+		return 4 + 4 + 4;
+	default:
+		return 8 + 8 + 4;
+	}
+}
+
+static const char* gbuffer_layout_name(gbuffer_layout layout) {
+	switch (layout) {
+	case gbuffer_layout::COMPACT:
+		return "compact";
+	default:
+		return "standard";
+	}
+}
+
+/* (re)specifies the targets' storage, the framebuffer's attachments keep pointing at the same textures */
+static void gbuffer_allocate(gl_state_c& gl, gbuffer_t& gbuffer, u32 width, u32 height) {
+	gbuffer_formats_t normal_formats = gbuffer_normal_formats(gbuffer.layout);
+	gbuffer_formats_t albedo_formats = gbuffer_albedo_formats(gbuffer.layout);
+
+	gl.bind_texture(0, GL_TEXTURE_2D, gbuffer.normal);
+	glTexImage2D(GL_TEXTURE_2D, 0, normal_formats.internal_format, width, height, 0, normal_formats.format, normal_formats.type, nullptr);
+	gl.bind_texture(0, GL_TEXTURE_2D, gbuffer.albedo_specular);
+	glTexImage2D(GL_TEXTURE_2D, 0, albedo_formats.internal_format, width, height, 0, albedo_formats.format, albedo_formats.type, nullptr);
+	gl.bind_texture(0, GL_TEXTURE_2D, gbuffer.depth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+
+	gl.bind_texture(0, GL_TEXTURE_2D, gbuffer.output);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	gbuffer.width = width;
+	gbuffer.height = height;
+}
+
+/* the renderer of each window, callbacks look themselves up here so the window user pointer stays the application's */
+static std::vector<std::pair<GLFWwindow*, renderer_internal_t*>> renderer_windows;
+
+/* only records the size, resizing several times between frames reallocates once */
+static void renderer_framebuffer_size_callback(GLFWwindow* window, int width, int height) {
+	auto entry = std::find_if(renderer_windows.begin(), renderer_windows.end(), [window](const std::pair<GLFWwindow*, renderer_internal_t*>& entry) {
+		return entry.first == window;
+	});
+	if (entry == renderer_windows.end()) {
+		return;
+	}
+
+	renderer_internal_t* internal = entry->second;
+	internal->framebuffer_width = static_cast<u32>(std::max(width, 0));
+	internal->framebuffer_height = static_cast<u32>(std::max(height, 0));
+
+	if (internal->previous_framebuffer_size_callback != nullptr) {
+		internal->previous_framebuffer_size_callback(window, width, height);
+	}
+}
+
+static f32 light_radius(f32 intensity) {
+	return std::sqrt(std::max(intensity, 0.0f) / LIGHT_ATTENUATION_CUTOFF);
+}
+
+static bounds_t light_bounds(const light_t& light) {
+	f32 radius = light_radius(light.intensity);
+
+	bounds_t bounds = {};
+	vec3_dup(bounds.center, light.position);
+	bounds.extent[0] = bounds.extent[1] = bounds.extent[2] = radius;
+	bounds.radius = radius;
+	return bounds;
+}
+
+/* share of the screen's height a light's sphere covers, at least 1 once the camera is inside it */
+static f32 light_screen_coverage(const camera_c& camera, const bounds_t& bounds) {
+	/* the projection's y scale, the rotation in vp leaves the length of its row alone */
+	const mat4x4& vp = camera.vp_matrix;
+	f32 scale_y = std::sqrt(vp[0][1] * vp[0][1] + vp[1][1] * vp[1][1] + vp[2][1] * vp[2][1]);
+	if (camera.is_ortho) {
+		return bounds.radius * scale_y;
+	}
+
+	vec3 offset;
+	vec3_sub(offset, bounds.center, camera.transform.position);
+	f32 distance_squared = vec3_mul_inner(offset, offset);
+	f32 radius_squared = bounds.radius * bounds.radius;
+	if (distance_squared <= radius_squared) {
+		return 1.0f;
+	}
+
+	/* tangent of the sphere's half angle */
+	return bounds.radius * scale_y / std::sqrt(distance_squared - radius_squared);
+}
+
+static void light_view_projection(const light_t& light, mat4x4 vp) {
+	mat4x4 light_proj;
+	mat4x4_perspective(light_proj, 45.0f, 1.0f, 0.1f, 25.0f * light.intensity);
+
+	mat4x4 light_view;
+	vec3 center = { 0, 1, 0 };
+	vec3 up = { 0, 1, 0 };
+	mat4x4_look_at(light_view, light.position, center, up);
+
+	mat4x4_mul(vp, light_proj, light_view);
+}
+
+static void transform_cache_reserve(transform_cache_t& cache, usize meshes) {
+	if (cache.valid.size() >= meshes) {
+		return;
+	}
+
+	cache.transforms.resize(meshes);
+	cache.matrices.resize(meshes);
+	cache.bounds.resize(meshes);
+	cache.valid.resize(meshes, 0);
+	cache.proxies.resize(meshes, BVH_NONE);
+}
+
+static void transform_cache_update(transform_cache_t& cache, const std::vector<mesh_internal_t>& meshes, const std::vector<geometry_internal_t>& geometries, const std::vector<u32>& draw_order, std::vector<bounds_t>& static_changes) {
+	PROFILE_ZONE("transform cache update");
+	cache.moved.clear();
+	cache.dirty.clear();
+
+	for (usize i = 0; i < draw_order.size(); i++) {
+		const mesh_t* mesh = meshes[draw_order[i]].mesh;
+		u32 id = mesh->id;
+		if (cache.valid[id] && std::memcmp(&cache.transforms[id], &mesh->transform, sizeof(transform_t)) == 0) {
+			continue;
+		}
+
+		cache.transforms[id] = mesh->transform;
+		cache.valid[id] = 1;
+		cache.moved.push(mesh->transform);
+		cache.dirty.push_back(id);
+	}
+
+	cache.moved.compose(cache.matrices.data(), cache.dirty.data());
+	cache.updated = cache.dirty.size();
+
+	for (usize i = 0; i < cache.dirty.size(); i++) {
+		u32 id = cache.dirty[i];
+		b8 is_static = meshes[id].is_static;
+		if (is_static && cache.proxies[id] != BVH_NONE) {
+			static_changes.push_back(cache.bounds[id]);
+		}
+
+		cache.bounds[id] = bounds_transform(geometries[meshes[id].geometry].bounds, cache.matrices[id].model);
+		if (is_static) {
+			static_changes.push_back(cache.bounds[id]);
+		}
+
+		if (cache.proxies[id] == BVH_NONE) {
+			cache.proxies[id] = cache.bvh.insert(cache.bounds[id], id);
+			cache.reshaped = true;
+		} else {
+			cache.bvh.update(cache.proxies[id], cache.bounds[id]);
+		}
+	}
+
+	cache.linear = cache.reshaped;
+	cache.reshaped = false;
+	if (!cache.linear) {
+		return;
+	}
+
+	cache.drawn.clear();
+	cache.drawn.reserve(draw_order.size());
+	for (usize i = 0; i < draw_order.size(); i++) {
+		cache.drawn.push(cache.bounds[draw_order[i]]);
+	}
+}
+
+/* records in sorted order */
+static void draw_records_write(draw_data_t* records, const std::vector<mesh_internal_t>& meshes, const transform_cache_t& cache, const draw_item_t* items, const u32* sorted, usize count) {
+	for (usize i = 0; i < count; i++) {
+		const mesh_t* mesh = meshes[items[sorted[i]].mesh].mesh;
+
+		const transform_matrices_t& matrices = cache.matrices[mesh->id];
+		std::memcpy(records[i].model, matrices.model, sizeof(mat4x4));
+		std::memcpy(records[i].model_rotation, matrices.rotation, sizeof(mat4x4));
+		records[i].material_color[0] = mesh->material.r;
+		records[i].material_color[1] = mesh->material.g;
+		records[i].material_color[2] = mesh->material.b;
+		records[i].material_color[3] = 1;
+	}
+}
+
+/* consecutive records with the same geometry (and textures, for passes that bind them) form one instanced batch */
+static void draw_batches_build(std::vector<draw_batch_t>& batches, const renderer_internal_t* internal, const u32* sorted, usize count, u32 first_record, b8 split_textures) {
+	usize start = batches.size();
+	for (usize i = 0; i < count; i++) {
+		const draw_item_t& item = internal->draw_items[sorted[i]];
+		if (batches.size() > start && batches.back().geometry == item.geometry && (!split_textures || batches.back().texture_set == item.texture_set)) {
+			++batches.back().count;
+			continue;
+		}
+
+		const geometry_internal_t& geometry = internal->geometries[item.geometry];
+		batches.push_back({
+			.shader = item.shader,
+			.texture_set = item.texture_set,
+			.geometry = item.geometry,
+			.vertex_array = internal->shaders[geometry.shader].vao,
+			.icount = geometry.icount,
+			.iindex = geometry.iindex,
+			.vindex = geometry.vindex,
+			.first = static_cast<u32>(first_record + i),
+			.count = 1,
+		});
+	}
+}
+
+/* mesh_t of a mesh id when it is drawn, nullptr otherwise */
+static mesh_t* renderer_internal_drawable(renderer_internal_t* internal, u32 id) {
+	const mesh_internal_t& mesh_internal = internal->meshes[id];
+	if (mesh_internal.mesh == nullptr || mesh_internal.geometry == GEOMETRY_NONE || internal->geometries[mesh_internal.geometry].icount == 0) {
+		return nullptr;
+	}
+
+	return mesh_internal.mesh;
+}
+
+/* visible mesh ids in no particular order, every drawn mesh when culling is off */
+static usize draw_view_cull(renderer_internal_t* internal, const frustum_t& frustum, b8 culling, u32* visible) {
+	PROFILE_ZONE("view cull");
+	const std::vector<u32>& draw_order = internal->draw_order;
+	if (!culling) {
+		std::copy(draw_order.begin(), draw_order.end(), visible);
+		return draw_order.size();
+	}
+
+	transform_cache_t& cache = internal->transform_cache;
+	if (cache.linear) {
+		usize count = frustum_cull(frustum, cache.drawn, visible);
+		for (usize i = 0; i < count; i++) {
+			visible[i] = draw_order[visible[i]];
+		}
+
+		return count;
+	}
+
+	std::vector<u32>& query = internal->bvh_results;
+	query.clear();
+	cache.bvh.query_frustum(frustum, query);
+
+	/* leaves of meshes that lost their geometry linger until the mesh is drawn or destroyed again */
+	usize count = 0;
+	for (usize i = 0; i < query.size(); i++) {
+		if (renderer_internal_drawable(internal, query[i]) != nullptr) {
+			visible[count++] = query[i];
+		}
+	}
+
+	return count;
+}
+
+/* a lookup without allocation once the set is known, gl names are resolved when it is first seen */
+static u32 texture_set_id(renderer_internal_t* internal, const std::vector<texture_t>& textures) {
+	auto found = internal->texture_sets.find(textures);
+	if (found != internal->texture_sets.end()) {
+		return found->second;
+	}
+
+	u32 id = static_cast<u32>(internal->texture_set_table.size());
+	internal->texture_sets.emplace(textures, id);
+	internal->texture_set_table.push_back({ static_cast<u32>(internal->texture_set_names.size()), static_cast<u32>(textures.size()) });
+	for (usize i = 0; i < textures.size(); i++) {
+		internal->texture_set_names.push_back(internal->textures[textures[i] - 1].gl);
+	}
+
+	return id;
+}
+
+/* clip w of the bounds' center, the distance along the view direction for a perspective projection */
+static u64 draw_key_depth(const mat4x4 vp, const bounds_t& bounds) {
+	f32 depth = vp[0][3] * bounds.center[0] + vp[1][3] * bounds.center[1] + vp[2][3] * bounds.center[2] + vp[3][3];
+	f32 scaled = std::log2(1.0f + std::max(depth, 0.0f)) / DRAW_KEY_DEPTH_LOG2_RANGE;
+	return static_cast<u64>(std::min(scaled, 1.0f) * ((1u << DRAW_KEY_DEPTH_BITS) - 1));
+}
+
+static u64 draw_key(u32 view, b8 dynamic, u32 shader, u32 texture_set, u32 geometry, u64 depth) {
+	u64 key = view;
+	key = (key << DRAW_KEY_CASTER_BITS) | (dynamic ? 1 : 0);
+	key = (key << DRAW_KEY_SHADER_BITS) | (shader & ((1u << DRAW_KEY_SHADER_BITS) - 1));
+	key = (key << DRAW_KEY_TEXTURES_BITS) | (texture_set & ((1u << DRAW_KEY_TEXTURES_BITS) - 1));
+	key = (key << DRAW_KEY_GEOMETRY_BITS) | (geometry & ((1u << DRAW_KEY_GEOMETRY_BITS) - 1));
+	return (key << DRAW_KEY_DEPTH_BITS) | depth;
+}
+
+renderer_c::renderer_c(GLFWwindow* window, camera_c& camera, gbuffer_layout layout) : camera(camera) {
+	this->window = window;
+	glfwMakeContextCurrent(window);
+	if (gladLoadGLLoader((GLADloadproc) glfwGetProcAddress) == 0) {
+		throw std::runtime_error("Failed to initialize GLAD");
+	}
+
+	this->internal = new renderer_internal_t();
+	this->internal->compaction_budget = 0;
+	this->internal->frustum_culling = true;
+	this->internal->cull_stats = {};
+	this->internal->occlusion.pool = &this->internal->workers;
+	this->internal->occlusion_culling = true;
+	gl_state_c& gl = this->internal->gl;
+
+	/* per-draw data, needed before any shader vao is created */
+	this->internal->draw_data = {};
+	glGenBuffers(1, &this->internal->draw_data.buffer);
+	glGenBuffers(1, &this->internal->draw_data.record_ids);
+	glGenTextures(1, &this->internal->draw_data.texture);
+	draw_data_ring_reserve(this->internal->gl, this->internal->draw_data, DRAW_DATA_RECORDS_DEFAULT);
+
+	/* multi draw indirect with base_instance needs 4.3 or the two arb extensions, everything else falls back to a draw per batch */
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	this->internal->multi_draw_elements_indirect = nullptr;
+	if (major > 4 || (major == 4 && minor >= 3) || (gl_extension_supported("GL_ARB_multi_draw_indirect") && gl_extension_supported("GL_ARB_base_instance"))) {
+		this->internal->multi_draw_elements_indirect = reinterpret_cast<PFN_GL_MULTI_DRAW_ELEMENTS_INDIRECT>(glfwGetProcAddress("glMultiDrawElementsIndirect"));
+	}
+	this->internal->use_multi_draw_indirect = this->internal->multi_draw_elements_indirect != nullptr;
+	glGenBuffers(1, &this->internal->indirect_buffer);
+	
+	shader_stage_t vshader = create_shader_stage(shader_stage_type::VERTEX, "assets/shaders/default.vert");
+	shader_stage_t fshader = create_shader_stage(shader_stage_type::FRAGMENT, "assets/shaders/default.frag");
+
+	shader_descriptor_t desc = {
+		.stages = {
+			shader_stage_type::VERTEX,
+			shader_stage_type::FRAGMENT,
+		},
+		.starting_stage = shader_stage_type::VERTEX,
+		.inputs = {
+			{ shader_data_type::F32, 3 },
+			{ shader_data_type::F32, 2 },
+			{ shader_data_type::F32, 3 },
+		},
+		.uniforms = {
+			{ shader_data_type::TEXTURE, 1, "unif_texture_albedo" },
+			{ shader_data_type::TEXTURE, 1, "unif_texture_normal" },
+			{ shader_data_type::TEXTURE, 1, "unif_texture_specular" },
+			{ shader_data_type::TEXTURE, 1, "unif_draw_data" },
+			{ shader_data_type::S32, 1, "unif_draw_index" },
+		},
+		.texture_attachments = {
+			{ shader_texture_attachment_type::ALBEDO, "unif_texture_albedo" },
+			{ shader_texture_attachment_type::NORMAL, "unif_texture_normal" },
+			{ shader_texture_attachment_type::SPECULAR, "unif_texture_specular" },
+		},
+	};
+
+	std::vector<shader_stage_t> stages = {
+		vshader,
+		fshader,
+	};
+
+	create_shader(desc, stages);
+
+	shader_stage_t vlight_pass = create_shader_stage(shader_stage_type::VERTEX, "assets/shaders/default_light.vert");
+	shader_stage_t flight_pass = create_shader_stage(shader_stage_type::FRAGMENT, "assets/shaders/default_light.frag");
+
+	shader_descriptor_t light_pass_desc = {
+		.stages = {
+			shader_stage_type::VERTEX,
+			shader_stage_type::FRAGMENT,
+		},
+		.starting_stage = shader_stage_type::VERTEX,
+		.inputs = {
+			{ shader_data_type::F32, 2 },
+		},
+		.uniforms = {
+			{ shader_data_type::TEXTURE, 1, "unif_gbuffer_depth" },
+			{ shader_data_type::TEXTURE, 1, "unif_gbuffer_normal" },
+			{ shader_data_type::TEXTURE, 1, "unif_gbuffer_albedo_specular" },
+			{ shader_data_type::TEXTURE, 1, "unif_shadow_atlas" },
+			{ shader_data_type::F32, 2, "unif_screen" },
+			{ shader_data_type::TEXTURE, 1, "unif_light_data" },
+			{ shader_data_type::TEXTURE, 1, "unif_cluster_offsets" },
+			{ shader_data_type::TEXTURE, 1, "unif_cluster_lights" },
+			{ shader_data_type::S32, 3, "unif_cluster_grid" },
+			{ shader_data_type::F32, 2, "unif_cluster_depth" },
+			{ shader_data_type::TEXTURE, 1, "unif_shadow_data" },
+		},
+		.texture_attachments = {
+			{ shader_texture_attachment_type::UNKNOWN, "unif_gbuffer_depth" },
+			{ shader_texture_attachment_type::NORMAL, "unif_gbuffer_normal" },
+			{ shader_texture_attachment_type::UNKNOWN, "unif_gbuffer_albedo_specular" },
+		},
+	};
+
+	std::vector<shader_stage_t> light_pass_stages = {
+		vlight_pass,
+		flight_pass,
+	};
+
+	this->internal->gbuffer.light_pass = create_shader(light_pass_desc, light_pass_stages);
+
+	glFrontFace(GL_CCW);
+	glCullFace(GL_BACK);
+	gl.set_capability(GL_DEPTH_TEST, true);
+
+	glGenFramebuffers(1, &this->internal->gbuffer.framebuffer);
+	gl.bind_framebuffer(GL_FRAMEBUFFER, this->internal->gbuffer.framebuffer);
+
+	/* framebuffer size rather than window size, they differ on high dpi displays */
+	int w, h;
+	glfwGetFramebufferSize(window, &w, &h);
+	this->internal->framebuffer_width = static_cast<u32>(w);
+	this->internal->framebuffer_height = static_cast<u32>(h);
+	renderer_windows.emplace_back(window, this->internal);
+	this->internal->previous_framebuffer_size_callback = glfwSetFramebufferSizeCallback(window, renderer_framebuffer_size_callback);
+
+	this->internal->gbuffer.layout = layout;
+	glGenTextures(3, &this->internal->gbuffer.normal);
+	glGenTextures(1, &this->internal->gbuffer.output);
+	gbuffer_allocate(gl, this->internal->gbuffer, this->internal->framebuffer_width, this->internal->framebuffer_height);
+
+	gl.bind_texture(0, GL_TEXTURE_2D, this->internal->gbuffer.normal);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->internal->gbuffer.normal, 0);
+
+	gl.bind_texture(0, GL_TEXTURE_2D, this->internal->gbuffer.albedo_specular);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, this->internal->gbuffer.albedo_specular, 0);
+
+	gl.bind_texture(0, GL_TEXTURE_2D, this->internal->gbuffer.depth);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->internal->gbuffer.depth, 0);
+
+	u32 attachments[2] = {
+		GL_COLOR_ATTACHMENT0,
+		GL_COLOR_ATTACHMENT1,
+	};
+	glDrawBuffers(2, attachments);
+
+	glGenFramebuffers(1, &this->internal->gbuffer.output_framebuffer);
+	gl.bind_framebuffer(GL_FRAMEBUFFER, this->internal->gbuffer.output_framebuffer);
+	gl.bind_texture(0, GL_TEXTURE_2D, this->internal->gbuffer.output);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->internal->gbuffer.output, 0);
+
+	this->internal->gpu_timer.create();
+	this->internal->dynamic_resolution = false;
+
+	gbuffer_stats_t report = this->gbuffer_stats();
+	LOG_INFO("g-buffer: %s layout, %u bytes per pixel, %.1f MiB at %ux%u, at least %.1f MiB of traffic per frame", gbuffer_layout_name(layout), report.bytes_per_pixel, report.bytes / (1024.0 * 1024.0), report.width, report.height, report.per_frame / (1024.0 * 1024.0));
+
+	glGenVertexArrays(1, &this->internal->shaders[this->internal->gbuffer.light_pass].vao);
+	gl.bind_vertex_array(this->internal->shaders[this->internal->gbuffer.light_pass].vao);
+	glGenBuffers(1, &this->internal->gbuffer.quad_vbo);
+	gl.bind_buffer(GL_ARRAY_BUFFER, this->internal->gbuffer.quad_vbo);
+	float vertices[12] = {
+		-1, -1,
+		-1,  1,
+		 1, -1,
+		 1,  1,
+	};
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*) 0);
+	glEnableVertexAttribArray(0);
+	gl.bind_vertex_array(0);
+
+	/* clustered lights */
+	stream_texture_buffer_create(this->internal->light_grid.lights, GL_RGBA32F, sizeof(vec4));
+	stream_texture_buffer_create(this->internal->light_grid.offsets, GL_R32UI, sizeof(u32));
+	stream_texture_buffer_create(this->internal->light_grid.indices, GL_R16UI, sizeof(u16));
+
+	/* shadow atlas */
+	shader_stage_t vshadow_depth_pass = create_shader_stage(shader_stage_type::VERTEX, "assets/shaders/shadow_depth.vert");
+	shader_stage_t fshadow_depth_pass = create_shader_stage(shader_stage_type::FRAGMENT, "assets/shaders/shadow_depth.frag");
+
+	shader_descriptor_t shadow_depth_pass_desc = {
+		.stages = {
+			shader_stage_type::VERTEX,
+			shader_stage_type::FRAGMENT,
+		},
+		.starting_stage = shader_stage_type::VERTEX,
+		.inputs = {
+			{ shader_data_type::F32, 3 },
+			{ shader_data_type::F32, 2 },
+			{ shader_data_type::F32, 3 },
+		},
+		.uniforms = {
+			{ shader_data_type::MAT4x4, 1, "unif_light_vp" },
+			{ shader_data_type::TEXTURE, 1, "unif_draw_data" },
+			{ shader_data_type::S32, 1, "unif_draw_index" },
+		},
+		.texture_attachments = {
+
+		},
+	};
+
+	std::vector<shader_stage_t> shadow_depth_pass_stages = {
+		vshadow_depth_pass,
+		fshadow_depth_pass,
+	};
+
+	this->internal->shadow_map.depth_shader = create_shader(shadow_depth_pass_desc, shadow_depth_pass_stages);
+
+	glGenFramebuffers(1, &this->internal->shadow_map.framebuffer);
+	gl.bind_framebuffer(GL_FRAMEBUFFER, this->internal->shadow_map.framebuffer);
+
+	/* compared in hardware, linear filtering gives 2x2 pcf */
+	u32 atlas_size = this->internal->shadow_map.atlas.size;
+	glGenTextures(1, &this->internal->shadow_map.texture);
+	gl.bind_texture(0, GL_TEXTURE_2D, this->internal->shadow_map.texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, atlas_size, atlas_size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->internal->shadow_map.texture, 0);
 
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	/* only ever blitted from, the formats have to match for depth blits */
+	glGenFramebuffers(1, &this->internal->shadow_map.static_framebuffer);
+	gl.bind_framebuffer(GL_FRAMEBUFFER, this->internal->shadow_map.static_framebuffer);
+
+	glGenTextures(1, &this->internal->shadow_map.static_texture);
+	gl.bind_texture(0, GL_TEXTURE_2D, this->internal->shadow_map.static_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, atlas_size, atlas_size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->internal->shadow_map.static_texture, 0);
+
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	gl.bind_framebuffer(GL_FRAMEBUFFER, 0);
+
+	this->internal->shadow_map.stats = {};
+	stream_texture_buffer_create(this->internal->shadow_map.stream, GL_RGBA32F, sizeof(vec4));
+
+	/* per-frame data */
+	glGenBuffers(1, &this->internal->frame_ubo);
+	gl.bind_buffer(GL_UNIFORM_BUFFER, this->internal->frame_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_data_t), nullptr, GL_STREAM_DRAW);
+	gl.bind_buffer_base(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, this->internal->frame_ubo);
 }
 
 renderer_c::~renderer_c() {
@@ -391,14 +1474,38 @@ renderer_c::~renderer_c() {
 	}
 
 	for (usize i = 0; i < this->internal->shaders.size(); ++i) {
-		glDeleteShader(this->internal->shaders[i].program);
-		glDeleteVertexArrays(1, &this->internal->shaders[i].vao);
-		glDeleteBuffers(1, &this->internal->shaders[i].vbo);
+		this->internal->gl.delete_program(this->internal->shaders[i].program);
+		this->internal->gl.delete_vertex_array(this->internal->shaders[i].vao);
+		this->internal->gl.delete_buffer(this->internal->shaders[i].vbo);
+		this->internal->gl.delete_buffer(this->internal->shaders[i].ibo);
 	}
 
 	for (usize i = 0; i < this->internal->textures.size(); ++i) {
-		glDeleteTextures(1, &this->internal->textures[i].gl);
+		this->internal->gl.delete_texture(this->internal->textures[i].gl);
 	}
+
+	for (usize i = 0; i < DRAW_DATA_RING_FRAMES; ++i) {
+		if (this->internal->draw_data.fences[i] != nullptr) {
+			glDeleteSync(this->internal->draw_data.fences[i]);
+		}
+	}
+
+	this->internal->gl.delete_texture(this->internal->draw_data.texture);
+	this->internal->gl.delete_buffer(this->internal->draw_data.buffer);
+	this->internal->gl.delete_buffer(this->internal->draw_data.record_ids);
+	this->internal->gl.delete_buffer(this->internal->indirect_buffer);
+	this->internal->gl.delete_buffer(this->internal->frame_ubo);
+
+	stream_texture_buffer_destroy(this->internal->gl, this->internal->light_grid.lights);
+	stream_texture_buffer_destroy(this->internal->gl, this->internal->light_grid.offsets);
+	stream_texture_buffer_destroy(this->internal->gl, this->internal->light_grid.indices);
+	stream_texture_buffer_destroy(this->internal->gl, this->internal->shadow_map.stream);
+
+	this->internal->gpu_timer.destroy();
+
+	/* the window has to outlive the renderer, the callback it had before is put back */
+	glfwSetFramebufferSizeCallback(this->window, this->internal->previous_framebuffer_size_callback);
+	renderer_windows.erase(std::remove(renderer_windows.begin(), renderer_windows.end(), std::make_pair(this->window, this->internal)), renderer_windows.end());
 }
 
 shader_stage_t renderer_c::create_shader_stage(shader_stage_type type, const char* filepath) {
@@ -431,7 +1538,7 @@ shader_stage_t renderer_c::create_shader_stage(shader_stage_type type, const cha
 		error += filepath;
 		error += ":\n";
 		error += info_log;
-		std::cerr << error;
+		LOG_ERROR("%s", error.c_str());
 		throw std::runtime_error(error);
 	}
 
@@ -449,13 +1556,20 @@ shader_t renderer_c::create_shader(const shader_descriptor_t& desc, const std::v
 		.program = 0,
 		.vao = 0,
 		.vbo = 0,
-		.vbuffer_size = 0,
-		.ibuffer_size = 0,
+		.ibo = 0,
 		.vbuffer_capacity = SHADER_VERTEX_PREALLOCATION_DEFAULT,
 		.ibuffer_capacity = SHADER_INDEX_PREALLOCATION_DEFAULT,
+		.vallocator = offset_allocator_c(SHADER_VERTEX_PREALLOCATION_DEFAULT),
+		.iallocator = offset_allocator_c(SHADER_INDEX_PREALLOCATION_DEFAULT),
+		.vertex_geometries = {},
+		.index_geometries = {},
+		.vertices_packed = false,
+		.indices_packed = false,
 		.inputs = desc.inputs,
 		.uniforms = desc.uniforms,
 		.texture_attachments = desc.texture_attachments,
+		.uniform_locations = {},
+		.texture_attachment_ids = {},
 	};
 
 	usize stride = 0;
@@ -466,24 +1580,21 @@ shader_t renderer_c::create_shader(const shader_descriptor_t& desc, const std::v
 	shader_internal.vertex_size = stride;
 
 	glGenVertexArrays(1, &shader_internal.vao);
-	glBindVertexArray(shader_internal.vao);
+	this->internal->gl.bind_vertex_array(shader_internal.vao);
 
 	glGenBuffers(1, &shader_internal.vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, shader_internal.vbo);
+	this->internal->gl.bind_buffer(GL_ARRAY_BUFFER, shader_internal.vbo);
 	glBufferData(GL_ARRAY_BUFFER, shader_internal.vbuffer_capacity * shader_internal.vertex_size, nullptr, GL_DYNAMIC_DRAW);
 
 	glGenBuffers(1, &shader_internal.ibo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shader_internal.ibo);
+	this->internal->gl.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, shader_internal.ibo);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, shader_internal.ibuffer_capacity * sizeof(u32), nullptr, GL_DYNAMIC_DRAW);
 
-	usize offset = 0;
-	for (usize i = 0; i < desc.inputs.size(); i++) {
-		glVertexAttribPointer(i, desc.inputs[i].size, shader_data_type_to_gl(desc.inputs[i].type), GL_FALSE, stride, (void*)offset);
-		glEnableVertexAttribArray(i);
-		offset += desc.inputs[i].size * shader_data_type_size(desc.inputs[i].type);
-	}
+	shader_internal_bind_inputs(shader_internal);
+
+	this->internal->gl.bind_vertex_array(0);
 
-	glBindVertexArray(0);
+	shader_internal_bind_draw_records(this->internal->gl, shader_internal, this->internal->draw_data.record_ids);
 
 	shader_internal.program = glCreateProgram();
 	for (usize i = 0; i < stages.size(); i++) {
@@ -496,7 +1607,7 @@ shader_t renderer_c::create_shader(const shader_descriptor_t& desc, const std::v
 	if (!success) {
 		GLchar info_log[512];
 		glGetProgramInfoLog(shader_internal.program, 512, NULL, info_log);
-		std::cerr << info_log << '\n';
+		LOG_ERROR("%s", info_log);
 		throw std::runtime_error(info_log);
 	}
 
@@ -504,32 +1615,49 @@ shader_t renderer_c::create_shader(const shader_descriptor_t& desc, const std::v
 		glDetachShader(shader_internal.program, stages[i]);
 	}
 
+	shader_internal_resolve_uniforms(shader_internal);
+
+	/* engine wide bindings, glsl 410 has no layout(binding) */
+	GLuint frame_block = glGetUniformBlockIndex(shader_internal.program, "frame_data");
+	if (frame_block != GL_INVALID_INDEX) {
+		glUniformBlockBinding(shader_internal.program, frame_block, FRAME_DATA_BINDING);
+	}
+
+	const shader_uniform_location_t* draw_data = shader_internal_find_uniform(shader_internal, UNIFORM_DRAW_DATA);
+	if (draw_data != nullptr) {
+		this->internal->gl.use_program(shader_internal.program);
+		glUniform1i(draw_data->location, DRAW_DATA_TEXTURE_UNIT);
+	}
+
 	for (usize u = 0; u < desc.uniforms.size(); u++) {
-		if (!internal_shader_uniform_exists(shader_internal, desc.uniforms[u].name)) {
+		if (shader_internal_find_uniform(shader_internal, uniform_id(desc.uniforms[u].name)) == nullptr) {
 			std::string error = "Uniform not found ";
 			error += desc.uniforms[u].name;
-			std::cerr << error << '\n';
-			throw new std::runtime_error(error);
+			LOG_ERROR("%s", error.c_str());
+			throw std::runtime_error(error);
 		}
 	}
 
 	for (usize u = 0; u < desc.texture_attachments.size(); u++) {
-		if (!internal_shader_uniform_exists(shader_internal, desc.texture_attachments[u].associated_uniform)) {
+		if (shader_internal_find_declared_uniform(shader_internal, desc.texture_attachments[u].associated_uniform) == nullptr
+			|| shader_internal_find_uniform(shader_internal, uniform_id(desc.texture_attachments[u].associated_uniform)) == nullptr) {
 			std::string error = "Texture attachment associated uniform not found ";
-			error += desc.uniforms[u].name;
-			std::cerr << error << '\n';
-			throw new std::runtime_error(error);
+			error += desc.texture_attachments[u].associated_uniform;
+			LOG_ERROR("%s", error.c_str());
+			throw std::runtime_error(error);
 		}
 		for (usize i = 0; i < desc.uniforms.size(); i++) {
 			if (std::strcmp(desc.texture_attachments[u].associated_uniform, desc.uniforms[i].name) == 0) {
 				if (desc.uniforms[i].type != shader_data_type::TEXTURE) {
 					std::string error = "Texture attachment associated uniform is not a texture ";
 					error += desc.uniforms[i].name;
-					std::cerr << error << '\n';
-					throw new std::runtime_error(error);
+					LOG_ERROR("%s", error.c_str());
+					throw std::runtime_error(error);
 				}
 			}
 		}
+
+		shader_internal.texture_attachment_ids.push_back(uniform_id(desc.texture_attachments[u].associated_uniform));
 	}
 
 	this->internal->shaders.push_back(shader_internal);
@@ -541,79 +1669,26 @@ s32 renderer_c::shader_uniform(shader_t shader, const std::string& name, void* d
 		return 1;
 	}
 
-	if (this->internal->shaders[shader].uniforms.size() <= 0) {
+	const shader_internal_t& shader_internal = this->internal->shaders[shader];
+	if (shader_internal.uniforms.size() <= 0) {
 		return 2;
 	}
 
-	usize uniform = USIZE_MAX;
-	for (usize i = 0; i < this->internal->shaders[shader].uniforms.size(); i++) {
-		if (name.compare(this->internal->shaders[shader].uniforms[i].name) == 0) {
-			uniform = i;
-			break;
-		}
-	}
-
-	if (uniform == USIZE_MAX) {
+	const shader_uniform_t* uniform = shader_internal_find_declared_uniform(shader_internal, name.c_str());
+	if (uniform == nullptr) {
 		return 3;
 	}
 
-	if (size != this->internal->shaders[shader].uniforms[uniform].size * shader_data_type_size(this->internal->shaders[shader].uniforms[uniform].type)) {
+	if (size != uniform->size * shader_data_type_size(uniform->type)) {
 		return 4;
 	}
 
-	GLint location = glGetUniformLocation(this->internal->shaders[shader].program, name.c_str());
-	if (location == -1) {
+	const shader_uniform_location_t* uniform_location = shader_internal_find_uniform(shader_internal, uniform_id(name.c_str()));
+	if (uniform_location == nullptr) {
 		return 5;
 	}
 
-	usize amount = size / shader_data_type_size(this->internal->shaders[shader].uniforms[uniform].type);
-	switch (this->internal->shaders[shader].uniforms[uniform].type) {
-	case shader_data_type::U32:
-		if (amount == 1) {
-			glUniform1ui(location, reinterpret_cast<u32*>(data)[0]);
-		} else if (amount == 2) {
-			glUniform2ui(location, reinterpret_cast<u32*>(data)[0], reinterpret_cast<u32*>(data)[1]);
-		} else if (amount == 3) {
-			glUniform3ui(location, reinterpret_cast<u32*>(data)[0], reinterpret_cast<u32*>(data)[1], reinterpret_cast<u32*>(data)[2]);
-		} else if (amount == 4) {
-			glUniform4ui(location, reinterpret_cast<u32*>(data)[0], reinterpret_cast<u32*>(data)[1], reinterpret_cast<u32*>(data)[2], reinterpret_cast<u32*>(data)[3]);
-		} else {
-			glUniform1uiv(location, amount, reinterpret_cast<u32*>(data));
-		}
-		break;
-	case shader_data_type::S32:
-		if (amount == 1) {
-			glUniform1i(location, reinterpret_cast<s32*>(data)[0]);
-		} else if (amount == 2) {
-			glUniform2i(location, reinterpret_cast<s32*>(data)[0], reinterpret_cast<s32*>(data)[1]);
-		} else if (amount == 3) {
-			glUniform3i(location, reinterpret_cast<s32*>(data)[0], reinterpret_cast<s32*>(data)[1], reinterpret_cast<s32*>(data)[2]);
-		} else if (amount == 4) {
-			glUniform4i(location, reinterpret_cast<s32*>(data)[0], reinterpret_cast<s32*>(data)[1], reinterpret_cast<s32*>(data)[2], reinterpret_cast<s32*>(data)[3]);
-		} else {
-			glUniform1iv(location, amount, reinterpret_cast<s32*>(data));
-		}
-		break;
-	case shader_data_type::F32:
-		if (amount == 1) {
-			glUniform1f(location, reinterpret_cast<f32*>(data)[0]);
-		} else if (amount == 2) {
-			glUniform2f(location, reinterpret_cast<f32*>(data)[0], reinterpret_cast<f32*>(data)[1]);
-		} else if (amount == 3) {
-			glUniform3f(location, reinterpret_cast<f32*>(data)[0], reinterpret_cast<f32*>(data)[1], reinterpret_cast<f32*>(data)[2]);
-		} else if (amount == 4) {
-			glUniform4f(location, reinterpret_cast<f32*>(data)[0], reinterpret_cast<f32*>(data)[1], reinterpret_cast<f32*>(data)[2], reinterpret_cast<f32*>(data)[3]);
-		} else {
-			glUniform1fv(location, amount, reinterpret_cast<f32*>(data));
-		}
-		break;
-	case shader_data_type::MAT4x4:
-		glUniformMatrix4fv(location, 1, false, reinterpret_cast<f32*>(data));
-		break;
-	default:
-		return 6;
-	}
-
+	gl_uniform(uniform_location->location, uniform->type, size / shader_data_type_size(uniform->type), data);
 	return 0;
 }
 
@@ -626,80 +1701,41 @@ s32 renderer_c::shader_uniform_unsafe(shader_t shader, const std::string& name,
 		return 2;
 	}
 
-	GLint location = glGetUniformLocation(this->internal->shaders[shader].program, name.c_str());
-	if (location == -1) {
+	const shader_uniform_location_t* uniform_location = shader_internal_find_uniform(this->internal->shaders[shader], uniform_id(name.c_str()));
+	if (uniform_location == nullptr) {
 		return 5;
 	}
 
-	usize amount = size / shader_data_type_size(type);
 	switch (type) {
 	case shader_data_type::U32:
-		if (amount == 1) {
-			glUniform1ui(location, reinterpret_cast<u32*>(data)[0]);
-		} else if (amount == 2) {
-			glUniform2ui(location, reinterpret_cast<u32*>(data)[0], reinterpret_cast<u32*>(data)[1]);
-		} else if (amount == 3) {
-			glUniform3ui(location, reinterpret_cast<u32*>(data)[0], reinterpret_cast<u32*>(data)[1], reinterpret_cast<u32*>(data)[2]);
-		} else if (amount == 4) {
-			glUniform4ui(location, reinterpret_cast<u32*>(data)[0], reinterpret_cast<u32*>(data)[1], reinterpret_cast<u32*>(data)[2], reinterpret_cast<u32*>(data)[3]);
-		} else {
-			glUniform1uiv(location, amount, reinterpret_cast<u32*>(data));
-		}
-		break;
 	case shader_data_type::S32:
-		if (amount == 1) {
-			glUniform1i(location, reinterpret_cast<s32*>(data)[0]);
-		} else if (amount == 2) {
-			glUniform2i(location, reinterpret_cast<s32*>(data)[0], reinterpret_cast<s32*>(data)[1]);
-		} else if (amount == 3) {
-			glUniform3i(location, reinterpret_cast<s32*>(data)[0], reinterpret_cast<s32*>(data)[1], reinterpret_cast<s32*>(data)[2]);
-		} else if (amount == 4) {
-			glUniform4i(location, reinterpret_cast<s32*>(data)[0], reinterpret_cast<s32*>(data)[1], reinterpret_cast<s32*>(data)[2], reinterpret_cast<s32*>(data)[3]);
-		} else {
-			glUniform1iv(location, amount, reinterpret_cast<s32*>(data));
-		}
-		break;
-	case shader_data_type::F32:
-		if (amount == 1) {
-			glUniform1f(location, reinterpret_cast<f32*>(data)[0]);
-		} else if (amount == 2) {
-			glUniform2f(location, reinterpret_cast<f32*>(data)[0], reinterpret_cast<f32*>(data)[1]);
-		} else if (amount == 3) {
-			glUniform3f(location, reinterpret_cast<f32*>(data)[0], reinterpret_cast<f32*>(data)[1], reinterpret_cast<f32*>(data)[2]);
-		} else if (amount == 4) {
-			glUniform4f(location, reinterpret_cast<f32*>(data)[0], reinterpret_cast<f32*>(data)[1], reinterpret_cast<f32*>(data)[2], reinterpret_cast<f32*>(data)[3]);
-		} else {
-			glUniform1fv(location, amount, reinterpret_cast<f32*>(data));
-		}
-		break;
+	case shader_data_type::F32:
 	case shader_data_type::MAT4x4:
-		glUniformMatrix4fv(location, 1, false, reinterpret_cast<f32*>(data));
 		break;
 	default:
 		return 6;
 	}
 
+	gl_uniform(uniform_location->location, type, size / shader_data_type_size(type), data);
 	return 0;
 }
 
-static b8 internal_shader_uniform_exists(const shader_internal_t& shader, const std::string& name) {
-	if (shader.uniforms.size() <= 0) {
-		return false;
+s32 renderer_c::shader_uniform(shader_t shader, uniform_id_t uniform, const void* data, usize size) {
+	if (this->internal->shaders.size() <= shader) {
+		return 1;
 	}
 
-	usize uniform = USIZE_MAX;
-	for (usize i = 0; i < shader.uniforms.size(); i++) {
-		if (name.compare(shader.uniforms[i].name) == 0) {
-			s32 location = glGetUniformLocation(shader.program, name.c_str());
-			if (location == -1) {
-				return false;
-			} else {
-				return true;
-			}
-		}
+	const shader_uniform_location_t* uniform_location = shader_internal_find_uniform(this->internal->shaders[shader], uniform);
+	if (uniform_location == nullptr) {
+		return 5;
 	}
 
-	return false;
+	if (size != uniform_location->size * shader_data_type_size(uniform_location->type)) {
+		return 4;
+	}
+
+	gl_uniform(uniform_location->location, uniform_location->type, size / shader_data_type_size(uniform_location->type), data);
+	return 0;
 }
 
 b8 renderer_c::shader_uniform_exists(shader_t shader, const std::string & name) {
@@ -707,7 +1743,9 @@ b8 renderer_c::shader_uniform_exists(shader_t shader, const std::string & name)
 		return false;
 	}
 
-	return internal_shader_uniform_exists(this->internal->shaders[shader], name);
+	const shader_internal_t& shader_internal = this->internal->shaders[shader];
+	return shader_internal_find_declared_uniform(shader_internal, name.c_str()) != nullptr
+		&& shader_internal_find_uniform(shader_internal, uniform_id(name.c_str())) != nullptr;
 }
 
 void renderer_c::shader_use(shader_t shader) {
@@ -715,7 +1753,7 @@ void renderer_c::shader_use(shader_t shader) {
 		throw std::runtime_error("Shader does not exist");
 	}
 
-	glUseProgram(this->internal->shaders[shader].program);
+	this->internal->gl.use_program(this->internal->shaders[shader].program);
 }
 
 mesh_t* renderer_c::create_mesh(const transform_t& transform, const material_t& material, shader_t shader) {
@@ -723,95 +1761,475 @@ mesh_t* renderer_c::create_mesh(const transform_t& transform, const material_t&
 		throw std::runtime_error("Shader does not exist");
 	}
 
+	u32 id = static_cast<u32>(this->internal->meshes.size());
+	if (!this->internal->free_mesh_ids.empty()) {
+		id = this->internal->free_mesh_ids.back();
+		this->internal->free_mesh_ids.pop_back();
+	}
+
 	mesh_internal_t mesh_internal = {
 		.mesh = new mesh_t {
-			.id = static_cast<u32>(this->internal->meshes.size()),
+			.id = id,
 			.transform = transform,
 			.material = material,
 			.shader = shader,
 		},
-		.vindex = 0,
-		.vcount = 0,
-		.iindex = 0,
-		.icount = 0,
+		.geometry = GEOMETRY_NONE,
+		.occluder_model = OCCLUSION_NONE,
+		.is_static = false,
 	};
 
-	this->internal->meshes.push_back(mesh_internal);
+	if (id == this->internal->meshes.size()) {
+		this->internal->meshes.push_back(mesh_internal);
+	} else {
+		this->internal->meshes[id] = mesh_internal;
+	}
+
+	/* ids are recycled, so the cached matrices of a destroyed mesh must not leak into this one */
+	transform_cache_reserve(this->internal->transform_cache, this->internal->meshes.size());
+	this->internal->transform_cache.valid[id] = 0;
+
 	return mesh_internal.mesh;
 }
 
-void renderer_c::mesh_upload(mesh_t* mesh, void* vertex_data, usize vertex_bytesize, u32* index_data, usize index_bytesize) {
-	if (this->internal->meshes.size() <= mesh->id) {
+/* drops the mesh's reference, the ranges are freed with the last one */
+static void mesh_internal_release(renderer_internal_t* internal, mesh_internal_t& mesh_internal) {
+	u32 mesh = mesh_internal.mesh->id;
+	internal->transform_cache.valid[mesh] = 0;
+
+	/* the old geometry's depth may be cached, the new one shows up as a move once it is drawn */
+	if (mesh_internal.is_static && internal->transform_cache.proxies[mesh] != BVH_NONE) {
+		internal->shadow_map.changes.push_back(internal->transform_cache.bounds[mesh]);
+	}
+
+	/* the occluder copy belongs to the old geometry */
+	if (mesh_internal.occluder_model != OCCLUSION_NONE) {
+		internal->occlusion.remove_model(mesh_internal.occluder_model);
+		mesh_internal.occluder_model = OCCLUSION_NONE;
+		internal->occluders.erase(std::find(internal->occluders.begin(), internal->occluders.end(), mesh_internal.mesh->id));
+	}
+
+	if (mesh_internal.geometry == GEOMETRY_NONE) {
+		return;
+	}
+
+	u32 id = mesh_internal.geometry;
+	geometry_internal_t& geometry = internal->geometries[id];
+	mesh_internal.geometry = GEOMETRY_NONE;
+
+	if (--geometry.references > 0) {
+		return;
+	}
+
+	shader_internal_t& shader_internal = internal->shaders[geometry.shader];
+	shader_internal_track(shader_internal, geometry, id, false);
+	shader_internal.vallocator.free(geometry.vindex, geometry.vcount);
+	shader_internal.iallocator.free(geometry.iindex, geometry.icount);
+
+	auto range = internal->geometry_lookup.equal_range(geometry.hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == id) {
+			internal->geometry_lookup.erase(it);
+			break;
+		}
+	}
+
+	geometry = {};
+	std::vector<u8>().swap(internal->geometry_bytes[id]);
+	internal->free_geometry_ids.push_back(id);
+}
+
+static mesh_internal_t& renderer_internal_mesh(renderer_internal_t* internal, const mesh_t* mesh) {
+	if (mesh == nullptr || internal->meshes.size() <= mesh->id || internal->meshes[mesh->id].mesh != mesh) {
 		throw std::runtime_error("Mesh does not exist");
 	}
 
-	mesh_internal_t& mesh_internal = this->internal->meshes[mesh->id];
+	return internal->meshes[mesh->id];
+}
+
+void renderer_c::destroy_mesh(mesh_t* mesh) {
+	mesh_internal_t& mesh_internal = renderer_internal_mesh(this->internal, mesh);
+	mesh_internal_release(this->internal, mesh_internal);
+
+	transform_cache_t& transform_cache = this->internal->transform_cache;
+	if (transform_cache.proxies[mesh->id] != BVH_NONE) {
+		transform_cache.bvh.remove(transform_cache.proxies[mesh->id]);
+		transform_cache.proxies[mesh->id] = BVH_NONE;
+		transform_cache.reshaped = true;
+	}
+
+	this->internal->free_mesh_ids.push_back(mesh->id);
+	mesh_internal.mesh = nullptr;
+	delete mesh;
+}
+
+static u64 hash_bytes(u64 hash, const void* data, usize bytesize) {
+	const u8* bytes = reinterpret_cast<const u8*>(data);
+	for (usize i = 0; i < bytesize; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+void renderer_c::mesh_upload(mesh_t* mesh, void* vertex_data, usize vertex_bytesize, u32* index_data, usize index_bytesize) {
+	PROFILE_ZONE("renderer_c::mesh_upload");
+	mesh_internal_t& mesh_internal = renderer_internal_mesh(this->internal, mesh);
 	if (this->internal->shaders.size() <= mesh_internal.mesh->shader) {
 		throw std::runtime_error("Shader does not exist");
 	}
 
 	shader_internal_t& shader_internal = this->internal->shaders[mesh_internal.mesh->shader];
 
-	std::cout << "mehs :;\n";
-	for (usize i = 0; i < vertex_bytesize / sizeof(float); ++i) {
-		if (i % 8 == 0) {
-			std::cout << '\n';
+	u32 vcount = static_cast<u32>(vertex_bytesize / shader_internal.vertex_size);
+	u32 icount = static_cast<u32>(index_bytesize / sizeof(u32));
+	LOG_DEBUG("mesh %u upload: %u vertices, %u indices", mesh->id, vcount, icount);
+
+	/* re-uploading replaces the previous geometry */
+	mesh_internal_release(this->internal, mesh_internal);
+
+	/* identical data already uploaded for this shader is shared instead of stored again. the hash only finds candidates,
+	 * their bytes are compared so a collision uploads fresh geometry instead of drawing another mesh's */
+	u64 hash = hash_bytes(hash_bytes(14695981039346656037ull, vertex_data, vertex_bytesize), index_data, index_bytesize);
+	auto range = this->internal->geometry_lookup.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		geometry_internal_t& geometry = this->internal->geometries[it->second];
+		if (geometry.shader != mesh_internal.mesh->shader || geometry.vcount != vcount || geometry.icount != icount) {
+			continue;
+		}
+
+		const std::vector<u8>& bytes = this->internal->geometry_bytes[it->second];
+		if (bytes.size() == vertex_bytesize + index_bytesize && std::memcmp(bytes.data(), vertex_data, vertex_bytesize) == 0 &&
+			std::memcmp(bytes.data() + vertex_bytesize, index_data, index_bytesize) == 0) {
+			++geometry.references;
+			mesh_internal.geometry = it->second;
+			return;
 		}
-		std::cout << reinterpret_cast<float*>(vertex_data)[i] << ' ';
 	}
 
-	usize vcount = vertex_bytesize / shader_internal.vertex_size;
-	usize icount = index_bytesize / sizeof(u32);
-	usize new_vsize = shader_internal.vbuffer_size + vcount;
-	usize new_isize = shader_internal.ibuffer_size + icount;
+	geometry_internal_t geometry = {
+		.shader = mesh_internal.mesh->shader,
+		.vindex = 0,
+		.vcount = vcount,
+		.iindex = 0,
+		.icount = icount,
+		.references = 1,
+		.hash = hash,
+		.bounds = bounds_unbounded(),
+	};
+
+	/* the first input is the position by convention, anything else can't be culled */
+	if (!shader_internal.inputs.empty() && shader_internal.inputs[0].type == shader_data_type::F32 && shader_internal.inputs[0].size >= 3) {
+		geometry.bounds = bounds_from_positions(vertex_data, shader_internal.vertex_size, vcount);
+	}
+
+	shader_internal_allocate(this->internal->gl, shader_internal, vcount, icount, geometry.vindex, geometry.iindex);
+
+	this->internal->gl.bind_buffer(GL_ARRAY_BUFFER, shader_internal.vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, geometry.vindex * shader_internal.vertex_size, vertex_bytesize, vertex_data);
+
+	/* indices stay mesh-local, draws offset them by vindex through the base vertex */
+	this->internal->gl.bind_buffer(GL_COPY_WRITE_BUFFER, shader_internal.ibo);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, geometry.iindex * sizeof(u32), index_bytesize, index_data);
 
-	if (new_vsize < shader_internal.vbuffer_capacity) {
-		glBindBuffer(GL_ARRAY_BUFFER, shader_internal.vbo);
-		glBufferSubData(GL_ARRAY_BUFFER, shader_internal.vbuffer_size * shader_internal.vertex_size, vertex_bytesize, vertex_data);
+	u32 id = static_cast<u32>(this->internal->geometries.size());
+	if (!this->internal->free_geometry_ids.empty()) {
+		id = this->internal->free_geometry_ids.back();
+		this->internal->free_geometry_ids.pop_back();
+		this->internal->geometries[id] = geometry;
 	} else {
-		std::string error = "Not implemented yet (resizing vbuffer) ";
-		error += __FILE__;
-		error += ":";
-		error += __LINE__;
-		std::cerr << error << '\n';
-		throw new std::runtime_error(error);
+		this->internal->geometries.push_back(geometry);
 	}
 
-	u32* ibo_buffer = new u32[icount];
-	for (usize i = 0; i < icount; i++) {
-		ibo_buffer[i] = index_data[i] + shader_internal.vbuffer_size;
+	this->internal->geometry_bytes.resize(this->internal->geometries.size());
+	std::vector<u8>& bytes = this->internal->geometry_bytes[id];
+	bytes.resize(vertex_bytesize + index_bytesize);
+	std::memcpy(bytes.data(), vertex_data, vertex_bytesize);
+	std::memcpy(bytes.data() + vertex_bytesize, index_data, index_bytesize);
+
+	shader_internal_track(shader_internal, geometry, id, true);
+	this->internal->geometry_lookup.emplace(hash, id);
+	mesh_internal.geometry = id;
+}
+
+void renderer_c::mesh_share_geometry(mesh_t* mesh, const mesh_t* source) {
+	mesh_internal_t& mesh_internal = renderer_internal_mesh(this->internal, mesh);
+	const mesh_internal_t& source_internal = renderer_internal_mesh(this->internal, source);
+	if (mesh->shader != source->shader) {
+		throw std::runtime_error("Shared geometry requires the same shader");
 	}
 
-	if (new_isize < shader_internal.ibuffer_capacity) {
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shader_internal.ibo);
-		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, shader_internal.ibuffer_size * sizeof(u32), index_bytesize, ibo_buffer);
-	} else {
-		std::string error = "Not implemented yet (resizing ibuffer) ";
-		error += __FILE__;
-		error += ":";
-		error += __LINE__;
-		std::cerr << error << '\n';
-		throw new std::runtime_error(error);
+	if (&mesh_internal == &source_internal) {
+		return;
+	}
+
+	u32 geometry = source_internal.geometry;
+	if (geometry != GEOMETRY_NONE) {
+		++this->internal->geometries[geometry].references;
+	}
+
+	mesh_internal_release(this->internal, mesh_internal);
+	mesh_internal.geometry = geometry;
+}
+
+static usize shader_internal_compact(gl_state_c& gl, shader_internal_t& shader_internal, std::vector<geometry_internal_t>& geometries, usize byte_budget) {
+	usize moved = 0;
+
+	/* move the highest allocations into the best fitting hole below them */
+	for (usize pass = 0; pass < 2 && moved < byte_budget; ++pass) {
+		b8 vertices = (pass == 0);
+		offset_allocator_c& allocator = vertices ? shader_internal.vallocator : shader_internal.iallocator;
+		std::map<u32, u32>& owners = vertices ? shader_internal.vertex_geometries : shader_internal.index_geometries;
+		b8& packed = vertices ? shader_internal.vertices_packed : shader_internal.indices_packed;
+		usize element_size = vertices ? shader_internal.vertex_size : sizeof(u32);
+
+		/* no hole below the highest allocation, or nothing above the holes fit into one since the buffer last changed */
+		if (packed || allocator.free_by_offset.empty() || allocator.free_by_offset.begin()->first >= allocator.high_water()) {
+			continue;
+		}
+
+		/* one walk down from the top, a moved allocation only frees space above the ones still to come.
+		 * the next one down is taken before moving, so the walk doesn't come back to what it just moved */
+		usize moved_here = 0;
+		b8 walked = true;
+		b8 more = !owners.empty();
+		auto next = more ? std::prev(owners.end()) : owners.end();
+		while (more) {
+			auto current = next;
+			more = (next != owners.begin());
+			if (more) {
+				--next;
+			}
+
+			/* this one and everything below it sits under the lowest hole */
+			u32 index = current->first;
+			if (allocator.free_by_offset.empty() || index < allocator.free_by_offset.begin()->first) {
+				break;
+			}
+
+			if (moved >= byte_budget) {
+				walked = false;
+				break;
+			}
+
+			u32 id = current->second;
+			geometry_internal_t& geometry = geometries[id];
+			u32 count = vertices ? geometry.vcount : geometry.icount;
+			usize bytesize = count * element_size;
+			/* an allocation bigger than the whole budget may still go alone, otherwise it would block compaction forever */
+			if (moved > 0 && moved + bytesize > byte_budget) {
+				walked = false;
+				continue;
+			}
+
+			u32 target = allocator.allocate_below(count, index);
+			if (target == OFFSET_ALLOCATOR_INVALID) {
+				continue;
+			}
+
+			gl_buffer_move(gl, vertices ? shader_internal.vbo : shader_internal.ibo, index * element_size, target * element_size, bytesize);
+			allocator.free(index, count);
+			if (vertices) {
+				geometry.vindex = target;
+			} else {
+				geometry.iindex = target;
+			}
+
+			owners.erase(current);
+			owners.emplace(target, id);
+			moved += bytesize;
+			moved_here += bytesize;
+		}
+
+		/* a whole walk that moved nothing would find the same next frame */
+		packed = walked && moved_here == 0;
+	}
+
+	return moved;
+}
+
+usize renderer_c::compact(usize byte_budget) {
+	usize moved = 0;
+	for (usize i = 0; i < this->internal->shaders.size() && moved < byte_budget; ++i) {
+		moved += shader_internal_compact(this->internal->gl, this->internal->shaders[i], this->internal->geometries, byte_budget - moved);
+	}
+
+	return moved;
+}
+
+usize renderer_c::transforms_updated() {
+	return this->internal->transform_cache.updated;
+}
+
+void renderer_c::set_frustum_culling(b8 enabled) {
+	this->internal->frustum_culling = enabled;
+}
+
+void renderer_c::set_occlusion_culling(b8 enabled) {
+	this->internal->occlusion_culling = enabled;
+}
+
+void renderer_c::set_static(mesh_t* mesh, b8 is_static) {
+	mesh_internal_t& mesh_internal = renderer_internal_mesh(this->internal, mesh);
+	if (mesh_internal.is_static == is_static) {
+		return;
+	}
+
+	/* either way the set of cached casters changes where the mesh is */
+	mesh_internal.is_static = is_static;
+	if (this->internal->transform_cache.proxies[mesh->id] != BVH_NONE) {
+		this->internal->shadow_map.changes.push_back(this->internal->transform_cache.bounds[mesh->id]);
+	}
+}
+
+void renderer_c::set_occluder(mesh_t* mesh, b8 occluder) {
+	mesh_internal_t& mesh_internal = renderer_internal_mesh(this->internal, mesh);
+	if ((mesh_internal.occluder_model != OCCLUSION_NONE) == occluder) {
+		return;
+	}
+
+	if (!occluder) {
+		this->internal->occlusion.remove_model(mesh_internal.occluder_model);
+		mesh_internal.occluder_model = OCCLUSION_NONE;
+		this->internal->occluders.erase(std::find(this->internal->occluders.begin(), this->internal->occluders.end(), mesh->id));
+		return;
+	}
+
+	if (mesh_internal.geometry == GEOMETRY_NONE) {
+		throw std::runtime_error("Occluder has no geometry");
+	}
+
+	const geometry_internal_t& geometry = this->internal->geometries[mesh_internal.geometry];
+	const shader_internal_t& shader_internal = this->internal->shaders[geometry.shader];
+	if (shader_internal.inputs.empty() || shader_internal.inputs[0].type != shader_data_type::F32 || shader_internal.inputs[0].size < 3) {
+		throw std::runtime_error("Occluder geometry needs positions as its first input");
+	}
+
+	/* read back once, the culler keeps its own copy of the triangles */
+	std::vector<u8> vertices(static_cast<usize>(geometry.vcount) * shader_internal.vertex_size);
+	std::vector<u32> indices(geometry.icount);
+	this->internal->gl.bind_buffer(GL_COPY_READ_BUFFER, shader_internal.vbo);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, static_cast<usize>(geometry.vindex) * shader_internal.vertex_size, vertices.size(), vertices.data());
+	this->internal->gl.bind_buffer(GL_COPY_READ_BUFFER, shader_internal.ibo);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, geometry.iindex * sizeof(u32), indices.size() * sizeof(u32), indices.data());
+
+	std::vector<f32> positions(static_cast<usize>(geometry.vcount) * 3);
+	for (usize i = 0; i < geometry.vcount; i++) {
+		std::memcpy(&positions[i * 3], &vertices[i * shader_internal.vertex_size], sizeof(vec3));
+	}
+
+	mesh_internal.occluder_model = this->internal->occlusion.add_model(positions.data(), geometry.vcount, indices.data(), indices.size());
+	this->internal->occluders.push_back(mesh->id);
+}
+
+cull_stats_t renderer_c::cull_stats() {
+	return this->internal->cull_stats;
+}
+
+u64 renderer_c::draw_allocations() {
+	return this->internal->draw_allocations;
+}
+
+light_cluster_stats_t renderer_c::light_cluster_stats() {
+	return this->internal->light_grid.clusters.stats;
+}
+
+shadow_stats_t renderer_c::shadow_stats() {
+	return this->internal->shadow_map.stats;
+}
+
+void renderer_c::set_dynamic_resolution(b8 enabled, f32 target_ms) {
+	this->internal->dynamic_resolution = enabled;
+	this->internal->resolution = resolution_controller_c(target_ms);
+}
+
+f32 renderer_c::resolution_scale() {
+	return this->internal->dynamic_resolution ? this->internal->resolution.scale : 1.0f;
+}
+
+f32 renderer_c::gpu_frame_ms() {
+	return this->internal->gpu_timer.timing().frame.last_ms;
+}
+
+gpu_timing_t renderer_c::gpu_timing() {
+	return this->internal->gpu_timer.timing();
+}
+
+gbuffer_stats_t renderer_c::gbuffer_stats() {
+	const gbuffer_t& gbuffer = this->internal->gbuffer;
+	u32 bytes_per_pixel = gbuffer_bytes_per_pixel(gbuffer.layout);
+	u64 bytes = static_cast<u64>(gbuffer.width) * gbuffer.height * bytes_per_pixel;
+	return {
+		.layout = gbuffer.layout,
+		.width = gbuffer.width,
+		.height = gbuffer.height,
+		.bytes_per_pixel = bytes_per_pixel,
+		.bytes = bytes,
+		.per_frame = bytes * 2,
+	};
+}
+
+bind_stats_t renderer_c::bind_stats() {
+	return {
+		.draw_calls = this->internal->draw_calls,
+		.state = this->internal->gl.stats,
+		.binds_saved = this->internal->gl.redundant(),
+	};
+}
+
+void renderer_c::query_sphere(const vec3 center, f32 radius, std::vector<mesh_t*>& meshes) {
+	std::vector<u32>& query = this->internal->bvh_results;
+	query.clear();
+	this->internal->transform_cache.bvh.query_sphere(center, radius, query);
+
+	for (usize i = 0; i < query.size(); i++) {
+		mesh_t* mesh = renderer_internal_drawable(this->internal, query[i]);
+		if (mesh != nullptr) {
+			meshes.push_back(mesh);
+		}
+	}
+}
+
+mesh_t* renderer_c::pick(const vec3 origin, const vec3 direction, f32 max_distance) {
+	u32 id = this->internal->transform_cache.bvh.query_ray(origin, direction, max_distance, nullptr);
+	if (id == BVH_NONE) {
+		return nullptr;
 	}
 
-	delete ibo_buffer;
+	return renderer_internal_drawable(this->internal, id);
+}
+
+b8 renderer_c::set_multi_draw_indirect(b8 enabled) {
+	this->internal->use_multi_draw_indirect = enabled && this->internal->multi_draw_elements_indirect != nullptr;
+	return this->internal->use_multi_draw_indirect;
+}
+
+void renderer_c::set_compaction_budget(usize bytes_per_frame) {
+	this->internal->compaction_budget = bytes_per_frame;
+}
+
+shader_buffer_stats_t renderer_c::shader_buffer_stats(shader_t shader) {
+	if (this->internal->shaders.size() <= shader) {
+		throw std::runtime_error("Shader does not exist");
+	}
 
-	mesh_internal.vcount = vcount;
-	mesh_internal.vindex = shader_internal.vbuffer_size;
-	mesh_internal.icount = icount;
-	mesh_internal.iindex = shader_internal.ibuffer_size;
+	shader_buffer_stats_t stats = {
+		.vertices = this->internal->shaders[shader].vallocator.stats(),
+		.indices = this->internal->shaders[shader].iallocator.stats(),
+	};
 
-	shader_internal.vbuffer_size = new_vsize;
-	shader_internal.ibuffer_size = new_isize;
+	return stats;
 }
 
 texture_t renderer_c::create_texture(const texture_descriptor_t & desc, void* data, usize bytesize) {
+	PROFILE_ZONE("renderer_c::create_texture");
 	texture_internal_t texture_internal = {
 		.gl = 0,
 	};
 
 	glGenTextures(1, &texture_internal.gl);
-	glBindTexture(GL_TEXTURE_2D, texture_internal.gl);
+	this->internal->gl.bind_texture(0, GL_TEXTURE_2D, texture_internal.gl);
 	
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture_filter_to_gl_min(desc.filter));
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texture_filter_to_gl_mag(desc.filter));
@@ -820,7 +2238,6 @@ texture_t renderer_c::create_texture(const texture_descriptor_t & desc, void* da
 
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, desc.width, desc.height, 0, texture_format_to_gl(desc.format), GL_UNSIGNED_BYTE, data);
 	glGenerateMipmap(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, 0);
 
 	this->internal->textures.push_back(texture_internal);
 	return static_cast<texture_t>(this->internal->textures.size());
@@ -831,6 +2248,7 @@ light_t* renderer_c::create_light(vec3 position, vec3 color, f32 intensity) {
 		.light = new light_t {
 			.id = static_cast<u32>(this->internal->lights.size()),
 			.intensity = intensity,
+			.casts_shadows = false,
 		}
 	};
 	vec3_dup(light_internal.light->position, position);
@@ -841,180 +2259,566 @@ light_t* renderer_c::create_light(vec3 position, vec3 color, f32 intensity) {
 }
 
 void renderer_c::draw() {
+	PROFILE_ZONE("renderer_c::draw");
+	u64 allocations = allocation_count();
+
+	/* a minimized window has no pixels to draw into */
+	u32 framebuffer_width = this->internal->framebuffer_width;
+	u32 framebuffer_height = this->internal->framebuffer_height;
+	if (framebuffer_width == 0 || framebuffer_height == 0) {
+		return;
+	}
+
+	gbuffer_t& gbuffer = this->internal->gbuffer;
+	if (gbuffer.width != framebuffer_width || gbuffer.height != framebuffer_height) {
+		gbuffer_allocate(this->internal->gl, gbuffer, framebuffer_width, framebuffer_height);
+		this->camera.aspect = static_cast<f32>(framebuffer_width) / framebuffer_height;
+		LOG_DEBUG("g-buffer resized to %ux%u", framebuffer_width, framebuffer_height);
+	}
+
 	this->camera.calculate_matrices();
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthMask(GL_TRUE);
+	/* the deferred passes render at the scale picked from frames that finished since the last draw(), oldest first */
+	gpu_timer_c& gpu_timer = this->internal->gpu_timer;
+	f32 gpu_ms = 0;
+	while (gpu_timer.collect(gpu_ms)) {
+		if (this->internal->dynamic_resolution) {
+			this->internal->resolution.update(gpu_ms);
+		}
+	}
+	gpu_timer.begin_frame();
 
-	/* geometry pass */
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->internal->gbuffer.framebuffer);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	f32 scale = this->internal->dynamic_resolution ? this->internal->resolution.scale : 1.0f;
+	s32 w = std::max(1, static_cast<s32>(std::lround(framebuffer_width * scale)));
+	s32 h = std::max(1, static_cast<s32>(std::lround(framebuffer_height * scale)));
+	b8 upscale = static_cast<u32>(w) != framebuffer_width || static_cast<u32>(h) != framebuffer_height;
+
+	if (this->internal->compaction_budget > 0) {
+		this->compact(this->internal->compaction_budget);
+	}
+
+	frame_data_t frame_data = {};
+	mat4x4_dup(frame_data.vp, this->camera.vp_matrix);
+	frame_data.view_pos[0] = this->camera.transform.position[0];
+	frame_data.view_pos[1] = this->camera.transform.position[1];
+	frame_data.view_pos[2] = this->camera.transform.position[2];
+	frame_data.view_pos[3] = 1;
+	frame_data.time = glfwGetTime();
+	mat4x4_invert(frame_data.inverse_vp, this->camera.vp_matrix);
+
+	/* the stats cover this draw() only, uploads in between frames aren't counted */
+	gl_state_c& gl = this->internal->gl;
+	gl.reset_stats();
+	this->internal->draw_calls = 0;
+
+	gl.bind_buffer(GL_UNIFORM_BUFFER, this->internal->frame_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_data_t), &frame_data, GL_STREAM_DRAW);
+
+	/* every drawable mesh by id, the passes' order comes from the sort keys below */
+	std::vector<u32>& draw_order = this->internal->draw_order;
+	draw_order.clear();
 	for (usize i = 0; i < this->internal->meshes.size(); i++) {
-		mesh_internal_t mesh_internal = this->internal->meshes[i];
-		shader_internal_t shader_internal = this->internal->shaders[mesh_internal.mesh->shader];
+		if (renderer_internal_drawable(this->internal, static_cast<u32>(i)) != nullptr) {
+			draw_order.push_back(static_cast<u32>(i));
+		}
+	}
 
-		if (mesh_internal.vcount == 0 || mesh_internal.vindex + mesh_internal.vcount > shader_internal.vbuffer_capacity) {
+	const std::vector<mesh_internal_t>& meshes = this->internal->meshes;
+	transform_cache_t& transform_cache = this->internal->transform_cache;
+	transform_cache_update(transform_cache, meshes, this->internal->geometries, draw_order, this->internal->shadow_map.changes);
+
+	b8 culling = this->internal->frustum_culling;
+	frustum_t camera_frustum;
+	frustum_from_matrix(camera_frustum, this->camera.vp_matrix);
+
+	/* lights are culled against the camera like meshes, their bounds are binned into clusters further down */
+	light_grid_t& light_grid = this->internal->light_grid;
+	light_grid.bounds.clear();
+	light_grid.bounds.reserve(this->internal->lights.size());
+	for (usize j = 0; j < this->internal->lights.size(); ++j) {
+		light_grid.bounds.push(light_bounds(*this->internal->lights[j].light));
+	}
+
+	std::vector<u32>& lights_visible = this->internal->lights_visible;
+	lights_visible.resize(this->internal->lights.size());
+	if (culling) {
+		lights_visible.resize(frustum_cull(camera_frustum, light_grid.bounds, lights_visible.data()));
+	} else {
+		for (usize j = 0; j < lights_visible.size(); ++j) {
+			lights_visible[j] = static_cast<u32>(j);
+		}
+	}
+
+	/* shadow casting lights reaching into the view ask for a tile sized by how much of the screen they cover.
+	 * the atlas serves the largest first, lights it can't fit go without shadows this frame */
+	shadow_map_t& shadow_map = this->internal->shadow_map;
+	shadow_map.casters.clear();
+	shadow_map.sizes.clear();
+	for (usize i = 0; i < lights_visible.size(); ++i) {
+		u32 j = lights_visible[i];
+		const light_t& light = *this->internal->lights[j].light;
+		if (!light.casts_shadows) {
 			continue;
 		}
 
-		if (mesh_internal.icount == 0 || mesh_internal.iindex + mesh_internal.icount > shader_internal.ibuffer_capacity) {
+		shadow_map.casters.push_back(j);
+		shadow_map.sizes.push_back(shadow_map.atlas.tile_size(light_screen_coverage(this->camera, light_bounds(light))));
+	}
+
+	/* past what the sort key can tell apart, the lights asking for the smallest tiles go without shadows */
+	if (shadow_map.casters.size() > DRAW_KEY_SHADOW_LIGHTS_MAX) {
+		if (!shadow_map.capped) {
+			LOG_WARN("%zu shadow casting lights in view, only the %u asking for the largest tiles get shadows", shadow_map.casters.size(), DRAW_KEY_SHADOW_LIGHTS_MAX);
+			shadow_map.capped = true;
+		}
+
+		std::vector<u32>& priority = shadow_map.priority;
+		priority.resize(shadow_map.casters.size());
+		for (usize i = 0; i < priority.size(); i++) {
+			priority[i] = static_cast<u32>(i);
+		}
+
+		const std::vector<u32>& sizes = shadow_map.sizes;
+		std::nth_element(priority.begin(), priority.begin() + DRAW_KEY_SHADOW_LIGHTS_MAX, priority.end(), [&sizes](u32 a, u32 b) {
+			return sizes[a] > sizes[b] || (sizes[a] == sizes[b] && a < b);
+		});
+		priority.resize(DRAW_KEY_SHADOW_LIGHTS_MAX);
+
+		/* kept in request order, each position moves down or stays, so compacting in place is safe */
+		std::sort(priority.begin(), priority.end());
+		for (usize i = 0; i < priority.size(); i++) {
+			shadow_map.casters[i] = shadow_map.casters[priority[i]];
+			shadow_map.sizes[i] = shadow_map.sizes[priority[i]];
+		}
+		shadow_map.casters.resize(priority.size());
+		shadow_map.sizes.resize(priority.size());
+	}
+
+	shadow_map.tiles.resize(shadow_map.casters.size());
+	shadow_map.atlas.allocate(shadow_map.sizes.data(), shadow_map.sizes.size(), shadow_map.tiles.data());
+
+	/* light matrices are built once per light with a tile, the model matrices once per mesh in the transform cache */
+	std::vector<light_frame_t>& light_table = this->internal->light_table;
+	light_table.clear();
+	shadow_map.data.clear();
+	f32 atlas_texel = 1.0f / shadow_map.atlas.size;
+	for (usize i = 0; i < shadow_map.casters.size(); ++i) {
+		const shadow_tile_t& tile = shadow_map.tiles[i];
+		if (tile.size == 0) {
 			continue;
 		}
 
-		shader_use(shader_internal.shader);
+		light_table.emplace_back();
+		light_frame_t& frame = light_table.back();
+		frame.light = shadow_map.casters[i];
+		frame.tile = tile;
+		light_view_projection(*this->internal->lights[frame.light].light, frame.vp);
+		frustum_from_matrix(frame.frustum, frame.vp);
+
+		shadow_map.data.emplace_back();
+		shadow_data_t& data = shadow_map.data.back();
+		mat4x4_dup(data.vp, frame.vp);
+		data.tile[0] = tile.x * atlas_texel;
+		data.tile[1] = tile.y * atlas_texel;
+		data.tile[2] = tile.size * atlas_texel;
+		data.tile[3] = 0.5f * atlas_texel;
+	}
 
-		mat4x4 m, r, mvp;
-		mat4x4_translate(m, mesh_internal.mesh->transform.position[0], mesh_internal.mesh->transform.position[1], mesh_internal.mesh->transform.position[2]);
-		mat4x4_identity(r);
-		mat4x4_rotate_X(r, r, mesh_internal.mesh->transform.rotation[0] * (M_PI / 180.0));
-		mat4x4_rotate_Y(r, r, mesh_internal.mesh->transform.rotation[1] * (M_PI / 180.0));
-		mat4x4_rotate_Z(r, r, mesh_internal.mesh->transform.rotation[2] * (M_PI / 180.0));
-		shader_uniform_unsafe(mesh_internal.mesh->shader, "unif_model_rotation", &r, sizeof(f32) * 16, shader_data_type::MAT4x4);
-		mat4x4_mul(m, m, r);
-		mat4x4_scale_aniso(m, m, mesh_internal.mesh->transform.scale[0], mesh_internal.mesh->transform.scale[1], mesh_internal.mesh->transform.scale[2]);
+	/* a light's static depth survives while it keeps the same tile and matrix and no static mesh changed in its view.
+	 * a tile is only ever written by its light, so a light holding on to its tile frame after frame keeps its texels */
+	std::vector<shadow_cache_t>& caches = shadow_map.caches;
+	caches.resize(this->internal->lights.size());
+	for (usize j = 0; j < light_table.size(); ++j) {
+		light_frame_t& frame = light_table[j];
+		const shadow_cache_t& cache = caches[frame.light];
+		frame.cached = cache.valid && std::memcmp(&cache.tile, &frame.tile, sizeof(shadow_tile_t)) == 0 && std::memcmp(cache.vp, frame.vp, sizeof(mat4x4)) == 0;
+		for (usize i = 0; frame.cached && i < shadow_map.changes.size(); i++) {
+			frame.cached = !frustum_contains(frame.frustum, shadow_map.changes[i]);
+		}
+	}
 
-		mat4x4_mul(mvp, this->camera.vp_matrix, m);
-		shader_uniform_unsafe(mesh_internal.mesh->shader, "unif_mvp", &mvp, sizeof(f32) * 16, shader_data_type::MAT4x4);
-		shader_uniform_unsafe(mesh_internal.mesh->shader, "unif_model", &m, sizeof(f32) * 16, shader_data_type::MAT4x4);
-		shader_uniform(mesh_internal.mesh->shader, "unif_material_color", &mesh_internal.mesh->material.r, sizeof(f32) * 3);
+	for (usize j = 0; j < caches.size(); ++j) {
+		caches[j].valid = false;
+	}
 
-		for (usize j = 0; j < shader_internal.texture_attachments.size(); j++) {
-			if (j >= mesh_internal.mesh->material.textures.size()) {
-				s32 texture = -1;
-				shader_uniform(mesh_internal.mesh->shader, shader_internal.texture_attachments[j].associated_uniform, &texture, sizeof(s32));
-				continue;
+	/* lights without a tile lose theirs, the space may go to another light */
+	for (usize j = 0; j < light_table.size(); ++j) {
+		shadow_cache_t& cache = caches[light_table[j].light];
+		cache.valid = true;
+		cache.tile = light_table[j].tile;
+		mat4x4_dup(cache.vp, light_table[j].vp);
+	}
+	shadow_map.changes.clear();
+
+	/* every light is binned into the camera's clusters, the light pass only visits its fragment's cluster */
+	light_grid.data.resize(this->internal->lights.size());
+	for (usize j = 0; j < this->internal->lights.size(); ++j) {
+		const light_t& light = *this->internal->lights[j].light;
+		light_data_t& data = light_grid.data[j];
+		data.position_radius[0] = light.position[0];
+		data.position_radius[1] = light.position[1];
+		data.position_radius[2] = light.position[2];
+		data.position_radius[3] = light_grid.bounds.radius[j];
+		data.color_shadow[0] = light.color[0] * light.intensity;
+		data.color_shadow[1] = light.color[1] * light.intensity;
+		data.color_shadow[2] = light.color[2] * light.intensity;
+		data.color_shadow[3] = -1.0f;
+	}
+
+	for (usize j = 0; j < light_table.size(); ++j) {
+		light_grid.data[light_table[j].light].color_shadow[3] = static_cast<f32>(j);
+	}
+
+	light_clusters_c& clusters = light_grid.clusters;
+	clusters.build(light_grid.bounds, this->camera.vp_matrix, this->camera.near, this->camera.far, this->camera.is_ortho);
+	stream_texture_buffer_fill(gl, light_grid.lights, LIGHT_DATA_TEXTURE_UNIT, light_grid.data.data(), light_grid.data.size() * sizeof(light_data_t));
+	stream_texture_buffer_fill(gl, light_grid.offsets, CLUSTER_OFFSETS_TEXTURE_UNIT, clusters.offsets.data(), clusters.offsets.size() * sizeof(u32));
+	stream_texture_buffer_fill(gl, light_grid.indices, CLUSTER_LIGHTS_TEXTURE_UNIT, clusters.indices.data(), clusters.indices.size() * sizeof(u16));
+	stream_texture_buffer_fill(gl, shadow_map.stream, SHADOW_DATA_TEXTURE_UNIT, shadow_map.data.data(), shadow_map.data.size() * sizeof(shadow_data_t));
+
+	/* the geometry pass sees the camera's visible meshes, the depth pass each light's */
+	std::vector<u32>& visible = this->internal->visible;
+	visible.resize(draw_order.size());
+	visible.resize(draw_view_cull(this->internal, camera_frustum, culling, visible.data()));
+
+	/* occluders are rasterized from the camera and every visible mesh's box is tested against them,
+	 * which thins the camera's list for the geometry pass */
+	usize occluded = 0;
+	std::vector<u32>& occluders = this->internal->occluders;
+	if (culling && this->internal->occlusion_culling && !occluders.empty()) {
+		occlusion_culler_c& occlusion = this->internal->occlusion;
+		occlusion.begin(this->camera.vp_matrix);
+		for (usize i = 0; i < occluders.size(); i++) {
+			occlusion.add_occluder(meshes[occluders[i]].occluder_model, transform_cache.matrices[occluders[i]].model);
+		}
+		occlusion.render();
+
+		std::vector<bounds_t>& occlusion_bounds = this->internal->occlusion_bounds;
+		std::vector<u8>& occlusion_results = this->internal->occlusion_results;
+		occlusion_bounds.resize(visible.size());
+		occlusion_results.resize(visible.size());
+		for (usize i = 0; i < visible.size(); i++) {
+			occlusion_bounds[i] = transform_cache.bounds[visible[i]];
+		}
+		occlusion.test(occlusion_bounds.data(), occlusion_bounds.size(), occlusion_results.data());
+
+		usize kept = 0;
+		for (usize i = 0; i < visible.size(); i++) {
+			if (occlusion_results[i] || meshes[visible[i]].occluder_model != OCCLUSION_NONE) {
+				visible[kept++] = visible[i];
+			}
+		}
+
+		occluded = visible.size() - kept;
+		visible.resize(kept);
+	}
+
+	std::vector<u32>& shadow_visible = this->internal->shadow_visible;
+	usize shadow_visible_count = 0;
+	usize static_skipped = 0;
+	shadow_stats_t& shadow_stats = shadow_map.stats;
+	shadow_stats = { static_cast<u32>(light_table.size()), 0, 0, 0 };
+	for (usize j = 0; j < light_table.size(); ++j) {
+		light_frame_t& frame = light_table[j];
+		/* room for this light seeing everything, the lists so far stay put */
+		shadow_visible.resize(shadow_visible_count + draw_order.size());
+		u32* list = shadow_visible.data() + shadow_visible_count;
+		usize count = draw_view_cull(this->internal, frame.frustum, culling, list);
+
+		/* cached lights drop their static casters, the others count them for their static view */
+		usize kept = 0;
+		frame.static_count = 0;
+		for (usize i = 0; i < count; i++) {
+			if (meshes[list[i]].is_static) {
+				if (frame.cached) {
+					continue;
+				}
+
+				++frame.static_count;
 			}
 
-			texture_internal_t texture_internal = this->internal->textures[mesh_internal.mesh->material.textures[j] - 1];
-			glActiveTexture(GL_TEXTURE0 + j);
-			glBindTexture(GL_TEXTURE_2D, texture_internal.gl);
-			shader_uniform(mesh_internal.mesh->shader, shader_internal.texture_attachments[j].associated_uniform, &j, sizeof(s32));
+			list[kept++] = list[i];
+		}
+
+		static_skipped += count - kept;
+		frame.first_visible = static_cast<u32>(shadow_visible_count);
+		frame.visible_count = static_cast<u32>(kept);
+		shadow_visible_count += kept;
+
+		shadow_stats.cached += frame.cached ? 1 : 0;
+		shadow_stats.static_casters += frame.static_count;
+		shadow_stats.dynamic_casters += frame.visible_count - frame.static_count;
+	}
+	shadow_visible.resize(shadow_visible_count);
+
+	cull_stats_t& cull_stats = this->internal->cull_stats;
+	usize frustum_culled = draw_order.size() - visible.size() - occluded;
+	cull_stats.geometry = { static_cast<u32>(visible.size()), static_cast<u32>(frustum_culled), static_cast<u32>(occluded) };
+	cull_stats.shadow_depth = { static_cast<u32>(shadow_visible.size()), static_cast<u32>(draw_order.size() * light_table.size() - shadow_visible.size() - static_skipped), 0 };
+
+	/* the camera's view is 0 and light j's is j + 1, its caster bit splits static from dynamic, so one sort leaves the camera's records first
+	 * and then every light's, static ones ahead of dynamic ones.
+	 * within a view draws go by shader, textures and geometry, so equal geometry forms one instanced batch
+	 * and batches sharing shader and textures form one multi draw, then front to back for early depth rejection.
+	 * the shadow passes ignore materials, so textures are left out of the lights' keys */
+	std::vector<draw_item_t>& draw_items = this->internal->draw_items;
+	std::vector<u64>& draw_keys = this->internal->draw_keys;
+	std::vector<u32>& draw_sorted = this->internal->draw_sorted;
+	draw_items.resize(visible.size() + shadow_visible.size());
+	draw_keys.resize(draw_items.size());
+	draw_sorted.resize(draw_items.size());
+	for (usize i = 0; i < visible.size(); i++) {
+		const mesh_internal_t& mesh_internal = meshes[visible[i]];
+		draw_items[i] = {
+			.mesh = visible[i],
+			.shader = mesh_internal.mesh->shader,
+			.texture_set = texture_set_id(this->internal, mesh_internal.mesh->material.textures),
+			.geometry = mesh_internal.geometry,
+		};
+
+		u64 depth = draw_key_depth(this->camera.vp_matrix, transform_cache.bounds[visible[i]]);
+		draw_keys[i] = draw_key(0, false, draw_items[i].shader, draw_items[i].texture_set, draw_items[i].geometry, depth);
+	}
+
+	for (usize j = 0; j < light_table.size(); ++j) {
+		for (usize i = light_table[j].first_visible; i < light_table[j].first_visible + light_table[j].visible_count; i++) {
+			const mesh_internal_t& mesh_internal = meshes[shadow_visible[i]];
+			draw_item_t& item = draw_items[visible.size() + i];
+			item = {
+				.mesh = shadow_visible[i],
+				.shader = this->internal->geometries[mesh_internal.geometry].shader,
+				.texture_set = 0,
+				.geometry = mesh_internal.geometry,
+			};
+
+			u64 depth = draw_key_depth(light_table[j].vp, transform_cache.bounds[shadow_visible[i]]);
+			draw_keys[visible.size() + i] = draw_key(static_cast<u32>(j + 1), !mesh_internal.is_static, item.shader, 0, item.geometry, depth);
+		}
+	}
+
+	for (usize i = 0; i < draw_sorted.size(); i++) {
+		draw_sorted[i] = static_cast<u32>(i);
+	}
+	radix_sort(draw_keys, draw_sorted, this->internal->draw_key_scratch, this->internal->draw_sorted_scratch);
+
+	draw_data_ring_t& draw_data = this->internal->draw_data;
+	renderer_internal_reserve_draw_data(this->internal, static_cast<u32>(draw_sorted.size()));
+	draw_data_t* records = draw_data_ring_map(gl, draw_data);
+	draw_records_write(records, meshes, transform_cache, draw_items.data(), draw_sorted.data(), draw_sorted.size());
+	draw_data_ring_unmap(gl, draw_data);
+
+	std::vector<draw_batch_t>& batches = this->internal->batches;
+	std::vector<draw_batch_t>& light_batches = this->internal->light_batches;
+	batches.clear();
+	light_batches.clear();
+
+	draw_batches_build(batches, this->internal, draw_sorted.data(), visible.size(), 0, true);
+
+	for (usize j = 0; j < light_table.size(); ++j) {
+		light_frame_t& frame = light_table[j];
+		u32 first_record = static_cast<u32>(visible.size() + frame.first_visible);
+		u32 first_dynamic = first_record + frame.static_count;
+		frame.first_batch = static_cast<u32>(light_batches.size());
+		draw_batches_build(light_batches, this->internal, draw_sorted.data() + first_record, frame.static_count, first_record, false);
+		frame.static_batches = static_cast<u32>(light_batches.size()) - frame.first_batch;
+		draw_batches_build(light_batches, this->internal, draw_sorted.data() + first_dynamic, frame.visible_count - frame.static_count, first_dynamic, false);
+		frame.batch_count = static_cast<u32>(light_batches.size()) - frame.first_batch;
+	}
+
+	std::vector<draw_elements_indirect_command_t>& indirect_commands = this->internal->indirect_commands;
+	if (this->internal->use_multi_draw_indirect) {
+		indirect_commands.clear();
+		for (usize i = 0; i < batches.size(); i++) {
+			indirect_commands.push_back({ batches[i].icount, batches[i].count, batches[i].iindex, static_cast<s32>(batches[i].vindex), draw_data.base + batches[i].first });
 		}
 
-		glBindVertexArray(shader_internal.vao);
-		glBindBuffer(GL_ARRAY_BUFFER, shader_internal.vbo);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shader_internal.ibo);
-		std::cout << "mesh couthns:\n" << (GLsizei) mesh_internal.icount << " " << (const void*) mesh_internal.iindex << '\n';
-		glDrawElements(GL_TRIANGLES, mesh_internal.icount, GL_UNSIGNED_INT, (const void *) (mesh_internal.iindex));
+		gl.bind_buffer(GL_DRAW_INDIRECT_BUFFER, this->internal->indirect_buffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, indirect_commands.size() * sizeof(draw_elements_indirect_command_t), indirect_commands.data(), GL_STREAM_DRAW);
+	}
+
+	gl.bind_texture(DRAW_DATA_TEXTURE_UNIT, GL_TEXTURE_BUFFER, draw_data.texture);
+
+	gl.set_capability(GL_DEPTH_TEST, true);
+	gl.depth_mask(true);
+
+	/* geometry pass */
+	gpu_timer.begin(gpu_pass::GEOMETRY);
+	{
+		PROFILE_ZONE("geometry pass");
+		gl.bind_framebuffer(GL_DRAW_FRAMEBUFFER, gbuffer.framebuffer);
+		gl.viewport(0, 0, w, h);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		const draw_batch_t* previous = nullptr;
+		for (usize i = 0; i < batches.size();) {
+			const draw_batch_t& group = batches[i];
+			const shader_internal_t& shader_internal = this->internal->shaders[group.shader];
+			const texture_set_t& texture_set = this->internal->texture_set_table[group.texture_set];
+
+			usize group_end = i + 1;
+			while (group_end < batches.size() && batches[group_end].shader == group.shader && batches[group_end].texture_set == group.texture_set) {
+				++group_end;
+			}
+
+			gl.use_program(shader_internal.program);
+
+			/* sampler units only depend on how many textures the material has, they are program state */
+			b8 samplers_changed = previous == nullptr || previous->shader != group.shader || this->internal->texture_set_table[previous->texture_set].count != texture_set.count;
+			for (usize j = 0; j < shader_internal.texture_attachments.size(); j++) {
+				s32 unit = (j < texture_set.count) ? static_cast<s32>(j) : -1;
+				if (unit >= 0) {
+					gl.bind_texture(j, GL_TEXTURE_2D, this->internal->texture_set_names[texture_set.first + j]);
+				}
+
+				if (samplers_changed) {
+					shader_uniform(group.shader, shader_internal.texture_attachment_ids[j], &unit, sizeof(s32));
+				}
+			}
+
+			gl.bind_vertex_array(group.vertex_array);
+
+			if (this->internal->use_multi_draw_indirect) {
+				/* base_instance already selects each batch's records */
+				s32 draw_index = 0;
+				shader_uniform(group.shader, UNIFORM_DRAW_INDEX, &draw_index, sizeof(s32));
+				this->internal->multi_draw_elements_indirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*) (i * sizeof(draw_elements_indirect_command_t)), group_end - i, 0);
+				++this->internal->draw_calls;
+			} else {
+				for (usize j = i; j < group_end; j++) {
+					const draw_batch_t& batch = batches[j];
+
+					s32 draw_index = static_cast<s32>(draw_data.base + batch.first);
+					shader_uniform(group.shader, UNIFORM_DRAW_INDEX, &draw_index, sizeof(s32));
+					LOG_TRACE("draw %u indices from %u, %u instances", batch.icount, batch.iindex, batch.count);
+					glDrawElementsInstancedBaseVertex(GL_TRIANGLES, batch.icount, GL_UNSIGNED_INT, (const void*) (batch.iindex * sizeof(u32)), batch.count, batch.vindex);
+					++this->internal->draw_calls;
+				}
+			}
+
+			previous = &group;
+			i = group_end;
+		}
 	}
+	gpu_timer.end();
 
-	/* shadow depth and shade texture pass */
+	/* shadow depth pass, every light draws its casters into its own tile, the viewport clips its triangles to the tile */
+	gpu_timer.begin(gpu_pass::SHADOW_DEPTH);
 	{
-		glClear(GL_DEPTH_BUFFER_BIT);
-		glViewport(0, 0, this->internal->shadow_map.width, this->internal->shadow_map.height);
-		shader_use(this->internal->shadow_map.depth_shader);
-		for (usize i = 0; i < this->internal->meshes.size(); i++) {
-			mesh_internal_t mesh_internal = this->internal->meshes[i];
-			shader_internal_t shader_internal = this->internal->shaders[mesh_internal.mesh->shader];
-
-			for (usize j = 0; j < this->internal->lights.size(); ++j) {
-				mat4x4 light_proj;
-				mat4x4_perspective(light_proj, 45.0f, 1.0f, 0.1f, 25.0f * this->internal->lights[j].light->intensity);
-
-				mat4x4 light_view;
-				vec3 center = { 0, 1, 0 };
-				vec3 up = { 0, 1, 0 };
-				mat4x4_look_at(light_view, this->internal->lights[j].light->position, center, up);
-
-				mat4x4 light_vp;
-				mat4x4_mul(light_vp, light_proj, light_view);
-
-				mat4x4 m;
-				mat4x4_translate(m, mesh_internal.mesh->transform.position[0], mesh_internal.mesh->transform.position[1], mesh_internal.mesh->transform.position[2]);
-				mat4x4_rotate_Y(m, m, mesh_internal.mesh->transform.rotation[1] * (M_PI / 180.0));
-				mat4x4_rotate_Z(m, m, mesh_internal.mesh->transform.rotation[2] * (M_PI / 180.0));
-				mat4x4_rotate_X(m, m, mesh_internal.mesh->transform.rotation[0] * (M_PI / 180.0));
-				mat4x4_scale_aniso(m, m, mesh_internal.mesh->transform.scale[0], mesh_internal.mesh->transform.scale[1], mesh_internal.mesh->transform.scale[2]);
-
-				shader_uniform(this->internal->shadow_map.depth_shader, "unif_light_vp", &light_vp, sizeof(f32) * 16);
-				shader_uniform(this->internal->shadow_map.depth_shader, "unif_model", &m, sizeof(f32) * 16);
-
-				glBindVertexArray(shader_internal.vao);
-				glBindBuffer(GL_ARRAY_BUFFER, shader_internal.vbo);
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shader_internal.ibo);
-				glDrawElements(GL_TRIANGLES, mesh_internal.icount, GL_UNSIGNED_INT, (void*) (mesh_internal.iindex));
+		PROFILE_ZONE("shadow depth pass");
+		const shader_internal_t& depth_shader = this->internal->shaders[shadow_map.depth_shader];
+		gl.use_program(depth_shader.program);
+		auto draw_light_batches = [&](usize first, usize last) {
+			for (usize i = first; i < last; i++) {
+				const draw_batch_t& batch = light_batches[i];
+
+				s32 draw_index = static_cast<s32>(draw_data.base + batch.first);
+				shader_uniform(shadow_map.depth_shader, UNIFORM_DRAW_INDEX, &draw_index, sizeof(s32));
+
+				gl.bind_vertex_array(batch.vertex_array);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, batch.icount, GL_UNSIGNED_INT, (void*) (batch.iindex * sizeof(u32)), batch.count, batch.vindex);
+				++this->internal->draw_calls;
+			}
+		};
+
+		/* lights whose cache went stale redraw their static casters into the static atlas, clearing only their own tile */
+		if (shadow_stats.cached < light_table.size()) {
+			gl.bind_framebuffer(GL_DRAW_FRAMEBUFFER, shadow_map.static_framebuffer);
+			gl.set_capability(GL_SCISSOR_TEST, true);
+			for (usize j = 0; j < light_table.size(); ++j) {
+				const light_frame_t& frame = light_table[j];
+				if (frame.cached) {
+					continue;
+				}
+
+				glScissor(frame.tile.x, frame.tile.y, frame.tile.size, frame.tile.size);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				gl.viewport(frame.tile.x, frame.tile.y, frame.tile.size, frame.tile.size);
+				shader_uniform(shadow_map.depth_shader, UNIFORM_LIGHT_VP, &frame.vp, sizeof(f32) * 16);
+				draw_light_batches(frame.first_batch, frame.first_batch + frame.static_batches);
 			}
+			gl.set_capability(GL_SCISSOR_TEST, false);
+		}
+
+		/* every tile starts as its light's static depth, which also stands in for clearing it */
+		gl.bind_framebuffer(GL_READ_FRAMEBUFFER, shadow_map.static_framebuffer);
+		gl.bind_framebuffer(GL_DRAW_FRAMEBUFFER, shadow_map.framebuffer);
+		for (usize j = 0; j < light_table.size(); ++j) {
+			const shadow_tile_t& tile = light_table[j].tile;
+			glBlitFramebuffer(tile.x, tile.y, tile.x + tile.size, tile.y + tile.size, tile.x, tile.y, tile.x + tile.size, tile.y + tile.size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
 		}
 
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->internal->gbuffer.framebuffer);
-		glDepthMask(GL_FALSE);
-		shader_use(this->internal->shadow_map.shadow_composite);
-		for (usize i = 0; i < this->internal->meshes.size(); i++) {
-			mesh_internal_t mesh_internal = this->internal->meshes[i];
-			shader_internal_t shader_internal = this->internal->shaders[mesh_internal.mesh->shader];
-
-			for (usize j = 0; j < this->internal->lights.size(); ++j) {
-				mat4x4 light_proj;
-				mat4x4_perspective(light_proj, 45.0f, 1.0f, 0.1f, 25.0f * this->internal->lights[j].light->intensity);
-
-				mat4x4 light_view;
-				vec3 center = { 0, 1, 0 };
-				vec3 up = { 0, 1, 0 };
-				mat4x4_look_at(light_view, this->internal->lights[j].light->position, center, up);
-
-				mat4x4 light_vp;
-				mat4x4_mul(light_vp, light_proj, light_view);
-
-				mat4x4 m;
-				mat4x4_translate(m, mesh_internal.mesh->transform.position[0], mesh_internal.mesh->transform.position[1], mesh_internal.mesh->transform.position[2]);
-				mat4x4_rotate_Y(m, m, mesh_internal.mesh->transform.rotation[1] * (M_PI / 180.0));
-				mat4x4_rotate_Z(m, m, mesh_internal.mesh->transform.rotation[2] * (M_PI / 180.0));
-				mat4x4_rotate_X(m, m, mesh_internal.mesh->transform.rotation[0] * (M_PI / 180.0));
-				mat4x4_scale_aniso(m, m, mesh_internal.mesh->transform.scale[0], mesh_internal.mesh->transform.scale[1], mesh_internal.mesh->transform.scale[2]);
-
-				shader_uniform(this->internal->shadow_map.shadow_composite, "unif_light_vp", &light_vp, sizeof(f32) * 16);
-				shader_uniform(this->internal->shadow_map.shadow_composite, "unif_model", &m, sizeof(f32) * 16);
-				shader_uniform(this->internal->shadow_map.shadow_composite, "unif_vp", &this->camera.vp_matrix, sizeof(f32) * 16);
-
-				s32 texture = 0;
-				glActiveTexture(GL_TEXTURE0 + texture);
-				glBindTexture(GL_TEXTURE_2D, this->internal->shadow_map.texture);
-				shader_uniform(this->internal->shadow_map.shadow_composite, "unif_shadow_depth", &texture, sizeof(s32));
-
-				glBindVertexArray(shader_internal.vao);
-				glBindBuffer(GL_ARRAY_BUFFER, shader_internal.vbo);
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shader_internal.ibo);
-				glDrawElements(GL_TRIANGLES, mesh_internal.icount, GL_UNSIGNED_INT, (void*) (mesh_internal.iindex));
+		for (usize j = 0; j < light_table.size(); ++j) {
+			const light_frame_t& frame = light_table[j];
+			if (frame.static_batches == frame.batch_count) {
+				continue;
 			}
+
+			gl.viewport(frame.tile.x, frame.tile.y, frame.tile.size, frame.tile.size);
+			shader_uniform(shadow_map.depth_shader, UNIFORM_LIGHT_VP, &frame.vp, sizeof(f32) * 16);
+			draw_light_batches(frame.first_batch + frame.static_batches, frame.first_batch + frame.batch_count);
 		}
 	}
+	gpu_timer.end();
 
-	int w, h;
-	glfwGetWindowSize(this->window, &w, &h);
-	glViewport(0, 0, w, h);
+	gl.viewport(0, 0, w, h);
 	/* light/shadow pass */
+	gpu_timer.begin(gpu_pass::LIGHT);
 	{
-		glDisable(GL_DEPTH_TEST);
-		glDepthMask(GL_FALSE);
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, this->internal->gbuffer.framebuffer);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		PROFILE_ZONE("light pass");
+		const shader_internal_t& light_pass = this->internal->shaders[this->internal->gbuffer.light_pass];
+		gl.set_capability(GL_DEPTH_TEST, false);
+		gl.depth_mask(false);
+		gl.bind_framebuffer(GL_DRAW_FRAMEBUFFER, upscale ? gbuffer.output_framebuffer : 0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		shader_use(this->internal->gbuffer.light_pass);
+		gl.use_program(light_pass.program);
 		vec2 screen = { static_cast<f32>(w), static_cast<f32>(h) };
-		shader_uniform(this->internal->gbuffer.light_pass, "unif_screen", &screen, sizeof(f32) * 2);
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_SCREEN, &screen, sizeof(f32) * 2);
 		s32 texture = 0;
-		glActiveTexture(GL_TEXTURE0 + texture);
-		glBindTexture(GL_TEXTURE_2D, this->internal->gbuffer.geometry);
-		shader_uniform(this->internal->gbuffer.light_pass, "unif_gbuffer_geometry", &texture, sizeof(texture));
+		gl.bind_texture(texture, GL_TEXTURE_2D, this->internal->gbuffer.depth);
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_GBUFFER_DEPTH, &texture, sizeof(texture));
 		texture = 1;
-		glActiveTexture(GL_TEXTURE0 + texture);
-		glBindTexture(GL_TEXTURE_2D, this->internal->gbuffer.normal);
-		shader_uniform(this->internal->gbuffer.light_pass, "unif_gbuffer_normal", &texture, sizeof(texture));
+		gl.bind_texture(texture, GL_TEXTURE_2D, this->internal->gbuffer.normal);
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_GBUFFER_NORMAL, &texture, sizeof(texture));
 		texture = 2;
-		glActiveTexture(GL_TEXTURE0 + texture);
-		glBindTexture(GL_TEXTURE_2D, this->internal->gbuffer.albedo_specular);
-		shader_uniform(this->internal->gbuffer.light_pass, "unif_gbuffer_albedo_specular", &texture, sizeof(texture));
-		texture = 3;
-		glActiveTexture(GL_TEXTURE0 + texture);
-		glBindTexture(GL_TEXTURE_2D, this->internal->gbuffer.shadows);
-		shader_uniform(this->internal->gbuffer.light_pass, "unif_gbuffer_shadows", &texture, sizeof(texture));
-		shader_uniform_unsafe(this->internal->gbuffer.light_pass, "unif_view_pos", &this->camera.transform.position, sizeof(vec3), shader_data_type::F32);
-		float time = glfwGetTime();
-		shader_uniform_unsafe(this->internal->gbuffer.light_pass, "unif_time", &time, sizeof(f32), shader_data_type::F32);
-
-		glBindVertexArray(this->internal->shaders[this->internal->gbuffer.light_pass].vao);
-		glBindBuffer(GL_ARRAY_BUFFER, this->internal->gbuffer.quad_vbo);
+		gl.bind_texture(texture, GL_TEXTURE_2D, this->internal->gbuffer.albedo_specular);
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_GBUFFER_ALBEDO_SPECULAR, &texture, sizeof(texture));
+		texture = SHADOW_ATLAS_TEXTURE_UNIT;
+		gl.bind_texture(texture, GL_TEXTURE_2D, shadow_map.texture);
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_SHADOW_ATLAS, &texture, sizeof(texture));
+
+		texture = LIGHT_DATA_TEXTURE_UNIT;
+		gl.bind_texture(texture, GL_TEXTURE_BUFFER, light_grid.lights.texture);
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_LIGHT_DATA, &texture, sizeof(texture));
+		texture = CLUSTER_OFFSETS_TEXTURE_UNIT;
+		gl.bind_texture(texture, GL_TEXTURE_BUFFER, light_grid.offsets.texture);
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_CLUSTER_OFFSETS, &texture, sizeof(texture));
+		texture = CLUSTER_LIGHTS_TEXTURE_UNIT;
+		gl.bind_texture(texture, GL_TEXTURE_BUFFER, light_grid.indices.texture);
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_CLUSTER_LIGHTS, &texture, sizeof(texture));
+		texture = SHADOW_DATA_TEXTURE_UNIT;
+		gl.bind_texture(texture, GL_TEXTURE_BUFFER, shadow_map.stream.texture);
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_SHADOW_DATA, &texture, sizeof(texture));
+
+		s32 grid[3] = { LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z };
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_CLUSTER_GRID, grid, sizeof(grid));
+		vec2 cluster_depth = { clusters.depth_scale, clusters.depth_bias };
+		shader_uniform(this->internal->gbuffer.light_pass, UNIFORM_CLUSTER_DEPTH, &cluster_depth, sizeof(cluster_depth));
+
+		gl.bind_vertex_array(light_pass.vao);
 		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		++this->internal->draw_calls;
 	}
+	gpu_timer.end();
+
+	if (upscale) {
+		gpu_timer.begin(gpu_pass::UPSCALE);
+		gl.bind_framebuffer(GL_READ_FRAMEBUFFER, gbuffer.output_framebuffer);
+		gl.bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, w, h, 0, 0, framebuffer_width, framebuffer_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		gpu_timer.end();
+	}
+
+	gpu_timer.end_frame();
+	draw_data_ring_advance(draw_data);
+	this->internal->draw_allocations = allocation_count() - allocations;
 }
@@ -9,6 +9,10 @@
 #include "types.hpp"
 #include "camera.hpp"
 #include "utils.hpp"
+#include "offset_allocator.hpp"
+#include "gl_state.hpp"
+#include "light_clusters.hpp"
+#include "gpu_timer.hpp"
 
 enum class shader_stage_type {
 	VERTEX = 0,
@@ -20,6 +24,18 @@ enum class shader_stage_type {
 typedef u32 texture_t;
 typedef u32 shader_stage_t;
 typedef u32 shader_t;
+typedef u32 uniform_id_t;
+
+/* fnv-1a of the uniform name, constexpr so hot paths can hash names at compile time */
+constexpr uniform_id_t uniform_id(const char* name) {
+	uniform_id_t hash = 2166136261u;
+	while (*name != '\0') {
+		hash ^= static_cast<u8>(*name++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
 
 enum class texture_format {
 	RGB = 0,
@@ -40,6 +56,14 @@ enum class texture_wrap {
 	CLAMP_TO_BORDER,
 };
 
+/* render targets of the geometry pass, both keep depth in DEPTH_COMPONENT32F and normals octahedrally encoded in two channels */
+enum class gbuffer_layout {
+	/* RGBA16F normals and albedo/specular */
+	STANDARD = 0,
+	/* RG16 normals and RGBA8 albedo/specular */
+	COMPACT,
+};
+
 struct texture_descriptor_t {
 	u32 width;
 	u32 height;
@@ -107,11 +131,14 @@ struct mesh_t {
 	shader_t shader;
 };
 
+/* point light, intensity falls off with the squared distance and is cut off where it drops below a small fraction.
+ * only lights casting shadows get a tile of the shadow atlas, off for new lights */
 struct light_t {
 	u32 id;
 	vec3 position;
 	vec3 color;
 	f32 intensity;
+	b8 casts_shadows;
 };
 
 inline const usize shader_data_type_size(shader_data_type type) {
@@ -143,12 +170,59 @@ struct vertex_t {
 	vec3 normal;
 };
 
+/* allocator state of a shader's shared buffers, in vertices and indices */
+struct shader_buffer_stats_t {
+	offset_allocator_stats_t vertices;
+	offset_allocator_stats_t indices;
+};
+
+/* meshes submitted, rejected by frustum culling and hidden by occluders, the shadow depth pass counts once per light */
+struct pass_cull_stats_t {
+	u32 visible;
+	u32 culled;
+	u32 occluded;
+};
+
+struct cull_stats_t {
+	pass_cull_stats_t geometry;
+	pass_cull_stats_t shadow_depth;
+};
+
+/* shadow casting lights with an atlas tile in the last draw(), cached ones reused their static casters' depth.
+ * casters are records drawn into the atlases, static ones only for lights that weren't cached */
+struct shadow_stats_t {
+	u32 lights;
+	u32 cached;
+	u32 static_casters;
+	u32 dynamic_casters;
+};
+
+/* g-buffer size and what it costs, every pixel is written once by the geometry pass and read once by the light pass,
+ * so per_frame is a lower bound that ignores overdraw and depth testing */
+struct gbuffer_stats_t {
+	gbuffer_layout layout;
+	u32 width;
+	u32 height;
+	u32 bytes_per_pixel;
+	u64 bytes;
+	u64 per_frame;
+};
+
+/* gl calls of the last draw(), state has what the state cache issued and dropped per kind of call, binds_saved is every dropped call */
+struct bind_stats_t {
+	u32 draw_calls;
+	gl_state_stats_t state;
+	u32 binds_saved;
+};
+
 struct renderer_c {
 	GLFWwindow* window;
 	camera_c& camera;
 	struct renderer_internal_t * internal;
 
-	renderer_c(GLFWwindow* window, camera_c& camera);
+	/* the window has to outlive the renderer. its framebuffer size callback is chained and put back by the destructor,
+	 * the window user pointer is left alone */
+	renderer_c(GLFWwindow* window, camera_c& camera, gbuffer_layout layout = gbuffer_layout::STANDARD);
 	~renderer_c();
 
 	shader_stage_t create_shader_stage(shader_stage_type type, const char* filepath);
@@ -156,11 +230,59 @@ struct renderer_c {
 	shader_t create_shader(const shader_descriptor_t& descriptor, const std::vector<shader_stage_t>& stages);
 	s32 shader_uniform(shader_t shader, const std::string& name, void* data, usize size);
 	s32 shader_uniform_unsafe(shader_t shader, const std::string& name, void* data, usize size, shader_data_type type);
+	/* no string handling or location queries, size is checked against the type the program reports */
+	s32 shader_uniform(shader_t shader, uniform_id_t uniform, const void* data, usize size);
 	b8 shader_uniform_exists(shader_t shader, const std::string& name);
 	void shader_use(shader_t shader);
 
 	mesh_t* create_mesh(const transform_t& transform, const material_t& material, shader_t shader);
 	void mesh_upload(mesh_t* mesh, void* vertex_data, usize vertex_bytesize, u32* index_data, usize index_bytesize);
+	/* mesh draws source's uploaded geometry, meshes sharing geometry are drawn instanced */
+	void mesh_share_geometry(mesh_t* mesh, const mesh_t* source);
+	void destroy_mesh(mesh_t* mesh);
+
+	/* moves at most byte_budget bytes of mesh data down into free ranges, returns the bytes moved.
+	 * a single geometry bigger than the budget is moved on its own so it can't stall compaction */
+	usize compact(usize byte_budget);
+	/* 0 disables the per-frame compaction pass in draw() */
+	void set_compaction_budget(usize bytes_per_frame);
+	/* one glMultiDrawElementsIndirect per shader and texture set when the context supports it, returns whether it is active */
+	b8 set_multi_draw_indirect(b8 enabled);
+	shader_buffer_stats_t shader_buffer_stats(shader_t shader);
+	/* model matrices rebuilt by the last draw(), static meshes reuse their cached matrix */
+	usize transforms_updated();
+	/* on by default, off submits every mesh to every pass */
+	void set_frustum_culling(b8 enabled);
+	/* occluders are rasterized on the cpu each frame, every other mesh in the camera's view is tested against them.
+	 * the occluder flag is cleared when the mesh's geometry changes */
+	void set_occluder(mesh_t* mesh, b8 occluder);
+	/* on by default, only does anything once there are occluders */
+	void set_occlusion_culling(b8 enabled);
+	/* off for new meshes. a static mesh's shadow depth is cached per light until the light or a static mesh in its view changes,
+	 * moving one is allowed but re-renders the cache of every light that saw it before or after */
+	void set_static(mesh_t* mesh, b8 is_static);
+	/* per pass counts of the last draw() */
+	cull_stats_t cull_stats();
+	bind_stats_t bind_stats();
+	/* lights binned for the light pass by the last draw() */
+	light_cluster_stats_t light_cluster_stats();
+	shadow_stats_t shadow_stats();
+	/* off by default. the deferred passes render at a fraction of the framebuffer picked from measured gpu frame times
+	 * to stay under target_ms, and the result is upscaled to the default framebuffer */
+	void set_dynamic_resolution(b8 enabled, f32 target_ms = 16.0f);
+	/* fraction of the framebuffer's width and height the next draw() renders at */
+	f32 resolution_scale();
+	/* gpu time of the latest frame that came back, the sum of its passes. a few frames behind draw() and 0 before the first */
+	f32 gpu_frame_ms();
+	/* per pass gpu times of the frames that came back so far, rolling over the last GPU_TIMER_HISTORY of each */
+	gpu_timing_t gpu_timing();
+	gbuffer_stats_t gbuffer_stats();
+	/* heap allocations made during the last draw(), 0 once scene sizes settle. only counted in ALLOCATION_COUNTING builds */
+	u64 draw_allocations();
+	/* scene queries against world bounds as of the last draw(), meshes are appended */
+	void query_sphere(const vec3 center, f32 radius, std::vector<mesh_t*>& meshes);
+	/* nearest mesh whose bounding box the ray enters, nullptr when none */
+	mesh_t* pick(const vec3 origin, const vec3 direction, f32 max_distance);
 
 	texture_t create_texture(const texture_descriptor_t& descriptor, void* data, usize bytesize);
 
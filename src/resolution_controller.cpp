@@ -0,0 +1,65 @@
+#include "resolution_controller.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+/* the scale aims a little under the target so noise doesn't push frames over it */
+#define RESOLUTION_HEADROOM 0.95f
+/* smoothed times this close to the aim leave the scale alone */
+#define RESOLUTION_DEADBAND 0.05f
+/* the most the scale moves in one step, as a fraction of itself */
+#define RESOLUTION_MAX_STEP 0.1f
+#define RESOLUTION_SMOOTHING 0.25f
+
+resolution_controller_c::resolution_controller_c(f32 target_ms, f32 min_scale, f32 max_scale) {
+	if (target_ms <= 0 || min_scale <= 0 || min_scale > max_scale || max_scale > 1) {
+		throw std::runtime_error("Resolution controller needs a positive target and 0 < min_scale <= max_scale <= 1");
+	}
+
+	this->target_ms = target_ms;
+	this->min_scale = min_scale;
+	this->max_scale = max_scale;
+	this->reset();
+}
+
+void resolution_controller_c::reset() {
+	this->scale = this->max_scale;
+	this->filtered_ms = 0;
+	this->settle = 0;
+}
+
+f32 resolution_controller_c::update(f32 gpu_ms) {
+	if (!(gpu_ms > 0)) {
+		return this->scale;
+	}
+
+	/* timings still in flight from before the last change were measured at the old scale */
+	if (this->settle > 0) {
+		--this->settle;
+		return this->scale;
+	}
+
+	if (this->filtered_ms == 0) {
+		this->filtered_ms = gpu_ms;
+	} else {
+		this->filtered_ms += (gpu_ms - this->filtered_ms) * RESOLUTION_SMOOTHING;
+	}
+
+	f32 ratio = this->target_ms * RESOLUTION_HEADROOM / this->filtered_ms;
+	if (std::abs(ratio - 1) < RESOLUTION_DEADBAND) {
+		return this->scale;
+	}
+
+	f32 wanted = this->scale * std::sqrt(ratio);
+	wanted = std::clamp(wanted, this->scale * (1 - RESOLUTION_MAX_STEP), this->scale * (1 + RESOLUTION_MAX_STEP));
+	wanted = std::clamp(wanted, this->min_scale, this->max_scale);
+	if (wanted == this->scale) {
+		return this->scale;
+	}
+
+	/* the smoothed time belonged to the old scale, carry it over as the estimate for the new one */
+	this->filtered_ms *= (wanted * wanted) / (this->scale * this->scale);
+	this->scale = wanted;
+	this->settle = RESOLUTION_SETTLE_FRAMES;
+	return this->scale;
+}
@@ -0,0 +1,33 @@
+#ifndef RESOLUTION_CONTROLLER_HPP
+#define RESOLUTION_CONTROLLER_HPP
+
+#include "types.hpp"
+
+#define RESOLUTION_SCALE_MIN_DEFAULT 0.5f
+#define RESOLUTION_SCALE_MAX_DEFAULT 1.0f
+/* frames of timings ignored after a scale change, queries come back a few frames late */
+#define RESOLUTION_SETTLE_FRAMES 4
+
+/* picks the fraction of the framebuffer the deferred passes render at from measured gpu frame times.
+ * gpu cost is taken to grow with the pixel count, so the scale moves by the square root of the time ratio.
+ * no gl, timings come from whoever measures them, so it runs just as well on synthetic ones */
+struct resolution_controller_c {
+	f32 target_ms;
+	f32 min_scale;
+	f32 max_scale;
+	f32 scale;
+	/* smoothed gpu time the scale was last picked from, 0 until the first timing */
+	f32 filtered_ms;
+
+	resolution_controller_c(f32 target_ms = 16.0f, f32 min_scale = RESOLUTION_SCALE_MIN_DEFAULT, f32 max_scale = RESOLUTION_SCALE_MAX_DEFAULT);
+
+	/* one frame's gpu time measured at the current scale, returns the scale for the next frame */
+	f32 update(f32 gpu_ms);
+	/* back to max_scale with no history */
+	void reset();
+
+private:
+	u32 settle;
+};
+
+#endif
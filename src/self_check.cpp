@@ -0,0 +1,354 @@
+#define _USE_MATH_DEFINES
+#include "self_check.hpp"
+#include "occlusion.hpp"
+#include "transform_store.hpp"
+#include "bvh.hpp"
+#include "frustum.hpp"
+#include "resolution_controller.hpp"
+#include "log.hpp"
+#include <linmath.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+/* transforms composed for the throughput numbers, and the leading part of them compared element by element */
+#define SELF_CHECK_TRANSFORMS (1 << 20)
+#define SELF_CHECK_TRANSFORMS_COMPARED (1 << 16)
+/* largest difference between the kernels, relative to the element's size where that is above 1. the scalar kernel rounds
+ * the angle to radians in f32 first, which alone is worth a few 1e-6 at two turns */
+#define SELF_CHECK_TRANSFORM_TOLERANCE 1e-4f
+/* timed runs per measurement, the fastest is reported */
+#define SELF_CHECK_RUNS 3
+/* objects are scattered through a cube this many units on a side, each query is a camera at its centre */
+#define SELF_CHECK_BVH_EXTENT 1000.0f
+#define SELF_CHECK_BVH_QUERIES 8
+/* furthest a moved object goes along each axis, well past the tree's margin */
+#define SELF_CHECK_BVH_MOVE 5.0f
+/* frames each load runs for, enough to settle from either end of the clamp */
+#define SELF_CHECK_RESOLUTION_FRAMES 400
+
+static f64 self_check_seconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bounds_t self_check_box(f32 x, f32 y, f32 z, f32 half_extent) {
+	return {
+		.center = { x, y, z },
+		.extent = { half_extent, half_extent, half_extent },
+		.radius = half_extent * std::sqrt(3.0f),
+	};
+}
+
+/* one 4x4 quad 5 units in front of the camera, boxes fully behind it are culled and everything else is kept */
+b8 self_check_occlusion() {
+	worker_pool_c pool;
+	occlusion_culler_c culler(OCCLUSION_WIDTH_DEFAULT, OCCLUSION_HEIGHT_DEFAULT, &pool);
+
+	f32 positions[] = {
+		-2, -2, -5,
+		2, -2, -5,
+		2, 2, -5,
+		-2, 2, -5,
+	};
+	u32 indices[] = { 0, 1, 2, 2, 3, 0 };
+	u32 model = culler.add_model(positions, 4, indices, 6);
+
+	mat4x4 vp;
+	mat4x4_perspective(vp, static_cast<f32>(M_PI) / 2, static_cast<f32>(OCCLUSION_WIDTH_DEFAULT) / OCCLUSION_HEIGHT_DEFAULT, 0.1f, 100.0f);
+	mat4x4 model_matrix;
+	mat4x4_identity(model_matrix);
+
+	culler.begin(vp);
+	culler.add_occluder(model, &model_matrix[0][0]);
+	culler.render();
+
+	/* the quad covers |x|, |y| <= 0.4 * depth */
+	struct {
+		const char* name;
+		bounds_t bounds;
+		b8 visible;
+	} cases[] = {
+		{ "small box behind the quad", self_check_box(0, 0, -10, 0.5f), false },
+		{ "large box far behind the quad", self_check_box(0, 0, -20, 3.0f), false },
+		{ "box off centre behind the quad", self_check_box(2, -1, -10, 0.5f), false },
+		{ "box in front of the quad", self_check_box(0, 0, -3, 0.5f), true },
+		{ "box behind and beside the quad", self_check_box(8, 0, -10, 0.5f), true },
+		{ "box behind the quad's edge", self_check_box(4, 0, -10, 0.5f), true },
+		{ "box through the quad", self_check_box(0, 0, -5, 1.0f), true },
+		{ "box around the camera", self_check_box(0, 0, 0, 1.0f), true },
+	};
+	usize count = sizeof(cases) / sizeof(cases[0]);
+
+	bounds_t bounds[sizeof(cases) / sizeof(cases[0])];
+	u8 tested[sizeof(cases) / sizeof(cases[0])];
+	for (usize i = 0; i < count; i++) {
+		bounds[i] = cases[i].bounds;
+	}
+	culler.test(bounds, count, tested);
+
+	b8 passed = true;
+	for (usize i = 0; i < count; i++) {
+		b8 visible = culler.visible(cases[i].bounds);
+		if (visible != cases[i].visible || (tested[i] != 0) != visible) {
+			LOG_ERROR("occlusion check: %s is %s by visible() and %s by test(), expected %s", cases[i].name, visible ? "visible" : "culled", tested[i] ? "visible" : "culled", cases[i].visible ? "visible" : "culled");
+			passed = false;
+		}
+	}
+
+	LOG_INFO("occlusion check: %zu boxes against one occluder, %s", count, passed ? "passed" : "failed");
+	return passed;
+}
+
+static void self_check_transform_fill(transform_store_c& store, usize count) {
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<f32> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<f32> rotation(-720.0f, 720.0f);
+	std::uniform_real_distribution<f32> scale(0.01f, 10.0f);
+
+	store.clear();
+	store.reserve(count);
+	for (usize i = 0; i < count; i++) {
+		transform_t transform = {
+			.position = { position(random), position(random), position(random) },
+			.rotation = { rotation(random), rotation(random), rotation(random) },
+			.scale = { scale(random), scale(random), scale(random) },
+		};
+		store.push(transform);
+	}
+}
+
+/* the vector kernel against the scalar one on the same inputs, angles span two turns either way */
+b8 self_check_transforms() {
+	transform_store_c store;
+	self_check_transform_fill(store, SELF_CHECK_TRANSFORMS);
+	std::vector<transform_matrices_t> out(SELF_CHECK_TRANSFORMS);
+
+	f64 vector_seconds = 1e30;
+	f64 scalar_seconds = 1e30;
+	for (usize run = 0; run < SELF_CHECK_RUNS; run++) {
+		auto start = std::chrono::steady_clock::now();
+		store.compose(out.data(), nullptr);
+		vector_seconds = std::min(vector_seconds, self_check_seconds(start));
+
+		start = std::chrono::steady_clock::now();
+		store.compose_scalar(out.data(), nullptr);
+		scalar_seconds = std::min(scalar_seconds, self_check_seconds(start));
+	}
+
+	self_check_transform_fill(store, SELF_CHECK_TRANSFORMS_COMPARED);
+	std::vector<transform_matrices_t> vector(SELF_CHECK_TRANSFORMS_COMPARED);
+	std::vector<transform_matrices_t> scalar(SELF_CHECK_TRANSFORMS_COMPARED);
+	store.compose(vector.data(), nullptr);
+	store.compose_scalar(scalar.data(), nullptr);
+
+	f32 max_error = 0;
+	for (usize i = 0; i < SELF_CHECK_TRANSFORMS_COMPARED; i++) {
+		for (usize e = 0; e < 16; e++) {
+			max_error = std::max(max_error, std::fabs(vector[i].model[e] - scalar[i].model[e]) / std::max(1.0f, std::fabs(scalar[i].model[e])));
+			max_error = std::max(max_error, std::fabs(vector[i].rotation[e] - scalar[i].rotation[e]));
+		}
+	}
+
+	b8 passed = max_error <= SELF_CHECK_TRANSFORM_TOLERANCE;
+	LOG_INFO("transform check: %s kernel %.1f M matrices/s, scalar %.1f M matrices/s over %d transforms", transform_store_c::kernel(), SELF_CHECK_TRANSFORMS / vector_seconds / 1e6, SELF_CHECK_TRANSFORMS / scalar_seconds / 1e6, SELF_CHECK_TRANSFORMS);
+	if (passed) {
+		LOG_INFO("transform check: max error %g over %d transforms, passed", max_error, SELF_CHECK_TRANSFORMS_COMPARED);
+	} else {
+		LOG_ERROR("transform check: max error %g over %d transforms is above %g", max_error, SELF_CHECK_TRANSFORMS_COMPARED, SELF_CHECK_TRANSFORM_TOLERANCE);
+	}
+
+	return passed;
+}
+
+/* a camera at the centre of the cube looking around it, one direction per query */
+static void self_check_bvh_frustum(usize query, frustum_t& frustum) {
+	f32 angle = static_cast<f32>(query) * 2 * static_cast<f32>(M_PI) / SELF_CHECK_BVH_QUERIES;
+	vec3 eye = { 0, 0, 0 };
+	vec3 center = { std::sin(angle), 0.3f * std::cos(angle * 3), -std::cos(angle) };
+	vec3 up = { 0, 1, 0 };
+	mat4x4 view, projection, vp;
+	mat4x4_look_at(view, eye, center, up);
+	mat4x4_perspective(projection, static_cast<f32>(M_PI) / 3, 16.0f / 9.0f, 0.1f, SELF_CHECK_BVH_EXTENT * 0.4f);
+	mat4x4_mul(vp, projection, view);
+	frustum_from_matrix(frustum, vp);
+}
+
+/* expected is every object frustum_contains keeps, returns whether the query found exactly those */
+static b8 self_check_bvh_matches(bvh_c& bvh, const std::vector<bounds_t>& bounds, const frustum_t& frustum, std::vector<u32>& found, std::vector<u32>& expected) {
+	found.clear();
+	bvh.query_frustum(frustum, found);
+
+	expected.clear();
+	for (usize i = 0; i < bounds.size(); i++) {
+		if (frustum_contains(frustum, bounds[i])) {
+			expected.push_back(static_cast<u32>(i));
+		}
+	}
+
+	std::sort(found.begin(), found.end());
+	return found == expected;
+}
+
+/* the bvh's frustum query against testing every object, at three scene sizes. each query has to report exactly the objects
+ * frustum_contains keeps, before and after a tenth of the objects move, and is timed against frustum_cull, the linear path
+ * the renderer takes on frames the tree changes shape. the renderer queries the bvh on every other frame, so the check fails
+ * when it loses on the largest scene */
+b8 self_check_bvh() {
+	const usize counts[] = { 10000, 100000, 1000000 };
+
+	b8 passed = true;
+	std::mt19937 random(4321);
+	for (usize count : counts) {
+		std::uniform_real_distribution<f32> position(-SELF_CHECK_BVH_EXTENT * 0.5f, SELF_CHECK_BVH_EXTENT * 0.5f);
+		std::uniform_real_distribution<f32> size(0.1f, 2.0f);
+
+		std::vector<bounds_t> bounds(count);
+		bounds_store_c store;
+		store.reserve(count);
+		for (usize i = 0; i < count; i++) {
+			bounds[i] = {
+				.center = { position(random), position(random), position(random) },
+				.extent = { size(random), size(random), size(random) },
+				.radius = 0,
+			};
+			bounds[i].radius = vec3_len(bounds[i].extent);
+			store.push(bounds[i]);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		bvh_c bvh;
+		std::vector<u32> proxies(count);
+		for (usize i = 0; i < count; i++) {
+			proxies[i] = bvh.insert(bounds[i], static_cast<u32>(i));
+		}
+		f64 build_seconds = self_check_seconds(start);
+
+		start = std::chrono::steady_clock::now();
+		bvh.flatten();
+		f64 flatten_seconds = self_check_seconds(start);
+
+		std::vector<u32> found;
+		std::vector<u32> expected;
+		std::vector<u32> linear(count);
+		f64 bvh_seconds = 0;
+		f64 linear_seconds = 0;
+		usize visible = 0;
+		usize mismatches = 0;
+		for (usize q = 0; q < SELF_CHECK_BVH_QUERIES; q++) {
+			frustum_t frustum;
+			self_check_bvh_frustum(q, frustum);
+
+			f64 best = 1e30;
+			for (usize run = 0; run < SELF_CHECK_RUNS; run++) {
+				found.clear();
+				start = std::chrono::steady_clock::now();
+				bvh.query_frustum(frustum, found);
+				best = std::min(best, self_check_seconds(start));
+			}
+			bvh_seconds += best;
+
+			best = 1e30;
+			for (usize run = 0; run < SELF_CHECK_RUNS; run++) {
+				start = std::chrono::steady_clock::now();
+				frustum_cull(frustum, store, linear.data());
+				best = std::min(best, self_check_seconds(start));
+			}
+			linear_seconds += best;
+
+			if (!self_check_bvh_matches(bvh, bounds, frustum, found, expected)) {
+				++mismatches;
+				LOG_ERROR("bvh check: query %zu over %zu objects found %zu, testing every object found %zu", q, count, found.size(), expected.size());
+			}
+			visible += expected.size();
+		}
+
+		/* most of these leave their grown box, which grows the flattened boxes above them instead of flattening again */
+		std::uniform_real_distribution<f32> offset(-SELF_CHECK_BVH_MOVE, SELF_CHECK_BVH_MOVE);
+		for (usize i = 0; i < count; i += 10) {
+			for (usize c = 0; c < 3; c++) {
+				bounds[i].center[c] += offset(random);
+			}
+			bvh.update(proxies[i], bounds[i]);
+		}
+
+		for (usize q = 0; q < SELF_CHECK_BVH_QUERIES; q++) {
+			frustum_t frustum;
+			self_check_bvh_frustum(q, frustum);
+			if (!self_check_bvh_matches(bvh, bounds, frustum, found, expected)) {
+				++mismatches;
+				LOG_ERROR("bvh check: query %zu over %zu objects found %zu after moving, testing every object found %zu", q, count, found.size(), expected.size());
+			}
+		}
+
+		passed = passed && mismatches == 0;
+		LOG_INFO("bvh check: %zu objects, built in %.1f ms, flattened in %.2f ms, %zu visible per query, bvh %.3f ms, linear %.3f ms per query (%.1fx)", count, build_seconds * 1e3, flatten_seconds * 1e3,
+			visible / SELF_CHECK_BVH_QUERIES, bvh_seconds * 1e3 / SELF_CHECK_BVH_QUERIES, linear_seconds * 1e3 / SELF_CHECK_BVH_QUERIES, linear_seconds / bvh_seconds);
+		if (count == counts[sizeof(counts) / sizeof(counts[0]) - 1] && bvh_seconds > linear_seconds) {
+			LOG_ERROR("bvh check: queries over %zu objects are slower than testing every object", count);
+			passed = false;
+		}
+	}
+
+	LOG_INFO("bvh check: %s", passed ? "passed" : "failed");
+	return passed;
+}
+
+/* runs the controller for SELF_CHECK_RESOLUTION_FRAMES frames of a gpu that takes full_ms at full resolution and scales
+ * with the pixel count. false when a scale it picked left the clamp */
+static b8 self_check_resolution_load(resolution_controller_c& controller, f32 full_ms, std::mt19937& random) {
+	std::uniform_real_distribution<f32> noise(0.97f, 1.03f);
+	b8 clamped = true;
+	for (u32 frame = 0; frame < SELF_CHECK_RESOLUTION_FRAMES; frame++) {
+		f32 scale = controller.update(full_ms * controller.scale * controller.scale * noise(random));
+		if (scale < controller.min_scale || scale > controller.max_scale) {
+			LOG_ERROR("resolution check: scale %.3f picked at %.1f ms is outside [%.2f, %.2f]", scale, full_ms, controller.min_scale, controller.max_scale);
+			clamped = false;
+		}
+	}
+
+	return clamped;
+}
+
+/* synthetic frame times against a 16 ms target: over budget the scale has to come down until frames fit, under budget go
+ * back up to the top of the clamp, and a load no scale can fit has to stop at the bottom of it */
+b8 self_check_resolution() {
+	resolution_controller_c controller(16.0f, RESOLUTION_SCALE_MIN_DEFAULT, RESOLUTION_SCALE_MAX_DEFAULT);
+	std::mt19937 random(99);
+	b8 passed = true;
+
+	passed = self_check_resolution_load(controller, 30.0f, random) && passed;
+	f32 heavy = controller.scale;
+	f32 heavy_ms = 30.0f * heavy * heavy;
+	if (!(heavy < controller.max_scale) || heavy_ms > controller.target_ms) {
+		LOG_ERROR("resolution check: 30 ms at full resolution settled at scale %.3f, %.1f ms against a %.1f ms target", heavy, heavy_ms, controller.target_ms);
+		passed = false;
+	}
+
+	passed = self_check_resolution_load(controller, 8.0f, random) && passed;
+	f32 light = controller.scale;
+	if (!(light > heavy) || light != controller.max_scale) {
+		LOG_ERROR("resolution check: 8 ms at full resolution settled at scale %.3f, expected %.2f", light, controller.max_scale);
+		passed = false;
+	}
+
+	passed = self_check_resolution_load(controller, 200.0f, random) && passed;
+	f32 overloaded = controller.scale;
+	if (overloaded != controller.min_scale) {
+		LOG_ERROR("resolution check: 200 ms at full resolution settled at scale %.3f, expected %.2f", overloaded, controller.min_scale);
+		passed = false;
+	}
+
+	LOG_INFO("resolution check: scale %.3f at 30 ms (%.1f ms a frame), %.3f at 8 ms, %.3f at 200 ms, %s", heavy, heavy_ms, light, overloaded, passed ? "passed" : "failed");
+	return passed;
+}
+
+b8 self_check_run() {
+	b8 passed = true;
+	passed = self_check_transforms() && passed;
+	passed = self_check_bvh() && passed;
+	passed = self_check_occlusion() && passed;
+	passed = self_check_resolution() && passed;
+	return passed;
+}
@@ -0,0 +1,19 @@
+#ifndef SELF_CHECK_HPP
+#define SELF_CHECK_HPP
+
+#include "types.hpp"
+
+/* headless checks of the cpu-side modules against known answers or slower reference code, no gl or window involved.
+ * each logs what it measured and returns whether it passed */
+/* the vector transform kernel against the scalar one, reports both kernels' throughput */
+b8 self_check_transforms();
+/* the bvh's frustum query against testing every object, results have to match and both are timed */
+b8 self_check_bvh();
+b8 self_check_occlusion();
+/* synthetic gpu timings over and under budget, the scale has to go down, back up and never leave its clamp */
+b8 self_check_resolution();
+
+/* every check above, main runs this for --self-check and exits non-zero when it returns false */
+b8 self_check_run();
+
+#endif
@@ -0,0 +1,81 @@
+#include "shadow_atlas.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+static b8 power_of_two(u32 value) {
+	return value != 0 && (value & (value - 1)) == 0;
+}
+
+static u32 power_of_two_floor(u32 value) {
+	u32 result = 1;
+	while (result * 2 <= value) {
+		result *= 2;
+	}
+
+	return result;
+}
+
+/* every other bit of the morton index */
+static u32 morton_compact(u32 bits) {
+	bits &= 0x55555555;
+	bits = (bits | (bits >> 1)) & 0x33333333;
+	bits = (bits | (bits >> 2)) & 0x0f0f0f0f;
+	bits = (bits | (bits >> 4)) & 0x00ff00ff;
+	bits = (bits | (bits >> 8)) & 0x0000ffff;
+	return bits;
+}
+
+shadow_atlas_c::shadow_atlas_c(u32 size, u32 tile_max, u32 tile_min) {
+	if (!power_of_two(size) || !power_of_two(tile_max) || !power_of_two(tile_min) || tile_min > tile_max || tile_max > size) {
+		throw std::runtime_error("Shadow atlas sizes must be powers of two with tile_min <= tile_max <= size");
+	}
+
+	this->size = size;
+	this->tile_max = tile_max;
+	this->tile_min = tile_min;
+}
+
+u32 shadow_atlas_c::tile_size(f32 coverage) const {
+	f32 texels = std::clamp(coverage, 0.0f, 1.0f) * this->tile_max;
+	return std::max(this->tile_min, power_of_two_floor(static_cast<u32>(texels)));
+}
+
+void shadow_atlas_c::allocate(const u32* sizes, usize count, shadow_tile_t* tiles) {
+	this->order.resize(count);
+	for (usize i = 0; i < count; i++) {
+		this->order[i] = static_cast<u32>(i);
+	}
+
+	/* equal sizes keep request order so equally important lights keep their order from frame to frame.
+	 * the index tie-break gives std::sort that order without the buffer std::stable_sort allocates */
+	std::sort(this->order.begin(), this->order.end(), [sizes](u32 a, u32 b) {
+		return sizes[a] > sizes[b] || (sizes[a] == sizes[b] && a < b);
+	});
+
+	u32 cells_side = this->size / this->tile_min;
+	u64 cells = static_cast<u64>(cells_side) * cells_side;
+	u64 cursor = 0;
+	for (usize i = 0; i < count; i++) {
+		u32 request = this->order[i];
+		u32 size = std::clamp(power_of_two_floor(std::max(sizes[request], 1u)), this->tile_min, this->tile_max);
+
+		/* sizes only go down, so the cursor is always aligned to the current tile */
+		u64 span = static_cast<u64>(size / this->tile_min) * (size / this->tile_min);
+		while (cursor + span > cells && size > this->tile_min) {
+			size /= 2;
+			span /= 4;
+		}
+
+		if (cursor + span > cells) {
+			tiles[request] = { 0, 0, 0 };
+			continue;
+		}
+
+		tiles[request] = {
+			.x = morton_compact(static_cast<u32>(cursor)) * this->tile_min,
+			.y = morton_compact(static_cast<u32>(cursor >> 1)) * this->tile_min,
+			.size = size,
+		};
+		cursor += span;
+	}
+}
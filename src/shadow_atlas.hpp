@@ -0,0 +1,39 @@
+#ifndef SHADOW_ATLAS_HPP
+#define SHADOW_ATLAS_HPP
+
+#include "types.hpp"
+#include <vector>
+
+#define SHADOW_ATLAS_SIZE_DEFAULT 4096
+#define SHADOW_ATLAS_TILE_MAX_DEFAULT 1024
+#define SHADOW_ATLAS_TILE_MIN_DEFAULT 64
+
+/* texels of the atlas, size 0 when the request got no space */
+struct shadow_tile_t {
+	u32 x;
+	u32 y;
+	u32 size;
+};
+
+/* hands out square power of two tiles of one square atlas, repacked from scratch every allocate().
+ * tiles are placed largest first along a morton curve of min sized cells, so each lands on a free aligned square
+ * and the atlas never fragments. no gl, the renderer owns the texture */
+struct shadow_atlas_c {
+	u32 size;
+	u32 tile_max;
+	u32 tile_min;
+
+	/* all three powers of two, tile_min <= tile_max <= size */
+	shadow_atlas_c(u32 size = SHADOW_ATLAS_SIZE_DEFAULT, u32 tile_max = SHADOW_ATLAS_TILE_MAX_DEFAULT, u32 tile_min = SHADOW_ATLAS_TILE_MIN_DEFAULT);
+
+	/* tile size for a light covering this fraction of the screen's height, more coverage gets more texels */
+	u32 tile_size(f32 coverage) const;
+	/* one tile per requested size, written in request order. when the atlas runs out, later (smaller) requests
+	 * are halved down to tile_min and get size 0 after that */
+	void allocate(const u32* sizes, usize count, shadow_tile_t* tiles);
+
+private:
+	std::vector<u32> order;
+};
+
+#endif
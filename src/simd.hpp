@@ -0,0 +1,80 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include "types.hpp"
+
+/* kernels are written once against these wrappers, vf is as many lanes as the instruction set has.
+ * chosen at compile time, VF_LANES is left undefined when there is no vector path and callers fall back to scalar code */
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX2__)
+typedef __m256 vf;
+typedef __m256i vi;
+#define VF_LANES 8
+#define VF_KERNEL "avx2"
+
+static inline vf vf_set(f32 x) { return _mm256_set1_ps(x); }
+static inline vf vf_load(const f32* p) { return _mm256_load_ps(p); }
+static inline vf vf_loadu(const f32* p) { return _mm256_loadu_ps(p); }
+static inline void vf_storeu(f32* p, vf a) { _mm256_storeu_ps(p, a); }
+static inline vf vf_add(vf a, vf b) { return _mm256_add_ps(a, b); }
+static inline vf vf_sub(vf a, vf b) { return _mm256_sub_ps(a, b); }
+static inline vf vf_mul(vf a, vf b) { return _mm256_mul_ps(a, b); }
+static inline vf vf_div(vf a, vf b) { return _mm256_div_ps(a, b); }
+static inline vf vf_sqrt(vf a) { return _mm256_sqrt_ps(a); }
+static inline vf vf_min(vf a, vf b) { return _mm256_min_ps(a, b); }
+static inline vf vf_max(vf a, vf b) { return _mm256_max_ps(a, b); }
+static inline vf vf_and(vf a, vf b) { return _mm256_and_ps(a, b); }
+static inline vf vf_or(vf a, vf b) { return _mm256_or_ps(a, b); }
+static inline vf vf_xor(vf a, vf b) { return _mm256_xor_ps(a, b); }
+static inline vf vf_less(vf a, vf b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline vf vf_select(vf mask, vf a, vf b) { return _mm256_blendv_ps(b, a, mask); }
+/* one bit per lane, set where the mask lane is set */
+static inline u32 vf_mask_bits(vf mask) { return static_cast<u32>(_mm256_movemask_ps(mask)); }
+static inline vi vf_round_int(vf a) { return _mm256_cvtps_epi32(a); }
+static inline vf vi_to_vf(vi a) { return _mm256_cvtepi32_ps(a); }
+static inline vi vi_set(s32 x) { return _mm256_set1_epi32(x); }
+static inline vi vi_add(vi a, vi b) { return _mm256_add_epi32(a, b); }
+static inline vi vi_and(vi a, vi b) { return _mm256_and_si256(a, b); }
+static inline vi vi_shift_left(vi a, s32 bits) { return _mm256_slli_epi32(a, bits); }
+static inline vf vi_equal(vi a, vi b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+static inline vf vi_bits(vi a) { return _mm256_castsi256_ps(a); }
+#elif defined(__SSE2__)
+typedef __m128 vf;
+typedef __m128i vi;
+#define VF_LANES 4
+#define VF_KERNEL "sse2"
+
+static inline vf vf_set(f32 x) { return _mm_set1_ps(x); }
+static inline vf vf_load(const f32* p) { return _mm_load_ps(p); }
+static inline vf vf_loadu(const f32* p) { return _mm_loadu_ps(p); }
+static inline void vf_storeu(f32* p, vf a) { _mm_storeu_ps(p, a); }
+static inline vf vf_add(vf a, vf b) { return _mm_add_ps(a, b); }
+static inline vf vf_sub(vf a, vf b) { return _mm_sub_ps(a, b); }
+static inline vf vf_mul(vf a, vf b) { return _mm_mul_ps(a, b); }
+static inline vf vf_div(vf a, vf b) { return _mm_div_ps(a, b); }
+static inline vf vf_sqrt(vf a) { return _mm_sqrt_ps(a); }
+static inline vf vf_min(vf a, vf b) { return _mm_min_ps(a, b); }
+static inline vf vf_max(vf a, vf b) { return _mm_max_ps(a, b); }
+static inline vf vf_and(vf a, vf b) { return _mm_and_ps(a, b); }
+static inline vf vf_or(vf a, vf b) { return _mm_or_ps(a, b); }
+static inline vf vf_xor(vf a, vf b) { return _mm_xor_ps(a, b); }
+static inline vf vf_less(vf a, vf b) { return _mm_cmplt_ps(a, b); }
+static inline vf vf_select(vf mask, vf a, vf b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+/* one bit per lane, set where the mask lane is set */
+static inline u32 vf_mask_bits(vf mask) { return static_cast<u32>(_mm_movemask_ps(mask)); }
+static inline vi vf_round_int(vf a) { return _mm_cvtps_epi32(a); }
+static inline vf vi_to_vf(vi a) { return _mm_cvtepi32_ps(a); }
+static inline vi vi_set(s32 x) { return _mm_set1_epi32(x); }
+static inline vi vi_add(vi a, vi b) { return _mm_add_epi32(a, b); }
+static inline vi vi_and(vi a, vi b) { return _mm_and_si128(a, b); }
+static inline vi vi_shift_left(vi a, s32 bits) { return _mm_slli_epi32(a, bits); }
+static inline vf vi_equal(vi a, vi b) { return _mm_castsi128_ps(_mm_cmpeq_epi32(a, b)); }
+static inline vf vi_bits(vi a) { return _mm_castsi128_ps(a); }
+#else
+#define VF_KERNEL "scalar"
+#endif
+
+#endif
@@ -0,0 +1,211 @@
+#include "transform_store.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#define TRANSFORM_STORE_ALIGNMENT 32
+#define TRANSFORM_STORE_COMPONENTS 9
+
+#ifdef VF_LANES
+/* reduces by whole quarter turns in degrees, which is exact for any angle a transform will hold,
+ * then evaluates the cephes minimax polynomials on [-45, 45] degrees */
+static inline void vf_sincos_degrees(vf degrees, vf& sin, vf& cos) {
+	vi quadrant = vf_round_int(vf_mul(degrees, vf_set(1.0f / 90.0f)));
+	vf x = vf_mul(vf_sub(degrees, vf_mul(vi_to_vf(quadrant), vf_set(90.0f))), vf_set(0.017453292519943295f));
+	vf z = vf_mul(x, x);
+
+	vf s = vf_add(vf_mul(vf_set(-1.9515295891e-4f), z), vf_set(8.3321608736e-3f));
+	s = vf_add(vf_mul(s, z), vf_set(-1.6666654611e-1f));
+	s = vf_add(vf_mul(vf_mul(s, z), x), x);
+
+	vf c = vf_add(vf_mul(vf_set(2.443315711809948e-5f), z), vf_set(-1.388731625493765e-3f));
+	c = vf_add(vf_mul(c, z), vf_set(4.166664568298827e-2f));
+	c = vf_add(vf_sub(vf_mul(vf_mul(c, z), z), vf_mul(vf_set(0.5f), z)), vf_set(1.0f));
+
+	/* odd quadrants swap sin and cos, bit 1 of the quadrant (and of quadrant + 1 for cos) flips the sign */
+	vf swap = vi_equal(vi_and(quadrant, vi_set(1)), vi_set(1));
+	vf sin_sign = vi_bits(vi_shift_left(vi_and(quadrant, vi_set(2)), 30));
+	vf cos_sign = vi_bits(vi_shift_left(vi_and(vi_add(quadrant, vi_set(1)), vi_set(2)), 30));
+	sin = vf_xor(vf_select(swap, c, s), sin_sign);
+	cos = vf_xor(vf_select(swap, s, c), cos_sign);
+}
+
+/* transposes one column of every lane out of component vectors, dst[lane] + offset receives (x, y, z, w) */
+static inline void vf_store_column(f32* const* dst, usize offset, usize lanes, vf x, vf y, vf z, vf w) {
+#if defined(__AVX2__)
+	__m128 lx = _mm256_castps256_ps128(x), ly = _mm256_castps256_ps128(y), lz = _mm256_castps256_ps128(z), lw = _mm256_castps256_ps128(w);
+	__m128 hx = _mm256_extractf128_ps(x, 1), hy = _mm256_extractf128_ps(y, 1), hz = _mm256_extractf128_ps(z, 1), hw = _mm256_extractf128_ps(w, 1);
+	_MM_TRANSPOSE4_PS(lx, ly, lz, lw);
+	_MM_TRANSPOSE4_PS(hx, hy, hz, hw);
+
+	__m128 columns[8] = { lx, ly, lz, lw, hx, hy, hz, hw };
+	for (usize i = 0; i < lanes; i++) {
+		_mm_storeu_ps(dst[i] + offset, columns[i]);
+	}
+#else
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+
+	vf columns[4] = { x, y, z, w };
+	for (usize i = 0; i < lanes; i++) {
+		_mm_storeu_ps(dst[i] + offset, columns[i]);
+	}
+#endif
+}
+#endif
+
+transform_store_c::transform_store_c() {
+	this->count = 0;
+	this->capacity = 0;
+	this->block = nullptr;
+	for (usize i = 0; i < 3; i++) {
+		this->position[i] = nullptr;
+		this->rotation[i] = nullptr;
+		this->scale[i] = nullptr;
+	}
+}
+
+transform_store_c::~transform_store_c() {
+	if (this->block != nullptr) {
+		::operator delete[](this->block, std::align_val_t(TRANSFORM_STORE_ALIGNMENT));
+	}
+}
+
+void transform_store_c::reserve(usize capacity) {
+	if (capacity <= this->capacity) {
+		return;
+	}
+
+	/* rounded up to whole kernel iterations, which also keeps every array aligned inside the block */
+	capacity = std::max(capacity, this->capacity * 2);
+	capacity = (capacity + TRANSFORM_STORE_LANES - 1) / TRANSFORM_STORE_LANES * TRANSFORM_STORE_LANES;
+
+	f32* block = static_cast<f32*>(::operator new[](capacity * TRANSFORM_STORE_COMPONENTS * sizeof(f32), std::align_val_t(TRANSFORM_STORE_ALIGNMENT)));
+	std::memset(block, 0, capacity * TRANSFORM_STORE_COMPONENTS * sizeof(f32));
+
+	f32** components[TRANSFORM_STORE_COMPONENTS] = {
+		&this->position[0], &this->position[1], &this->position[2],
+		&this->rotation[0], &this->rotation[1], &this->rotation[2],
+		&this->scale[0], &this->scale[1], &this->scale[2],
+	};
+
+	for (usize i = 0; i < TRANSFORM_STORE_COMPONENTS; i++) {
+		f32* array = block + i * capacity;
+		if (this->count > 0) {
+			std::memcpy(array, *components[i], this->count * sizeof(f32));
+		}
+		*components[i] = array;
+	}
+
+	if (this->block != nullptr) {
+		::operator delete[](this->block, std::align_val_t(TRANSFORM_STORE_ALIGNMENT));
+	}
+
+	this->block = block;
+	this->capacity = capacity;
+}
+
+void transform_store_c::clear() {
+	this->count = 0;
+}
+
+u32 transform_store_c::push(const transform_t& transform) {
+	this->reserve(this->count + 1);
+	u32 index = static_cast<u32>(this->count++);
+	this->set(index, transform);
+	return index;
+}
+
+void transform_store_c::set(u32 index, const transform_t& transform) {
+	for (usize i = 0; i < 3; i++) {
+		this->position[i][index] = transform.position[i];
+		this->rotation[i][index] = transform.rotation[i];
+		this->scale[i][index] = transform.scale[i];
+	}
+}
+
+void transform_store_c::compose(transform_matrices_t* out, const u32* indices) const {
+#ifdef VF_LANES
+	for (usize first = 0; first < this->count; first += VF_LANES) {
+		usize lanes = std::min<usize>(VF_LANES, this->count - first);
+		f32* models[VF_LANES];
+		f32* rotations[VF_LANES];
+		for (usize i = 0; i < lanes; i++) {
+			transform_matrices_t& matrices = out[indices != nullptr ? indices[first + i] : first + i];
+			models[i] = matrices.model;
+			rotations[i] = matrices.rotation;
+		}
+
+		vf sx, cx, sy, cy, sz, cz;
+		vf_sincos_degrees(vf_load(this->rotation[0] + first), sx, cx);
+		vf_sincos_degrees(vf_load(this->rotation[1] + first), sy, cy);
+		vf_sincos_degrees(vf_load(this->rotation[2] + first), sz, cz);
+
+		/* Rx * Ry * Rz expanded, rCR is column C row R */
+		vf sx_sy = vf_mul(sx, sy);
+		vf cx_sy = vf_mul(cx, sy);
+		vf r00 = vf_mul(cz, cy);
+		vf r01 = vf_add(vf_mul(cz, sx_sy), vf_mul(sz, cx));
+		vf r02 = vf_sub(vf_mul(sz, sx), vf_mul(cz, cx_sy));
+		vf r10 = vf_sub(vf_set(0.0f), vf_mul(sz, cy));
+		vf r11 = vf_sub(vf_mul(cz, cx), vf_mul(sz, sx_sy));
+		vf r12 = vf_add(vf_mul(sz, cx_sy), vf_mul(cz, sx));
+		vf r20 = sy;
+		vf r21 = vf_sub(vf_set(0.0f), vf_mul(sx, cy));
+		vf r22 = vf_mul(cx, cy);
+
+		vf zero = vf_set(0.0f);
+		vf one = vf_set(1.0f);
+		vf_store_column(rotations, 0, lanes, r00, r01, r02, zero);
+		vf_store_column(rotations, 4, lanes, r10, r11, r12, zero);
+		vf_store_column(rotations, 8, lanes, r20, r21, r22, zero);
+		vf_store_column(rotations, 12, lanes, zero, zero, zero, one);
+
+		vf scale_x = vf_load(this->scale[0] + first);
+		vf scale_y = vf_load(this->scale[1] + first);
+		vf scale_z = vf_load(this->scale[2] + first);
+		vf_store_column(models, 0, lanes, vf_mul(r00, scale_x), vf_mul(r01, scale_x), vf_mul(r02, scale_x), zero);
+		vf_store_column(models, 4, lanes, vf_mul(r10, scale_y), vf_mul(r11, scale_y), vf_mul(r12, scale_y), zero);
+		vf_store_column(models, 8, lanes, vf_mul(r20, scale_z), vf_mul(r21, scale_z), vf_mul(r22, scale_z), zero);
+		vf_store_column(models, 12, lanes, vf_load(this->position[0] + first), vf_load(this->position[1] + first), vf_load(this->position[2] + first), one);
+	}
+#else
+	this->compose_scalar(out, indices);
+#endif
+}
+
+void transform_store_c::compose_scalar(transform_matrices_t* out, const u32* indices) const {
+	for (usize i = 0; i < this->count; i++) {
+		transform_matrices_t& matrices = out[indices != nullptr ? indices[i] : i];
+		f32 sx = std::sin(this->rotation[0][i] * 0.017453292519943295f);
+		f32 cx = std::cos(this->rotation[0][i] * 0.017453292519943295f);
+		f32 sy = std::sin(this->rotation[1][i] * 0.017453292519943295f);
+		f32 cy = std::cos(this->rotation[1][i] * 0.017453292519943295f);
+		f32 sz = std::sin(this->rotation[2][i] * 0.017453292519943295f);
+		f32 cz = std::cos(this->rotation[2][i] * 0.017453292519943295f);
+
+		f32 rotation[16] = {
+			cz * cy, cz * sx * sy + sz * cx, sz * sx - cz * cx * sy, 0,
+			-sz * cy, cz * cx - sz * sx * sy, sz * cx * sy + cz * sx, 0,
+			sy, -sx * cy, cx * cy, 0,
+			0, 0, 0, 1,
+		};
+		std::memcpy(matrices.rotation, rotation, sizeof(rotation));
+
+		for (usize column = 0; column < 3; column++) {
+			for (usize row = 0; row < 3; row++) {
+				matrices.model[column * 4 + row] = rotation[column * 4 + row] * this->scale[column][i];
+			}
+			matrices.model[column * 4 + 3] = 0;
+		}
+		matrices.model[12] = this->position[0][i];
+		matrices.model[13] = this->position[1][i];
+		matrices.model[14] = this->position[2][i];
+		matrices.model[15] = 1;
+	}
+}
+
+const char* transform_store_c::kernel() {
+	return VF_KERNEL;
+}
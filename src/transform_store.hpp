@@ -0,0 +1,48 @@
+#ifndef TRANSFORM_STORE_HPP
+#define TRANSFORM_STORE_HPP
+
+#include "types.hpp"
+#include "utils.hpp"
+
+/* transforms composed per kernel iteration, arrays are padded to this so there is never a scalar tail */
+#define TRANSFORM_STORE_LANES 8
+
+/* column-major, model = T * Rx * Ry * Rz * S and rotation = Rx * Ry * Rz */
+struct transform_matrices_t {
+	f32 model[16];
+	f32 rotation[16];
+};
+
+/* structure-of-arrays transforms, every component in its own 32 byte aligned array.
+ * rotations are euler angles in degrees, like transform_t */
+struct transform_store_c {
+	usize count;
+	usize capacity;
+	f32* position[3];
+	f32* rotation[3];
+	f32* scale[3];
+
+	transform_store_c();
+	~transform_store_c();
+	transform_store_c(const transform_store_c&) = delete;
+	transform_store_c& operator=(const transform_store_c&) = delete;
+
+	void reserve(usize capacity);
+	void clear();
+	u32 push(const transform_t& transform);
+	void set(u32 index, const transform_t& transform);
+
+	/* composes every stored transform, transform i is written to out[indices[i]] or out[i] when indices is null */
+	void compose(transform_matrices_t* out, const u32* indices) const;
+	/* compose() one transform at a time with libm's sin and cos, what compose() falls back to without a vector path.
+	 * always built, so the vector kernels can be checked against it */
+	void compose_scalar(transform_matrices_t* out, const u32* indices) const;
+
+	/* "avx2", "sse2" or "scalar", whichever compose() was built with */
+	static const char* kernel();
+
+private:
+	f32* block;
+};
+
+#endif
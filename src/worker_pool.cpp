@@ -0,0 +1,104 @@
+#include "worker_pool.hpp"
+
+worker_pool_c::worker_pool_c(usize threads) {
+	this->invoke = nullptr;
+	this->context = nullptr;
+	this->count = 0;
+	this->next = 0;
+	this->busy = 0;
+	this->generation = 0;
+	this->stopping = false;
+
+	if (threads == 0) {
+		usize hardware = std::thread::hardware_concurrency();
+		threads = hardware > 1 ? hardware - 1 : 0;
+	}
+
+	for (usize i = 0; i < threads; i++) {
+		this->threads.emplace_back(&worker_pool_c::work, this, 0);
+	}
+}
+
+worker_pool_c::~worker_pool_c() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+
+	this->start.notify_all();
+	for (usize i = 0; i < this->threads.size(); i++) {
+		this->threads[i].join();
+	}
+}
+
+usize worker_pool_c::concurrency() const {
+	return this->threads.size() + 1;
+}
+
+void worker_pool_c::drain(job_invoke_t invoke, const void* context, usize count) {
+	for (usize index = this->next.fetch_add(1); index < count; index = this->next.fetch_add(1)) {
+		invoke(context, index);
+	}
+}
+
+void worker_pool_c::work(u64 seen) {
+	for (;;) {
+		/* a worker waking after its parallel_for already returned copies a null job and does nothing */
+		job_invoke_t invoke;
+		const void* context;
+		usize count;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->start.wait(lock, [this, seen] { return this->stopping || this->generation != seen; });
+			if (this->stopping) {
+				return;
+			}
+
+			seen = this->generation;
+			invoke = this->invoke;
+			context = this->context;
+			count = this->count;
+			++this->busy;
+		}
+
+		this->drain(invoke, context, count);
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (--this->busy == 0) {
+			this->done.notify_all();
+		}
+	}
+}
+
+void worker_pool_c::run(usize count, job_invoke_t invoke, const void* context) {
+	if (count == 0) {
+		return;
+	}
+
+	/* not worth waking anyone for */
+	if (count == 1 || this->threads.empty()) {
+		for (usize i = 0; i < count; i++) {
+			invoke(context, i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->invoke = invoke;
+		this->context = context;
+		this->count = count;
+		this->next = 0;
+		++this->generation;
+	}
+
+	this->start.notify_all();
+	this->drain(invoke, context, count);
+
+	/* job has to outlive every worker that picked it up */
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->done.wait(lock, [this] { return this->busy == 0; });
+	this->invoke = nullptr;
+	this->context = nullptr;
+	this->count = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include "types.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* threads kept alive between frames that run one parallel_for at a time, the calling thread takes part too */
+struct worker_pool_c {
+	/* 0 picks one less than the hardware thread count */
+	worker_pool_c(usize threads = 0);
+	~worker_pool_c();
+	worker_pool_c(const worker_pool_c&) = delete;
+	worker_pool_c& operator=(const worker_pool_c&) = delete;
+
+	/* calls job(index) for every index in [0, count) and returns once all of them have finished.
+	 * the job is called through a plain function pointer, so unlike std::function nothing is allocated per call */
+	template <typename job_t>
+	void parallel_for(usize count, const job_t& job) {
+		this->run(count, [](const void* context, usize index) { (*static_cast<const job_t*>(context))(index); }, &job);
+	}
+
+	/* workers plus the calling thread */
+	usize concurrency() const;
+
+private:
+	typedef void (*job_invoke_t)(const void* context, usize index);
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable done;
+	job_invoke_t invoke;
+	const void* context;
+	usize count;
+	std::atomic<usize> next;
+	usize busy;
+	u64 generation;
+	b8 stopping;
+
+	void run(usize count, job_invoke_t invoke, const void* context);
+	void work(u64 seen);
+	void drain(job_invoke_t invoke, const void* context, usize count);
+};
+
+#endif